@@ -17,6 +17,7 @@
 #include <algorithm>
 #include "augment_image.hpp"
 #include "image.hpp"
+#include "object_pool.hpp"
 
 using namespace std;
 using namespace nervana;
@@ -116,13 +117,24 @@ emit_type augment::image::param_factory::get_emit_constraint_type()
         throw std::invalid_argument("Invalid emit constraint type");
 }
 
+void augment::image::params::reset()
+{
+    // keep the storage of lighting
+    vector<float> lighting_storage;
+    lighting_storage.swap(lighting);
+    *this = params();
+    lighting_storage.clear();
+    lighting.swap(lighting_storage);
+}
+
 shared_ptr<augment::image::params> augment::image::param_factory::make_params(
     size_t input_width, size_t input_height, size_t output_width, size_t output_height) const
 {
     // Must use this method for creating a shared_ptr rather than make_shared
     // since the params default ctor is private and factory is friend
     // make_shared is not friend :(
-    auto settings = shared_ptr<augment::image::params>(new augment::image::params());
+    auto settings = object_pool<augment::image::params>::acquire(
+        []() { return shared_ptr<augment::image::params>(new augment::image::params()); });
 
 #ifdef PYTHON_PLUGIN
     if (!plugin_filename.empty())
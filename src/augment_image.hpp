@@ -121,6 +121,9 @@ public:
     std::shared_ptr<plugin> user_plugin = nullptr;
 #endif
 
+    // Restores the defaults, called by object_pool when the params comes back
+    void reset();
+
 private:
     params() {}
 };
@@ -14,6 +14,9 @@
 * limitations under the License.
 *******************************************************************************/
 
+#include <algorithm>
+#include <sstream>
+
 #include "batch_decoder.hpp"
 #include "provider_factory.hpp"
 #include "batch_iterator.hpp"
@@ -26,7 +29,8 @@ batch_decoder::batch_decoder(shared_ptr<batch_iterator>                 b_itor,
                              uint32_t                                   thread_count,
                              bool                                       pinned,
                              const std::shared_ptr<provider_interface>& prov,
-                             uint32_t                                   seed)
+                             uint32_t                                   seed,
+                             size_t                                     feature_major_size)
     : async_manager<encoded_record_list, fixed_buffer_map>(b_itor, "batch_decoder")
     , m_batch_size(batch_size)
     , m_provider(prov)
@@ -36,9 +40,29 @@ batch_decoder::batch_decoder(shared_ptr<batch_iterator>                 b_itor,
         singleton<thread_pool_queue<batch_decoder, &batch_decoder::process>>::get(thread_count);
     m_number_elements_in = prov->get_input_count();
 
-    // Allocate the space in the output buffers
+    // Allocate the space in the output buffers.  For feature major output the records are
+    // written straight into batches of feature_major_size records, so they are only copied
+    // and not transposed later.
     for (unsigned int k = 0; k < 2; ++k)
+    {
         m_containers[k].add_items(prov->get_output_shapes(), batch_size, pinned);
+        m_containers[k].set_feature_major(feature_major_size);
+    }
+
+    // Feature major records are decoded in blocks of up to a cache line of each feature,
+    // which are written as runs so threads share at most the lines at the ends of a run.
+    // Every decode thread still gets at least one block.
+    if (feature_major_size != 0)
+    {
+        const size_t cache_line = 64;
+        size_t       block      = 1;
+        for (const auto& shape : prov->get_output_shapes())
+        {
+            block = max(block, cache_line / shape.second.get_otype().get_size());
+        }
+        size_t threads = max(1, m_thread_pool->get_thread_count());
+        m_block_size   = min(block, (batch_size + threads - 1) / threads);
+    }
 
     if (m_deterministic_mode)
     {
@@ -53,11 +77,34 @@ batch_decoder::~batch_decoder()
 }
 
 void batch_decoder::process(const int index)
+{
+    if (m_block_size == 0)
+    {
+        decode(index, *m_outputs, index);
+        return;
+    }
+
+    // the block is decoded batch major into a per thread buffer and then written feature major
+    size_t                        first = index * m_block_size;
+    size_t                        count = min(m_block_size, m_batch_size - first);
+    thread_local fixed_buffer_map block;
+    block.reshape(m_provider->get_output_shapes(), m_block_size);
+    for (size_t i = 0; i < count; i++)
+    {
+        decode(first + i, block, i);
+    }
+    for (const string& name : block.get_names())
+    {
+        (*m_outputs)[name]->write_items(first, block[name]->get_item(0), count);
+    }
+}
+
+void batch_decoder::decode(size_t index, fixed_buffer_map& outputs, size_t out_index)
 {
     if (m_deterministic_mode)
         get_thread_local_random_engine() = m_random[index];
 
-    m_provider->provide(index, *m_inputs, *m_outputs);
+    m_provider->provide(index, *m_inputs, outputs, out_index);
 
     if (m_deterministic_mode)
         m_random[index] = get_thread_local_random_engine();
@@ -83,10 +130,79 @@ fixed_buffer_map* batch_decoder::filler()
         {
             record.rethrow_if_exception();
         }
+        if (m_deterministic_mode)
+        {
+            lock_guard<mutex> lock(m_state_mutex);
+            m_random_states[m_batch_number] = m_random;
+        }
+        m_batch_number++;
         m_inputs  = inputs;
         m_outputs = outputs;
-        m_thread_pool->run(this, m_batch_size);
+        if (m_block_size == 0)
+        {
+            m_thread_pool->run(this, m_batch_size);
+        }
+        else
+        {
+            m_thread_pool->run(this, (m_batch_size + m_block_size - 1) / m_block_size);
+        }
     }
     m_state = async_state::idle;
     return outputs;
 }
+
+void batch_decoder::initialize()
+{
+    {
+        lock_guard<mutex> lock(m_state_mutex);
+        m_random_states.clear();
+    }
+    m_batch_number       = m_start_batch_number;
+    m_start_batch_number = 0;
+    async_manager<encoded_record_list, fixed_buffer_map>::initialize();
+}
+
+nlohmann::json batch_decoder::get_state(size_t batch_number) const
+{
+    nlohmann::json state;
+    if (m_deterministic_mode)
+    {
+        lock_guard<mutex> lock(m_state_mutex);
+        auto              it = m_random_states.find(batch_number);
+        if (it == m_random_states.end())
+        {
+            throw runtime_error("decoder state for batch " + std::to_string(batch_number) +
+                                " is no longer available");
+        }
+        for (const random_engine_t& engine : it->second)
+        {
+            stringstream ss;
+            ss << engine;
+            state.push_back(ss.str());
+        }
+    }
+    return state;
+}
+
+void batch_decoder::set_state(const nlohmann::json& state, size_t batch_number)
+{
+    if (m_deterministic_mode)
+    {
+        if (state.size() != m_random.size())
+        {
+            throw invalid_argument("decoder state does not match the batch size");
+        }
+        for (size_t i = 0; i < m_random.size(); i++)
+        {
+            stringstream ss(state[i].get<string>());
+            ss >> m_random[i];
+        }
+    }
+    m_start_batch_number = batch_number;
+}
+
+void batch_decoder::release_states(size_t batch_number)
+{
+    lock_guard<mutex> lock(m_state_mutex);
+    m_random_states.erase(m_random_states.begin(), m_random_states.lower_bound(batch_number));
+}
@@ -16,6 +16,9 @@
 
 #pragma once
 
+#include <map>
+#include <mutex>
+
 #include "async_manager.hpp"
 #include "buffer_batch.hpp"
 #include "provider_interface.hpp"
@@ -36,13 +39,15 @@ public:
                   uint32_t                                   thread_count,
                   bool                                       pinned,
                   const std::shared_ptr<provider_interface>& prov,
-                  uint32_t                                   seed = 0);
+                  uint32_t                                   seed               = 0,
+                  size_t                                     feature_major_size = 0);
 
     virtual ~batch_decoder();
 
     virtual size_t            record_count() const override { return m_batch_size; }
     virtual size_t            elements_per_record() const override { return m_number_elements_out; }
     virtual fixed_buffer_map* filler() override;
+    virtual void              initialize() override;
 
     void register_info_handler(std::function<void(const fixed_buffer_map*)>& f)
     {
@@ -51,8 +56,18 @@ public:
 
     void process(const int index);
 
+    // In deterministic mode the random engines are saved before each batch is decoded,
+    // numbered from the start of the stream, and kept until released.
+    nlohmann::json get_state(size_t batch_number) const;
+    void           set_state(const nlohmann::json& state, size_t batch_number);
+    void           release_states(size_t batch_number);
+
 private:
+    // Decodes record index into record out_index of outputs
+    void decode(size_t index, fixed_buffer_map& outputs, size_t out_index);
+
     size_t                                    m_batch_size;
+    size_t                                    m_block_size{0};
     size_t                                    m_number_elements_in;
     size_t                                    m_number_elements_out;
     std::shared_ptr<const provider_interface> m_provider;
@@ -63,4 +78,9 @@ private:
     size_t                                       m_iteration_number{0};
     std::vector<nervana::random_engine_t>        m_random;
     bool                                         m_deterministic_mode;
+
+    size_t                                         m_batch_number{0};
+    size_t                                         m_start_batch_number{0};
+    std::map<size_t, std::vector<random_engine_t>> m_random_states;
+    mutable std::mutex                             m_state_mutex;
 };
@@ -25,7 +25,8 @@
 using namespace nervana;
 using namespace std;
 
-batch_iterator::batch_iterator(shared_ptr<block_manager> blkl, size_t batch_size)
+batch_iterator::batch_iterator(shared_ptr<async_manager_source<encoded_record_list>> blkl,
+                               size_t                                                batch_size)
     : async_manager<encoded_record_list, encoded_record_list>(blkl, "batch_iterator")
     , m_batch_size(batch_size)
     , m_element_count(blkl->elements_per_record())
@@ -87,11 +88,13 @@ encoded_record_list* batch_iterator::filler()
 
 batch_iterator_fbm::batch_iterator_fbm(shared_ptr<batch_decoder>                  blkl,
                                        size_t                                     batch_size,
+                                       uint32_t                                   thread_count,
                                        const std::shared_ptr<provider_interface>& prov,
                                        bool                                       transpose)
     : async_manager<fixed_buffer_map, fixed_buffer_map>(blkl, "batch_iterator")
     , m_batch_size(batch_size)
     , m_transpose(transpose)
+    , m_thread_count(thread_count)
     , m_element_count(blkl->elements_per_record())
 {
     m_element_count = elements_per_record();
@@ -115,10 +118,11 @@ fixed_buffer_map* batch_iterator_fbm::filler()
     // This is for the first pass
     if (m_input_ptr == nullptr)
     {
-        m_state     = async_state::fetching_data;
-        m_input_ptr = m_source->next();
-        m_src_index = 0;
-        m_state     = async_state::processing;
+        m_state      = async_state::fetching_data;
+        m_input_ptr  = m_source->next();
+        m_src_index  = m_skip_count;
+        m_skip_count = 0;
+        m_state      = async_state::processing;
     }
 
     m_dst_index      = 0;
@@ -136,7 +140,28 @@ fixed_buffer_map* batch_iterator_fbm::filler()
         size_t       current_input_size = input_size - m_src_index;
         size_t move_count = (current_input_size <= remainder) ? current_input_size : remainder;
 
-        rc->copy(*m_input_ptr, m_src_index, m_dst_index, move_count, m_batch_size, m_transpose);
+        m_tiles.clear();
+        rc->copy(
+            *m_input_ptr, m_src_index, m_dst_index, move_count, m_batch_size, m_transpose, &m_tiles);
+        // the tiles must be done before the next input is fetched and this one is released.
+        // There are none when the decoder already writes feature major batches.
+        if (m_tiles.size() > 1)
+        {
+            if (!m_thread_pool)
+            {
+                m_thread_pool = singleton<
+                    thread_pool_queue<batch_iterator_fbm, &batch_iterator_fbm::process>>::
+                    get(m_thread_count);
+            }
+            m_thread_pool->run(this, m_tiles.size());
+        }
+        else
+        {
+            for (const fixed_buffer_map::transpose_tile& tile : m_tiles)
+            {
+                tile.run();
+            }
+        }
 
         m_src_index += move_count;
         m_dst_index += move_count;
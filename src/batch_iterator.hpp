@@ -19,6 +19,7 @@
 #include "async_manager.hpp"
 #include "buffer_batch.hpp"
 #include "provider_interface.hpp"
+#include "thread_pool.hpp"
 #include "util.hpp"
 
 /* block_loader_file
@@ -38,7 +39,7 @@ namespace nervana
 class nervana::batch_iterator : public async_manager<encoded_record_list, encoded_record_list>
 {
 public:
-    batch_iterator(std::shared_ptr<block_manager>, size_t batch_size);
+    batch_iterator(std::shared_ptr<async_manager_source<encoded_record_list>>, size_t batch_size);
     ~batch_iterator() { finalize(); }
     encoded_record_list* filler() override;
 
@@ -61,6 +62,7 @@ class nervana::batch_iterator_fbm : public async_manager<fixed_buffer_map, fixed
 public:
     batch_iterator_fbm(std::shared_ptr<batch_decoder>             blkl,
                        size_t                                     batch_size,
+                       uint32_t                                   thread_count,
                        const std::shared_ptr<provider_interface>& prov,
                        bool                                       transpose);
     ~batch_iterator_fbm() { finalize(); }
@@ -74,11 +76,22 @@ public:
         async_manager<fixed_buffer_map, fixed_buffer_map>::initialize();
     }
 
+    // drop the first record_count records after the next initialize()
+    void skip_records(size_t record_count) { m_skip_count = record_count; }
+    // transposes one tile of the current batch
+    void process(const int index) { m_tiles[index].run(); }
+
 private:
     size_t            m_batch_size;
     bool              m_transpose;
+    uint32_t          m_thread_count;
     size_t            m_element_count;
     fixed_buffer_map* m_input_ptr{nullptr};
-    size_t            m_src_index = 0;
-    size_t            m_dst_index = 0;
+    size_t            m_src_index  = 0;
+    size_t            m_dst_index  = 0;
+    size_t            m_skip_count = 0;
+
+    std::vector<fixed_buffer_map::transpose_tile> m_tiles;
+    std::shared_ptr<thread_pool_queue<batch_iterator_fbm, &batch_iterator_fbm::process>>
+        m_thread_pool;
 };
@@ -51,49 +51,43 @@ nervana::encoded_record_list* block_loader_file::filler()
     rc->clear();
 
     m_state    = async_state::fetching_data;
-    auto block = m_source->next();
+    auto block = m_manifest->next_block();
     m_state    = async_state::processing;
     if (block != nullptr)
     {
-        for (auto element_list : *block)
+        // elements are read in place from the manifest's record table
+        const vector<manifest::element_t>& types = m_manifest->get_element_types();
+        for (size_t i = 0; i < block->size(); i++)
         {
-            const vector<manifest::element_t>& types = m_manifest->get_element_types();
-            encoded_record                     record;
+            encoded_record record;
             for (int j = 0; j < m_elements_per_record; ++j)
             {
                 try
                 {
-                    const string& element = element_list[j];
+                    const char* data = block->data(i, j);
+                    size_t      size = block->element_size(i, j);
                     switch (types[j])
                     {
                     case manifest::element_t::FILE:
                     {
-                        auto buffer = file_util::read_file_contents(element);
+                        auto buffer = file_util::read_file_contents(string(data, size));
                         record.add_element(std::move(buffer));
                         break;
                     }
                     case manifest::element_t::BINARY:
                     {
-                        vector<char> buffer  = string2vector(element);
-                        vector<char> decoded = base64::decode(buffer);
+                        vector<char> decoded = base64::decode(data, size);
                         record.add_element(std::move(decoded));
                         break;
                     }
                     case manifest::element_t::STRING:
-                    {
-                        record.add_element(element.data(), element.size());
-                        break;
-                    }
                     case manifest::element_t::ASCII_INT:
-                    {
-                        int32_t value = stod(element);
-                        record.add_element(&value, sizeof(value));
-                        break;
-                    }
                     case manifest::element_t::ASCII_FLOAT:
                     {
-                        float value = stof(element);
-                        record.add_element(&value, sizeof(value));
+                        // numeric elements were already converted to binary by the manifest.
+                        // The record table lives as long as the manifest, so the elements
+                        // refer to it instead of copying.
+                        record.add_reference(data, size);
                         break;
                     }
                     }
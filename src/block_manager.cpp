@@ -46,12 +46,101 @@ nervana::block_manager::block_manager(shared_ptr<block_loader_source> file_loade
 
 void block_manager::initialize()
 {
-    m_current_block_number = 0;
-    if (m_cache)
-        m_cache->restart();
+    {
+        lock_guard<mutex> lock(m_state_mutex);
+        m_epoch_states.clear();
+    }
+
+    bool read_cache = m_cache && m_cache->is_complete();
+    if (m_start_state.is_null())
+    {
+        m_current_block_number = 0;
+        m_epoch                = 0;
+        m_manifest_epoch       = 0;
+        if (m_cache)
+            m_cache->restart();
+        begin_epoch(read_cache, true);
+    }
+    else
+    {
+        read_cache             = m_start_state.at("source") == "cache";
+        m_current_block_number = read_cache ? m_cache->get_block_number() : m_start_block_number;
+        m_epoch                = m_start_state.at("epoch");
+        m_manifest_epoch       = m_start_state.at("manifest_epoch");
+        begin_epoch(read_cache, false);
+        m_start_state        = nullptr;
+        m_start_block_number = 0;
+    }
     async_manager<encoded_record_list, encoded_record_list>::initialize();
 }
 
+void block_manager::begin_epoch(bool read_cache, bool whole_epoch)
+{
+    m_read_cache  = read_cache;
+    m_store_cache = !read_cache && whole_epoch && m_cache && m_cache->is_ownership();
+
+    nlohmann::json state = {{"source", read_cache ? "cache" : "manifest"},
+                            {"manifest_epoch", m_manifest_epoch}};
+    if (read_cache)
+    {
+        state["cache"] = m_cache->get_state();
+    }
+
+    lock_guard<mutex> lock(m_state_mutex);
+    m_epoch_states[m_epoch] = std::move(state);
+}
+
+nlohmann::json block_manager::get_state(size_t epoch, size_t record_offset) const
+{
+    lock_guard<mutex> lock(m_state_mutex);
+    auto              it = m_epoch_states.find(epoch);
+    if (it == m_epoch_states.end())
+    {
+        throw runtime_error("block state for epoch " + std::to_string(epoch) +
+                            " is no longer available");
+    }
+    nlohmann::json state   = it->second;
+    state["epoch"]         = epoch;
+    state["record_offset"] = record_offset;
+    return state;
+}
+
+void block_manager::set_state(const nlohmann::json& state, size_t block_index)
+{
+    if (state.at("source") == "cache")
+    {
+        if (!m_cache || !m_cache->is_complete())
+        {
+            throw invalid_argument("loader state needs the complete cache it was saved with");
+        }
+        m_cache->set_state(state.at("cache"), state.at("record_offset"));
+    }
+    else if (m_cache)
+    {
+        // blocks stored before the restore belong to no epoch, so storing starts again
+        m_cache->restart();
+    }
+    m_start_block_number = block_index;
+    m_start_state        = state;
+}
+
+void block_manager::release_states(size_t epoch)
+{
+    lock_guard<mutex> lock(m_state_mutex);
+    m_epoch_states.erase(m_epoch_states.begin(), m_epoch_states.lower_bound(epoch));
+}
+
+size_t block_manager::manifest_epoch(size_t epoch) const
+{
+    lock_guard<mutex> lock(m_state_mutex);
+    auto              it = m_epoch_states.upper_bound(epoch);
+    if (it == m_epoch_states.begin())
+    {
+        return 0;
+    }
+    return (--it)->second.at("manifest_epoch");
+}
+
 nervana::encoded_record_list* block_manager::filler()
 {
     m_state                    = async_state::wait_for_buffer;
@@ -61,7 +150,7 @@ nervana::encoded_record_list* block_manager::filler()
 
     rc->clear();
 
-    if (m_cache && m_cache->is_complete())
+    if (m_read_cache)
     {
         m_cache->load_block(*rc);
     }
@@ -76,18 +165,25 @@ nervana::encoded_record_list* block_manager::filler()
         }
         else
         {
-            if (m_cache && m_cache->is_ownership())
+            if (m_store_cache)
                 m_cache->store_block(*input);
             input->swap(*rc);
         }
+    }
 
-        if (++m_current_block_number == m_block_count)
+    if (++m_current_block_number == m_block_count)
+    {
+        m_current_block_number = 0;
+        if (!m_read_cache)
         {
-            m_current_block_number = 0;
+            m_manifest_epoch++;
             m_source->reset();
-            if (m_cache)
+            // an owner that did not store this epoch keeps its lock and stores the next one
+            if (m_cache && !m_cache->is_ownership())
                 m_cache->try_get_access();
         }
+        m_epoch++;
+        begin_epoch(m_cache && m_cache->is_complete(), true);
     }
 
     if (rc && rc->size() == 0)
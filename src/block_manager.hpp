@@ -16,6 +16,8 @@
 
 #pragma once
 
+#include <map>
+#include <mutex>
 #include <string>
 
 #include "async_manager.hpp"
@@ -28,6 +30,10 @@
  *
  * Reads files from the manifest and optionally caches and shuffles them.
  *
+ * Each epoch is read either from the manifest or from a complete cache. A cache
+ * is only written by its owner during an epoch read from the first block, so a
+ * restored epoch that starts part way through is never stored.
+ *
  */
 
 namespace nervana
@@ -49,13 +55,35 @@ public:
 
     virtual void initialize() override;
 
+    // The source of every epoch is saved when the epoch starts, numbered from the start of
+    // the stream, and kept until released. For the manifest the state holds how many epochs
+    // were read from it before, for the cache it holds the cache's block order.
+    // set_state() makes the next initialize() continue the saved epoch at record_offset,
+    // which for the manifest is the start of block number block_index.
+    nlohmann::json get_state(size_t epoch, size_t record_offset) const;
+    void           set_state(const nlohmann::json& state, size_t block_index);
+    void           release_states(size_t epoch);
+
+    // number of epochs read from the manifest before epoch
+    size_t manifest_epoch(size_t epoch) const;
+
     size_t record_count() const override { return m_block_size; }
     size_t elements_per_record() const override { return m_elements_per_record; }
 private:
-    std::unique_ptr<cache_system> m_cache;
-    size_t                        m_current_block_number;
-    size_t                        m_block_size;
-    size_t                        m_block_count;
-    size_t                        m_record_count;
-    size_t                        m_elements_per_record;
+    void begin_epoch(bool read_cache, bool whole_epoch);
+
+    std::unique_ptr<cache_system>    m_cache;
+    size_t                           m_current_block_number;
+    size_t                           m_start_block_number{0};
+    size_t                           m_block_size;
+    size_t                           m_block_count;
+    size_t                           m_record_count;
+    size_t                           m_elements_per_record;
+    bool                             m_read_cache{false};
+    bool                             m_store_cache{false};
+    size_t                           m_epoch{0};
+    size_t                           m_manifest_epoch{0};
+    nlohmann::json                   m_start_state;
+    std::map<size_t, nlohmann::json> m_epoch_states;
+    mutable std::mutex               m_state_mutex;
 };
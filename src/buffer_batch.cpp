@@ -21,12 +21,6 @@
 #include "log.hpp"
 #include "transpose.hpp"
 
-enum TransposeType
-{
-    REGULAR,
-    SSE
-};
-
 using namespace std;
 using namespace nervana;
 
@@ -67,6 +61,7 @@ buffer_fixed_size_elements::buffer_fixed_size_elements(const buffer_fixed_size_e
     , m_batch_size{rhs.m_batch_size}
     , m_stride{rhs.m_stride}
     , m_pinned{rhs.m_pinned}
+    , m_group_size{rhs.m_group_size}
 {
     allocate();
     memcpy(m_data, rhs.m_data, m_size);
@@ -97,6 +92,7 @@ void buffer_fixed_size_elements::move(buffer_fixed_size_elements& second)
     swap(m_batch_size, second.m_batch_size);
     swap(m_stride, second.m_stride);
     swap(m_pinned, second.m_pinned);
+    swap(m_group_size, second.m_group_size);
 }
 
 char* buffer_fixed_size_elements::get_item(size_t index)
@@ -147,6 +143,80 @@ const char* buffer_fixed_size_elements::get_item(size_t index) const
     return &m_data[offset];
 }
 
+void buffer_fixed_size_elements::set_feature_major(size_t group_size)
+{
+    if (group_size != 0 && m_batch_size % group_size != 0)
+    {
+        throw invalid_argument("buffer_fixed_size: batch size must be a multiple of group size");
+    }
+    m_group_size = group_size;
+}
+
+// Writes count elements of the record at src, stride bytes apart at dest
+template <typename T>
+static void scatter(char* dest, const char* src, size_t count, size_t stride)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        memcpy(dest + i * stride, src + i * sizeof(T), sizeof(T));
+    }
+}
+
+void buffer_fixed_size_elements::write_items(size_t index, const char* src, size_t count)
+{
+    if (index + count > m_batch_size)
+    {
+        throw invalid_argument("buffer_fixed_size: count out-of-range");
+    }
+    if (m_group_size == 0)
+    {
+        memcpy(&m_data[index * m_stride], src, count * m_stride);
+        return;
+    }
+
+    size_t element_size = m_shape_type.get_otype().get_size();
+    size_t elements     = m_stride / element_size;
+    size_t dest_stride  = m_group_size * element_size;
+    for (size_t r = 0; r < count;)
+    {
+        // the run of records in the same group
+        size_t      i    = index + r;
+        size_t      off  = i % m_group_size;
+        size_t      run  = min(count - r, m_group_size - off);
+        char*       dest = &m_data[(i - off) * m_stride + off * element_size];
+        const char* s    = src + r * m_stride;
+        if (run == 1)
+        {
+            switch (element_size)
+            {
+            case 1: scatter<uint8_t>(dest, s, elements, dest_stride); break;
+            case 2: scatter<uint16_t>(dest, s, elements, dest_stride); break;
+            case 4: scatter<uint32_t>(dest, s, elements, dest_stride); break;
+            case 8: scatter<uint64_t>(dest, s, elements, dest_stride); break;
+            default:
+                for (size_t e = 0; e < elements; e++)
+                {
+                    memcpy(dest + e * dest_stride, s + e * element_size, element_size);
+                }
+            }
+        }
+        else
+        {
+            // the run x elements block is transposed into the rows of the group
+            transpose::transpose_columns(dest,
+                                         m_group_size,
+                                         s,
+                                         run,
+                                         elements,
+                                         element_size,
+                                         0,
+                                         elements,
+                                         transpose::best_isa());
+        }
+        r += run;
+    }
+}
+
 void buffer_fixed_size_elements::allocate()
 {
 #if HAS_GPU
@@ -185,76 +255,67 @@ void buffer_fixed_size_elements::deallocate()
 #endif
 }
 
-// Transposes the rows and columns of a matrix
-template <typename T>
-static void transpose_regular(T* dest, const T* src, int rows, int cols)
+buffer_fixed_size_elements::~buffer_fixed_size_elements()
 {
-    int dst_indx = 0;
-    int src_indx = 0;
-    for (int c = 0; c < cols; ++c)
-    {
-        src_indx = c;
-        for (int r = 0; r < rows; ++r)
-        {
-            dest[dst_indx++] = src[src_indx];
-            src_indx += cols;
-        }
-    }
+    deallocate();
 }
 
-static void transpose_buf(
-    char* dest, char* src, size_t rows, size_t cols, size_t element_size, TransposeType type)
+// Copies count records of the feature major src into dst, which is feature major in
+// groups of batch_size records
+static void copy_feature_major(const buffer_fixed_size_elements& src,
+                               buffer_fixed_size_elements&       dst,
+                               size_t                            src_index,
+                               size_t                            dst_index,
+                               size_t                            count,
+                               size_t                            batch_size)
 {
-    switch (element_size)
-    {
-    case 1:
-    {
-        if (type == TransposeType::REGULAR)
-            transpose_regular<uint8_t>(
-                reinterpret_cast<uint8_t*>(dest), reinterpret_cast<uint8_t*>(src), rows, cols);
-        else if (type == TransposeType::SSE)
-            transpose::sse::transpose<1>(
-                reinterpret_cast<uint8_t*>(dest), reinterpret_cast<uint8_t*>(src), rows, cols);
-        break;
-    }
-    case 2:
-        if (type == TransposeType::REGULAR)
-            transpose_regular<uint16_t>(
-                reinterpret_cast<uint16_t*>(dest), reinterpret_cast<uint16_t*>(src), rows, cols);
-        else if (type == TransposeType::SSE)
-            transpose::sse::transpose<2>(
-                reinterpret_cast<uint8_t*>(dest), reinterpret_cast<uint8_t*>(src), rows, cols);
-        break;
-    case 4:
+    size_t stride       = src.get_stride();
+    size_t element_size = src.get_shape_type().get_otype().get_size();
+    size_t elements     = stride / element_size;
+    size_t group        = src.get_feature_major_group();
+    for (size_t r = 0; r < count;)
     {
-        if (type == TransposeType::REGULAR)
-            transpose_regular<uint32_t>(
-                reinterpret_cast<uint32_t*>(dest), reinterpret_cast<uint32_t*>(src), rows, cols);
-        else if (type == TransposeType::SSE)
-            transpose::sse::transpose<4>(
-                reinterpret_cast<uint8_t*>(dest), reinterpret_cast<uint8_t*>(src), rows, cols);
-        break;
-    }
-    case 8:
-        transpose_regular<uint64_t>(
-            reinterpret_cast<uint64_t*>(dest), reinterpret_cast<uint64_t*>(src), rows, cols);
-        break;
-    default: throw "unsupported datatype for transpose";
+        // the run of records in the same group of src and batch of dst
+        size_t      s      = src_index + r;
+        size_t      d      = dst_index + r;
+        size_t      s_off  = s % group;
+        size_t      d_off  = d % batch_size;
+        size_t      run    = min(min(count - r, group - s_off), batch_size - d_off);
+        const char* s_base = src.data() + (s - s_off) * stride;
+        char*       d_base = dst.data() + (d - d_off) * stride;
+        if (run == group && run == batch_size)
+        {
+            memcpy(d_base, s_base, run * stride);
+        }
+        else
+        {
+            for (size_t e = 0; e < elements; e++)
+            {
+                memcpy(d_base + (e * batch_size + d_off) * element_size,
+                       s_base + (e * group + s_off) * element_size,
+                       run * element_size);
+            }
+        }
+        r += run;
     }
 }
 
-buffer_fixed_size_elements::~buffer_fixed_size_elements()
+void fixed_buffer_map::transpose_tile::run() const
 {
-    deallocate();
+    transpose::transpose_columns(dest, src, rows, cols, element_size, c0, c1);
 }
 
-void fixed_buffer_map::copy(fixed_buffer_map& src,
-                            size_t            src_index,
-                            size_t            dst_index,
-                            size_t            count,
-                            size_t            batch_size,
-                            bool              transpose)
+void fixed_buffer_map::copy(fixed_buffer_map&            src,
+                            size_t                       src_index,
+                            size_t                       dst_index,
+                            size_t                       count,
+                            size_t                       batch_size,
+                            bool                         transpose,
+                            std::vector<transpose_tile>* tiles)
 {
+    // smallest tile worth handing to another thread
+    const size_t min_tile_bytes = 256 * 1024;
+
     for (auto name : m_names)
     {
         buffer_fixed_size_elements* src_fbm = src[name];
@@ -268,12 +329,34 @@ void fixed_buffer_map::copy(fixed_buffer_map& src,
 
         int element_size = (this->operator[](name))->get_shape_type().get_otype().get_size();
         int cols         = count * src_fbm->get_stride() / batch_size / element_size;
-        if (transpose && batch_size > 1 && cols > 1)
-            if ((cols % 16) ||
-                (batch_size % 16)) //data must be bounded to 16 elements for using SSE
-                transpose_buf(p_dst, p_src, batch_size, cols, element_size, TransposeType::REGULAR);
+        if (src_fbm->get_feature_major_group() != 0)
+        {
+            copy_feature_major(*src_fbm, *dst_fbm, src_index, dst_index, count, batch_size);
+        }
+        else if (transpose && batch_size > 1 && cols > 1)
+        {
+            if (tiles == nullptr)
+            {
+                transpose::transpose(p_dst, p_src, batch_size, cols, element_size);
+            }
             else
-                transpose_buf(p_dst, p_src, batch_size, cols, element_size, TransposeType::SSE);
+            {
+                // whole multiples of the 64 column cache tiles used by the kernels
+                size_t tile_cols = min_tile_bytes / (batch_size * element_size);
+                tile_cols        = max<size_t>(64, (tile_cols + 63) / 64 * 64);
+                for (size_t c0 = 0; c0 < size_t(cols); c0 += tile_cols)
+                {
+                    transpose_tile tile = {p_dst,
+                                           p_src,
+                                           batch_size,
+                                           size_t(cols),
+                                           size_t(element_size),
+                                           c0,
+                                           min<size_t>(c0 + tile_cols, cols)};
+                    tiles->push_back(tile);
+                }
+            }
+        }
         else
             memcpy(p_dst, p_src, count * src_fbm->get_stride());
     }
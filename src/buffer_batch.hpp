@@ -34,13 +34,100 @@ namespace nervana
 {
     class buffer_fixed_size_elements;
     class fixed_buffer_map;
+    class variable_record_field;
     class encoded_record;
     class encoded_record_list;
 
-    typedef std::vector<char>                           variable_record_field;
     typedef std::vector<nervana::variable_record_field> variable_record_field_list;
 }
 
+// One element of an encoded record.  It holds its own bytes, or refers without a copy to
+// bytes that outlive the record, such as the record table of the manifest.
+class nervana::variable_record_field
+{
+public:
+    variable_record_field() {}
+    variable_record_field(const char* begin, const char* end)
+        : m_owned(begin, end)
+    {
+        own();
+    }
+    variable_record_field(const std::vector<char>& data)
+        : m_owned(data)
+    {
+        own();
+    }
+    variable_record_field(std::vector<char>&& data)
+        : m_owned(std::move(data))
+    {
+        own();
+    }
+    variable_record_field(const variable_record_field& other)
+        : m_owned(other.m_owned)
+    {
+        assign(other);
+    }
+    variable_record_field(variable_record_field&& other)
+        : m_owned(std::move(other.m_owned))
+    {
+        assign(other);
+    }
+    variable_record_field& operator=(const variable_record_field& other)
+    {
+        m_owned = other.m_owned;
+        assign(other);
+        return *this;
+    }
+    variable_record_field& operator=(variable_record_field&& other)
+    {
+        m_owned = std::move(other.m_owned);
+        assign(other);
+        return *this;
+    }
+
+    // Refers to size bytes at data, which must stay valid for as long as the field is used
+    static variable_record_field reference(const char* data, size_t size)
+    {
+        variable_record_field field;
+        field.m_data      = data;
+        field.m_size      = size;
+        field.m_reference = true;
+        return field;
+    }
+
+    const char* data() const { return m_data; }
+    size_t      size() const { return m_size; }
+    bool        empty() const { return m_size == 0; }
+    const char* begin() const { return m_data; }
+    const char* end() const { return m_data + m_size; }
+    const char& operator[](size_t index) const { return m_data[index]; }
+private:
+    void own()
+    {
+        m_data      = m_owned.data();
+        m_size      = m_owned.size();
+        m_reference = false;
+    }
+    void assign(const variable_record_field& other)
+    {
+        if (other.m_reference)
+        {
+            m_data      = other.m_data;
+            m_size      = other.m_size;
+            m_reference = true;
+        }
+        else
+        {
+            own();
+        }
+    }
+
+    std::vector<char> m_owned;
+    const char*       m_data{nullptr};
+    size_t            m_size{0};
+    bool              m_reference{false};
+};
+
 class nervana::encoded_record
 {
     friend class encoded_record_list;
@@ -51,17 +138,17 @@ public:
     size_t size() const { return m_elements.size(); }
     void add_element(const void* data, size_t size)
     {
-        std::vector<char> tmp(size);
-        const char*       p = (const char*)data;
-        for (size_t i = 0; i < size; i++)
-        {
-            tmp[i] = p[i];
-        }
-        m_elements.emplace_back(tmp);
+        const char* p = (const char*)data;
+        m_elements.emplace_back(p, p + size);
     }
 
     void add_element(const std::vector<char>& data) { m_elements.emplace_back(data); }
     void add_element(std::vector<char>&& data) { m_elements.emplace_back(std::move(data)); }
+    // Adds an element that refers to size bytes at data, see variable_record_field
+    void add_reference(const char* data, size_t size)
+    {
+        m_elements.push_back(variable_record_field::reference(data, size));
+    }
     void add_exception(std::exception_ptr e) { m_exception = e; }
     variable_record_field_list::iterator  begin() { return m_elements.begin(); }
     variable_record_field_list::iterator  end() { return m_elements.end(); }
@@ -174,6 +261,20 @@ public:
     size_t            size() const { return m_size; }
     size_t            get_stride() const { return m_stride; }
     const shape_type& get_shape_type() const { return m_shape_type; }
+
+    // Stores the records feature major in groups of group_size records, so element e of
+    // record r is at element (r / group_size) * group_size * elements + e * group_size +
+    // r % group_size.  Records are then no longer contiguous and are written with
+    // write_item.  A group_size of 0 restores the batch major layout.
+    void   set_feature_major(size_t group_size);
+    size_t get_feature_major_group() const { return m_group_size; }
+    // Copies the batch major record at src into record index
+    void write_item(size_t index, const char* src) { write_items(index, src, 1); }
+    // Copies count batch major records at src into records index to index + count - 1.
+    // Each feature is written as one run of records per group, so a block of at least a
+    // cache line of records fills whole lines instead of one element of each.
+    void write_items(size_t index, const char* src, size_t count);
+
     std::ostream& serialize(std::ostream& out) const;
     std::istream& deserialize(std::istream& in);
 
@@ -184,6 +285,7 @@ protected:
     size_t     m_batch_size{0};
     size_t     m_stride{0};
     bool       m_pinned{false};
+    size_t     m_group_size{0};
 };
 
 class nervana::fixed_buffer_map
@@ -260,12 +362,61 @@ public:
         return (it == m_data.end() ? nullptr : it->second);
     }
 
-    void copy(fixed_buffer_map& src,
-              size_t            src_index,
-              size_t            dst_index,
-              size_t            count,
-              size_t            batch_size,
-              bool              transpose);
+    // Makes the map hold batch_size records of each of write_sizes, keeping the buffers
+    // when they already do
+    void reshape(const std::vector<std::pair<std::string, shape_type>>& write_sizes,
+                 size_t batch_size)
+    {
+        bool same = m_data.size() == write_sizes.size();
+        for (size_t i = 0; same && i < write_sizes.size(); i++)
+        {
+            const buffer_fixed_size_elements* b = operator[](write_sizes[i].first);
+            same = b != nullptr && b->get_shape_type() == write_sizes[i].second &&
+                   b->get_item_count() == batch_size;
+        }
+        if (!same)
+        {
+            clear();
+            add_items(write_sizes, batch_size);
+        }
+    }
+
+    // See buffer_fixed_size_elements::set_feature_major
+    void set_feature_major(size_t group_size)
+    {
+        for (auto buf : m_data)
+            buf.second->set_feature_major(group_size);
+    }
+
+    bool is_feature_major() const
+    {
+        return !m_data.empty() && m_data.front().second->get_feature_major_group() != 0;
+    }
+
+    // Columns [c0, c1) of a transpose made by copy, which can run in parallel with the
+    // other tiles of the same transpose
+    struct transpose_tile
+    {
+        char*       dest;
+        const char* src;
+        size_t      rows;
+        size_t      cols;
+        size_t      element_size;
+        size_t      c0;
+        size_t      c1;
+
+        void run() const;
+    };
+
+    // When tiles is given the transposes are appended to it instead of being done here.
+    // A feature major src is copied as is into the feature major batch.
+    void copy(fixed_buffer_map&            src,
+              size_t                       src_index,
+              size_t                       dst_index,
+              size_t                       count,
+              size_t                       batch_size,
+              bool                         transpose,
+              std::vector<transpose_tile>* tiles = nullptr);
 
     size_t        size() const { return m_data.size(); }
     std::ostream& serialize(std::ostream& out) const;
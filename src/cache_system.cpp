@@ -41,6 +41,7 @@ cache_system::cache_system(source_uid_t       uid,
     , m_current_block_number{0}
     , m_random{seed ? seed : random_device{}()}
 {
+    m_pass_random = m_random;
     m_block_load_sequence.resize(m_block_count);
     iota(m_block_load_sequence.begin(), m_block_load_sequence.end(), 0);
 
@@ -65,6 +66,55 @@ cache_system::~cache_system()
 void cache_system::restart()
 {
     m_current_block_number = 0;
+    m_skip_count           = 0;
+    m_pass_random          = m_random;
+}
+
+nlohmann::json cache_system::get_state() const
+{
+    stringstream random;
+    random << m_pass_random;
+    return {{"block_load_sequence", m_block_load_sequence}, {"random", random.str()}};
+}
+
+void cache_system::set_state(const nlohmann::json& state, size_t record_offset)
+{
+    vector<size_t> sequence = state.at("block_load_sequence");
+    if (sequence.size() != m_block_count)
+    {
+        throw invalid_argument("cache state does not match the cache");
+    }
+
+    // find the block holding record_offset from the record counts in the block headers
+    size_t index = 0;
+    while (index < sequence.size())
+    {
+        string       block_name = create_cache_block_name(sequence[index]);
+        ifstream     file(file_util::path_join(m_cache_dir, block_name));
+        cpio::reader reader(file);
+        if (record_offset < reader.record_count())
+        {
+            break;
+        }
+        record_offset -= reader.record_count();
+        index++;
+    }
+    if (index == sequence.size())
+    {
+        throw invalid_argument("record offset is beyond the end of the cache");
+    }
+
+    stringstream random(state.at("random").get<string>());
+    random >> m_random;
+    m_pass_random = m_random;
+    if (m_shuffle_enabled)
+    {
+        // one draw shuffles each block read before this one
+        m_random.discard(index);
+    }
+    m_block_load_sequence  = sequence;
+    m_current_block_number = index;
+    m_skip_count           = record_offset;
 }
 void cache_system::try_get_access()
 {
@@ -102,7 +152,14 @@ void cache_system::load_block(encoded_record_list& buffer)
                 buffer.add_record(record);
             }
             if (m_shuffle_enabled)
-                buffer.shuffle(std::random_device{}());
+                buffer.shuffle(m_random());
+            if (m_skip_count > 0)
+            {
+                // a restored pass may start part way into its first block
+                encoded_record_list skipped;
+                buffer.move_to(skipped, m_skip_count);
+                m_skip_count = 0;
+            }
         }
     }
     else
@@ -113,6 +170,7 @@ void cache_system::load_block(encoded_record_list& buffer)
         m_current_block_number = 0;
         if (m_shuffle_enabled)
             shuffle(m_block_load_sequence.begin(), m_block_load_sequence.end(), m_random);
+        m_pass_random = m_random;
     }
 }
 
@@ -142,6 +200,7 @@ void cache_system::store_block(const encoded_record_list& buffer)
         m_stage = complete;
         if (m_shuffle_enabled)
             shuffle(m_block_load_sequence.begin(), m_block_load_sequence.end(), m_random);
+        m_pass_random = m_random;
     }
 }
 
@@ -21,6 +21,7 @@
 
 #include "buffer_batch.hpp"
 #include "block_loader_source.hpp"
+#include "json.hpp"
 
 namespace nervana
 {
@@ -44,6 +45,12 @@ public:
     void try_get_access();
     void restart();
 
+    // get_state() describes the block order and random engine at the start of the current
+    // pass. set_state() continues such a pass from record number record_offset of the pass.
+    nlohmann::json get_state() const;
+    void           set_state(const nlohmann::json& state, size_t record_offset);
+    size_t         get_block_number() const { return m_current_block_number; }
+
 private:
     enum stages
     {
@@ -60,8 +67,10 @@ private:
     bool                     m_shuffle_enabled;
     size_t                   m_elements_per_record;
     size_t                   m_current_block_number;
+    size_t                   m_skip_count{0};
     int                      m_cache_lock = -1;
     std::minstd_rand0        m_random;
+    std::minstd_rand0        m_pass_random;
 
     static std::mutex m_mutex;
 
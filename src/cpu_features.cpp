@@ -0,0 +1,91 @@
+/*******************************************************************************
+* Copyright 2016-2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#define AEON_X86
+#endif
+
+#include "cpu_features.hpp"
+
+using namespace nervana;
+
+namespace
+{
+#ifdef AEON_X86
+    // Register state the OS saves on context switches, from XCR0
+    unsigned int os_saved_state()
+    {
+        unsigned int eax, ebx, ecx, edx;
+        if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_OSXSAVE))
+        {
+            return 0;
+        }
+        unsigned int xcr0_lo, xcr0_hi;
+        __asm__("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+        return xcr0_lo;
+    }
+
+    // sse and avx state
+    bool os_saves_avx() { return (os_saved_state() & 0x06) == 0x06; }
+
+    // and the opmask, upper zmm0-15 and zmm16-31 state
+    bool os_saves_avx512() { return (os_saved_state() & 0xE6) == 0xE6; }
+
+    unsigned int extended_features()
+    {
+        unsigned int eax, ebx, ecx, edx;
+        if (__get_cpuid_max(0, nullptr) < 7)
+        {
+            return 0;
+        }
+        __cpuid_count(7, 0, eax, ebx, ecx, edx);
+        return ebx;
+    }
+#endif
+}
+
+bool cpu::has_f16c()
+{
+#ifdef AEON_X86
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+    {
+        return false;
+    }
+    return (ecx & bit_F16C) && (ecx & bit_AVX) && os_saves_avx();
+#else
+    return false;
+#endif
+}
+
+bool cpu::has_avx2()
+{
+#ifdef AEON_X86
+    return (extended_features() & bit_AVX2) && os_saves_avx();
+#else
+    return false;
+#endif
+}
+
+bool cpu::has_avx512f()
+{
+#ifdef AEON_X86
+    return (extended_features() & bit_AVX512F) && os_saves_avx512();
+#else
+    return false;
+#endif
+}
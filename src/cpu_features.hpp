@@ -0,0 +1,29 @@
+/*******************************************************************************
+* Copyright 2016-2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#pragma once
+
+namespace nervana
+{
+    namespace cpu
+    {
+        // Instruction set extensions the CPU and OS support, for picking kernels at run
+        // time.  All are false on other architectures than x86.
+        bool has_f16c();
+        bool has_avx2();
+        bool has_avx512f();
+    }
+}
@@ -15,6 +15,8 @@
 *******************************************************************************/
 
 #include "etl_audio.hpp"
+#include "float16.hpp"
+#include "wav_data.hpp"
 
 using namespace std;
 using namespace nervana;
@@ -22,6 +24,14 @@ using namespace nervana;
 /** \brief Extract audio data from a wav file using sox */
 std::shared_ptr<audio::decoded> audio::extractor::extract(const void* item, size_t itemSize) const
 {
+    // 16 bit mono PCM wav is used where it is, anything else is decoded by sox
+    cv::Mat samples;
+    if (wav_data::wrap(static_cast<const char*>(item), itemSize, samples))
+    {
+        auto decoded          = make_shared<audio::decoded>(samples);
+        decoded->wraps_record = true;
+        return decoded;
+    }
     return make_shared<audio::decoded>(nervana::read_audio_from_mem((const char*)item, itemSize));
 }
 
@@ -31,10 +41,14 @@ audio::transformer::transformer(const audio::config& config)
     if (_cfg.feature_type != "samples")
     {
         specgram::create_window(_cfg.window_type, _cfg.frame_length_tn, _window);
+        _fft.reset(new real_fft(_cfg.frame_length_tn));
+        cv::Mat filterbank;
         specgram::create_filterbanks(
-            _cfg.num_filters, _cfg.frame_length_tn, _cfg.sample_freq_hz, _filterbank);
+            _cfg.num_filters, _cfg.frame_length_tn, _cfg.sample_freq_hz, filterbank);
+        int num_cepstra = _cfg.feature_type == "mfcc" ? _cfg.num_cepstra : 0;
+        _filterbank.reset(new mel_filterbank(filterbank, num_cepstra));
     }
-    _noisemaker = make_shared<noise_clips>(_cfg.noise_index_file, _cfg.noise_root);
+    _noisemaker = noise_clips::get(_cfg.noise_index_file, _cfg.noise_root, _cfg.noise_bank_file);
 }
 
 audio::transformer::~transformer()
@@ -56,6 +70,11 @@ std::shared_ptr<audio::decoded>
                                   std::shared_ptr<audio::decoded>         decoded) const
 {
     cv::Mat& samples_mat = decoded->get_time_data();
+    if (params->add_noise && decoded->wraps_record)
+    {
+        samples_mat           = samples_mat.clone();
+        decoded->wraps_record = false;
+    }
     _noisemaker->addNoise(samples_mat,
                           params->add_noise,
                           params->noise_index,
@@ -71,7 +90,7 @@ std::shared_ptr<audio::decoded>
     {
         // convert from time domain to frequency domain into the freq mat
         specgram::wav_to_specgram(samples_mat,
-                                  _cfg.frame_length_tn,
+                                  *_fft,
                                   _cfg.frame_stride_tn,
                                   _cfg.time_steps,
                                   _window,
@@ -79,15 +98,15 @@ std::shared_ptr<audio::decoded>
         if (_cfg.feature_type != "specgram")
         {
             cv::Mat tmpmat;
-            specgram::specgram_to_cepsgram(decoded->get_freq_data(), _filterbank, tmpmat);
             if (_cfg.feature_type == "mfcc")
             {
-                specgram::cepsgram_to_mfcc(tmpmat, _cfg.num_cepstra, decoded->get_freq_data());
+                _filterbank->mfcc(decoded->get_freq_data(), tmpmat);
             }
             else
             {
-                decoded->get_freq_data() = tmpmat;
+                _filterbank->mfsc(decoded->get_freq_data(), tmpmat);
             }
+            decoded->get_freq_data() = tmpmat;
         }
 
         // place into a destination with the appropriate time dimensions
@@ -114,7 +133,8 @@ void audio::loader::load(const vector<void*>& outbuf, shared_ptr<audio::decoded>
 {
     auto nframes = input->valid_frames;
     auto frames  = input->get_freq_data();
-    int  cv_type = _cfg.get_shape_type().get_otype().get_cv_type();
+    auto otype   = _cfg.get_shape_type().get_otype();
+    int  cv_type = otype.is_half() ? CV_32F : otype.get_cv_type();
 
     if (_cfg.feature_type != "samples")
     {
@@ -131,9 +151,20 @@ void audio::loader::load(const vector<void*>& outbuf, shared_ptr<audio::decoded>
         padded_frames(cv::Range(nframes, _cfg.time_steps), cv::Range::all()) = cv::Scalar::all(0);
     }
 
-    cv::Mat dst(_cfg.freq_steps, _cfg.time_steps, cv_type, (void*)outbuf[0]);
-    cv::transpose(padded_frames, dst);
-    cv::flip(dst, dst, 0);
+    if (otype.is_half())
+    {
+        // transpose in float and narrow into the output
+        cv::Mat dst;
+        cv::transpose(padded_frames, dst);
+        cv::flip(dst, dst, 0);
+        convert_to_half(dst, outbuf[0], otype);
+    }
+    else
+    {
+        cv::Mat dst(_cfg.freq_steps, _cfg.time_steps, cv_type, (void*)outbuf[0]);
+        cv::transpose(padded_frames, dst);
+        cv::flip(dst, dst, 0);
+    }
 
     if (_cfg.emit_length)
     {
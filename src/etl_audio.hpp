@@ -95,6 +95,9 @@ public:
 
     std::string noise_index_file{};
     std::string noise_root{};
+    /** File of noise clips already decoded, read with mmap.  It is made from
+    * noise_index_file when it does not exist. */
+    std::string noise_bank_file{};
 
     /** Sample rate of input audio in hertz */
     uint32_t sample_freq_hz{16000};
@@ -235,6 +238,7 @@ private:
         ADD_SCALAR(window_type, mode::OPTIONAL),
         ADD_SCALAR(noise_index_file, mode::OPTIONAL),
         ADD_SCALAR(noise_root, mode::OPTIONAL),
+        ADD_SCALAR(noise_bank_file, mode::OPTIONAL),
         ADD_SCALAR(add_noise_probability, mode::OPTIONAL),
         ADD_SCALAR(sample_freq_hz, mode::OPTIONAL),
         ADD_DISTRIBUTION(time_scale_fraction,
@@ -288,6 +292,8 @@ public:
     cv::Mat& get_time_data() { return time_rep; }
     cv::Mat& get_freq_data() { return freq_rep; }
     uint32_t valid_frames{0};
+    // the samples are in the encoded record and must be copied before being changed
+    bool wraps_record{false};
 
 protected:
     cv::Mat time_rep{};
@@ -317,10 +323,11 @@ private:
     transformer() = delete;
     void scale_time(cv::Mat& img, float scale_fraction);
 
-    std::shared_ptr<noise_clips> _noisemaker{nullptr};
-    const audio::config&         _cfg;
-    cv::Mat                      _window{};
-    cv::Mat                      _filterbank{};
+    std::shared_ptr<noise_clips>    _noisemaker{nullptr};
+    const audio::config&            _cfg;
+    cv::Mat                         _window{};
+    std::unique_ptr<real_fft>       _fft;
+    std::unique_ptr<mel_filterbank> _filterbank;
 };
 
 class nervana::audio::loader : public interface::loader<audio::decoded>
@@ -17,6 +17,7 @@
 #include <sstream>
 #include "etl_boundingbox.hpp"
 #include "log.hpp"
+#include "object_pool.hpp"
 
 using namespace std;
 using namespace nervana;
@@ -134,7 +135,7 @@ void boundingbox::extractor::extract(const void*                            data
 shared_ptr<boundingbox::decoded> boundingbox::extractor::extract(const void* data,
                                                                  size_t      size) const
 {
-    shared_ptr<decoded> rc = make_shared<decoded>();
+    shared_ptr<decoded> rc = object_pool<decoded>::acquire();
     extract(data, size, rc);
     return rc;
 }
@@ -173,6 +174,15 @@ bool boundingbox::transformer::meet_emit_constraint(const cv::Rect& cropbox,
 
 vector<bbox> boundingbox::transformer::transform_box(const std::vector<bbox>&           boxes,
                                                      shared_ptr<augment::image::params> pptr)
+{
+    vector<bbox> rc;
+    transform_box(boxes, pptr, rc);
+    return rc;
+}
+
+void boundingbox::transformer::transform_box(const std::vector<bbox>&           boxes,
+                                             shared_ptr<augment::image::params> pptr,
+                                             vector<bbox>&                      rc)
 {
     cv::Rect crop    = pptr->cropbox;
     float    x_scale = (float)(pptr->output_size.width) / (float)(crop.width);
@@ -185,7 +195,7 @@ vector<bbox> boundingbox::transformer::transform_box(const std::vector<bbox>&
     * scale
     */
 
-    vector<bbox> rc;
+    rc.clear();
     for (bbox b : boxes)
     {
         if (pptr->expand_ratio > 1.)
@@ -261,7 +271,6 @@ vector<bbox> boundingbox::transformer::transform_box(const std::vector<bbox>&
     if (pptr->user_plugin)
         rc = pptr->user_plugin->augment_boundingbox(rc);
 #endif
-    return rc;
 }
 
 int nervana::boundingbox::extractor::get_label(const json& object) const
@@ -286,8 +295,8 @@ shared_ptr<boundingbox::decoded>
     {
         return shared_ptr<boundingbox::decoded>();
     }
-    shared_ptr<boundingbox::decoded> rc = make_shared<boundingbox::decoded>();
-    rc->m_boxes                         = transform_box(boxes->boxes(), pptr);
+    shared_ptr<boundingbox::decoded> rc = object_pool<boundingbox::decoded>::acquire();
+    transform_box(boxes->boxes(), pptr, rc->m_boxes);
 
     return rc;
 }
@@ -81,6 +81,8 @@ public:
     int                                  height() const { return m_height; }
     int                                  depth() const { return m_depth; }
     cv::Size2i image_size() const override { return cv::Size2i(m_width, m_height); }
+    // Called by object_pool when the decoded comes back
+    void reset() { m_boxes.clear(); }
 protected:
     std::vector<boundingbox::box> m_boxes;
     int                           m_width;
@@ -117,6 +119,11 @@ public:
         transform_box(const std::vector<boundingbox::box>&    b,
                       std::shared_ptr<augment::image::params> pptr);
 
+    // Writes the transformed boxes to rc, reusing its storage
+    static void transform_box(const std::vector<boundingbox::box>&    b,
+                              std::shared_ptr<augment::image::params> pptr,
+                              std::vector<boundingbox::box>&          rc);
+
 private:
     static bool meet_emit_constraint(const cv::Rect&         cropbox,
                                      const boundingbox::box& input_bbox,
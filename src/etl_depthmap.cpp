@@ -15,6 +15,7 @@
 *******************************************************************************/
 
 #include "etl_depthmap.hpp"
+#include "float16.hpp"
 
 using namespace std;
 using namespace nervana;
@@ -102,13 +103,24 @@ void depthmap::loader::load(const std::vector<void*>&  outlist,
     char* outbuf = (char*)outlist[0];
     // TODO: Generalize this to also handle multi_crop case
     auto img          = input->get_image(0);
-    auto cv_type      = _cfg.get_shape_type().get_otype().get_cv_type();
-    auto element_size = _cfg.get_shape_type().get_otype().get_size();
+    auto otype        = _cfg.get_shape_type().get_otype();
+    auto cv_type      = otype.get_cv_type();
+    auto element_size = otype.get_size();
     int  image_size   = img.channels() * img.total() * element_size;
 
+    // half types are mixed as float and then narrowed
+    vector<float> half_buffer;
+    if (otype.is_half())
+    {
+        cv_type      = CV_32F;
+        element_size = sizeof(float);
+        half_buffer.resize(img.channels() * img.total());
+    }
+
     for (int i = 0; i < input->get_image_count(); i++)
     {
         auto outbuf_i = outbuf + (i * image_size);
+        auto target_i = otype.is_half() ? (char*)half_buffer.data() : outbuf_i;
         img           = input->get_image(i);
         vector<cv::Mat> source;
         vector<cv::Mat> target;
@@ -120,14 +132,14 @@ void depthmap::loader::load(const std::vector<void*>&  outlist,
             for (int ch = 0; ch < _cfg.channels; ch++)
             {
                 target.emplace_back(
-                    img.size(), cv_type, (char*)(outbuf_i + ch * img.total() * element_size));
+                    img.size(), cv_type, (char*)(target_i + ch * img.total() * element_size));
                 from_to.push_back(ch);
                 from_to.push_back(ch);
             }
         }
         else
         {
-            target.emplace_back(img.size(), CV_MAKETYPE(cv_type, _cfg.channels), (char*)(outbuf_i));
+            target.emplace_back(img.size(), CV_MAKETYPE(cv_type, _cfg.channels), (char*)(target_i));
             for (int ch = 0; ch < _cfg.channels; ch++)
             {
                 from_to.push_back(ch);
@@ -135,5 +147,9 @@ void depthmap::loader::load(const std::vector<void*>&  outlist,
             }
         }
         image::convert_mix_channels(source, target, from_to);
+        if (otype.is_half())
+        {
+            convert_to_half(half_buffer.data(), outbuf_i, half_buffer.size(), otype);
+        }
     }
 }
@@ -19,8 +19,12 @@
 #include "python_plugin.hpp"
 #endif
 #include "output_saver.hpp"
+#include "float16.hpp"
+#include "object_pool.hpp"
+#include "raw_image.hpp"
 
 #include <atomic>
+#include <cstring>
 
 using namespace std;
 using namespace nervana;
@@ -60,6 +64,25 @@ void image::config::validate()
     {
         throw invalid_argument("invalid height");
     }
+    if (!mean.empty() || !stddev.empty())
+    {
+        if (output_type != "float" && output_type != "float16" && output_type != "bfloat16")
+        {
+            throw invalid_argument("image mean and stddev need a floating point output_type");
+        }
+        if ((!mean.empty() && mean.size() != channels) ||
+            (!stddev.empty() && stddev.size() != channels))
+        {
+            throw invalid_argument("image mean and stddev need one value per channel");
+        }
+        for (float v : stddev)
+        {
+            if (v <= 0)
+            {
+                throw invalid_argument("image stddev must be positive");
+            }
+        }
+    }
 }
 
 /* Extract */
@@ -75,11 +98,32 @@ image::extractor::extractor(const image::config& cfg)
     {
         _pixel_type = CV_MAKETYPE(CV_8U, cfg.channels);
         _color_mode = cfg.channels == 1 ? CV_LOAD_IMAGE_GRAYSCALE : CV_LOAD_IMAGE_COLOR;
+        _channels   = cfg.channels;
     }
 }
 
 shared_ptr<image::decoded> image::extractor::extract(const void* inbuf, size_t insize) const
 {
+    auto rc = object_pool<image::decoded>::acquire();
+
+    // pre-processed raw images need no decoding, their pixels are used where they are
+    cv::Mat raw_img;
+    if (raw_image::wrap(inbuf, insize, raw_img))
+    {
+        if (raw_img.channels() != _channels)
+        {
+            // give the channels imdecode would have given
+            bool    alpha = raw_img.channels() == 4;
+            int     code  = _channels == 1 ? (alpha ? CV_BGRA2GRAY : CV_BGR2GRAY)
+                                           : (alpha ? CV_BGRA2BGR : CV_GRAY2BGR);
+            cv::Mat converted;
+            cv::cvtColor(raw_img, converted, code);
+            raw_img = converted;
+        }
+        rc->add(raw_img);
+        return rc;
+    }
+
     cv::Mat output_img;
 
     // It is bad to cast away const, but opencv does not support a const Mat
@@ -87,11 +131,54 @@ shared_ptr<image::decoded> image::extractor::extract(const void* inbuf, size_t i
     cv::Mat input_img(1, insize, _pixel_type, (char*)inbuf);
     cv::imdecode(input_img, _color_mode, &output_img);
 
-    auto rc = make_shared<image::decoded>();
     rc->add(output_img); // don't need to check return for single image
     return rc;
 }
 
+shared_ptr<image::decoded>
+    image::extractor::extract(const void* inbuf, size_t insize, int reduction) const
+{
+#if CV_VERSION_MAJOR >= 3
+    int color = _color_mode == CV_LOAD_IMAGE_COLOR;
+    int mode;
+    switch (reduction)
+    {
+    case 1: mode = _color_mode; break;
+    case 2: mode = color ? cv::IMREAD_REDUCED_COLOR_2 : cv::IMREAD_REDUCED_GRAYSCALE_2; break;
+    case 4: mode = color ? cv::IMREAD_REDUCED_COLOR_4 : cv::IMREAD_REDUCED_GRAYSCALE_4; break;
+    case 8: mode = color ? cv::IMREAD_REDUCED_COLOR_8 : cv::IMREAD_REDUCED_GRAYSCALE_8; break;
+    default: throw invalid_argument("image reduction must be 1, 2, 4 or 8");
+    }
+
+    auto    rc = object_pool<image::decoded>::acquire();
+    cv::Mat output_img;
+    cv::Mat input_img(1, insize, _pixel_type, (char*)inbuf);
+    cv::imdecode(input_img, mode, &output_img);
+
+    rc->add(output_img);
+    return rc;
+#else
+    // reduced decode needs OpenCV 3
+    (void)reduction;
+    return extract(inbuf, insize);
+#endif
+}
+
+shared_ptr<image::decoded> image::extractor::extract_roi(const void*     inbuf,
+                                                         size_t          insize,
+                                                         int             reduction,
+                                                         const cv::Rect& roi) const
+{
+    shared_ptr<image::decoded> rc;
+    cv::Mat                    output_img;
+    if (image::decode_jpeg_roi(inbuf, insize, _channels, reduction, roi, output_img))
+    {
+        rc = object_pool<image::decoded>::acquire();
+        rc->add(output_img);
+    }
+    return rc;
+}
+
 /* Transform:
     image::config will be a supplied bunch of params used by this provider.
     on each record, the transformer will use the config along with the supplied
@@ -114,14 +201,14 @@ shared_ptr<image::decoded>
     image::transformer::transform(shared_ptr<augment::image::params> img_xform,
                                   shared_ptr<image::decoded>         img) const
 {
-    vector<cv::Mat> finalImageList;
+    auto rc        = object_pool<image::decoded>::acquire();
+    bool same_size = true;
     for (int i = 0; i < img->get_image_count(); i++)
     {
-        finalImageList.push_back(transform_single_image(img_xform, img->get_image(i)));
+        same_size &= rc->add(transform_single_image(img_xform, img->get_image(i)));
     }
 
-    auto rc = make_shared<image::decoded>();
-    if (rc->add(finalImageList) == false)
+    if (!same_size)
     {
         rc = nullptr;
     }
@@ -137,7 +224,8 @@ shared_ptr<image::decoded>
  * flip
  */
 cv::Mat image::transformer::transform_single_image(shared_ptr<augment::image::params> img_xform,
-                                                   cv::Mat& single_img) const
+                                                   cv::Mat& single_img,
+                                                   cv::Mat  buffer) const
 {
     // img_xform->dump(cout);
     cv::Mat rotatedImage;
@@ -153,8 +241,19 @@ cv::Mat image::transformer::transform_single_image(shared_ptr<augment::image::pa
     cv::Mat croppedImage = expandedImage(img_xform->cropbox);
     image::add_padding(croppedImage, img_xform->padding, img_xform->padding_crop_offset);
 
-    cv::Mat resizedImage;
+    cv::Mat resizedImage = buffer;
     image::resize(croppedImage, resizedImage, img_xform->output_size);
+    bool photometric = img_xform->contrast != 1.0 || img_xform->brightness != 1.0 ||
+                       img_xform->saturation != 1.0 || img_xform->hue != 0 ||
+                       !img_xform->lighting.empty();
+    if (resizedImage.data == croppedImage.data && photometric)
+    {
+        // the photometric steps work in place, keep them off the decoded image, which
+        // may be a view of the encoded record or shared by several views
+        croppedImage.copyTo(buffer);
+        resizedImage = buffer;
+    }
+    bool resized = resizedImage.data != croppedImage.data;
     photo.cbsjitter(resizedImage,
                     img_xform->contrast,
                     img_xform->brightness,
@@ -163,7 +262,13 @@ cv::Mat image::transformer::transform_single_image(shared_ptr<augment::image::pa
     photo.lighting(resizedImage, img_xform->lighting, img_xform->color_noise_std);
 
     cv::Mat flippedImage;
-    if (img_xform->flip)
+    if (img_xform->flip && resized)
+    {
+        // the resized image is our own, flip it in place
+        cv::flip(resizedImage, resizedImage, 1);
+        flippedImage = resizedImage;
+    }
+    else if (img_xform->flip)
     {
         cv::flip(resizedImage, flippedImage, 1);
     }
@@ -189,77 +294,136 @@ cv::Mat image::transformer::transform_single_image(shared_ptr<augment::image::pa
     return *finalImage;
 }
 
+int image::transformer::decode_reduction(const augment::image::params& img_xform)
+{
+    // padding and expand are given in pixels of the full size image
+    if (img_xform.padding > 0 || img_xform.expand_ratio > 1.0)
+    {
+        return 1;
+    }
+
+    int reduction = 8;
+    while (reduction > 1 && (img_xform.cropbox.width < img_xform.output_size.width * reduction ||
+                             img_xform.cropbox.height < img_xform.output_size.height * reduction))
+    {
+        reduction /= 2;
+    }
+    return reduction;
+}
+
+bool image::transformer::roi_decode_supported(const augment::image::params& img_xform)
+{
+    // rotation samples around the center of the whole image and expand and padding
+    // place the whole image on a larger canvas
+    return img_xform.angle == 0 && img_xform.expand_ratio <= 1.0 && img_xform.padding == 0;
+}
+
+shared_ptr<augment::image::params> image::transformer::reduce_params(
+    const augment::image::params& img_xform, int reduction, cv::Size2i decoded_size)
+{
+    auto rc = object_pool<augment::image::params>::acquire(
+        [&]() { return make_shared<augment::image::params>(img_xform); });
+    *rc = img_xform;
+
+    float    scale = 1.0f / reduction;
+    cv::Rect crop(unbiased_round(img_xform.cropbox.x * scale),
+                  unbiased_round(img_xform.cropbox.y * scale),
+                  unbiased_round(img_xform.cropbox.width * scale),
+                  unbiased_round(img_xform.cropbox.height * scale));
+    rc->cropbox = crop & cv::Rect(cv::Point2i(0, 0), decoded_size);
+    return rc;
+}
+
 image::loader::loader(const image::config& cfg, bool fixed_aspect_ratio)
     : m_channel_major{cfg.channel_major}
     , m_fixed_aspect_ratio{fixed_aspect_ratio}
     , m_stype{cfg.get_shape_type()}
     , m_channels{cfg.channels}
+    , m_scale(cfg.channels, 1.0f)
+    , m_offset(cfg.channels, 0.0f)
 {
+    for (int ch = 0; ch < m_channels; ch++)
+    {
+        float mean   = cfg.mean.empty() ? 0.0f : cfg.mean[ch];
+        float stddev = cfg.stddev.empty() ? 1.0f : cfg.stddev[ch];
+        m_scale[ch]  = 1.0f / stddev;
+        m_offset[ch] = -mean / stddev;
+    }
 }
 
 void image::loader::load(const vector<void*>& outlist, shared_ptr<image::decoded> input) const
 {
-    char* outbuf = (char*)outlist[0];
-    // TODO: Generalize this to also handle multi_crop case
-    auto cv_type      = m_stype.get_otype().get_cv_type();
-    auto element_size = m_stype.get_otype().get_size();
-    auto img          = input->get_image(0);
-    int  image_size   = img.channels() * img.total() * element_size;
+    char* outbuf       = (char*)outlist[0];
+    auto  otype        = m_stype.get_otype();
+    auto  cv_type      = otype.get_cv_type();
+    auto  element_size = otype.get_size();
+    bool  is_half      = otype.is_half();
+
+    // with fixed_aspect_ratio every image goes to the top left of a canvas of the output size
+    vector<size_t> shape       = m_stype.get_shape();
+    cv::Size2i     canvas_size = m_channel_major ? cv::Size2i(shape[2], shape[1])
+                                                 : cv::Size2i(shape[1], shape[0]);
 
     for (int i = 0; i < input->get_image_count(); i++)
     {
-        auto            outbuf_i    = outbuf + (i * image_size);
-        auto            input_image = input->get_image(i);
-        vector<cv::Mat> source;
-        vector<cv::Mat> target;
-        vector<int>     from_to;
+        auto       input_image = input->get_image(i);
+        cv::Size2i canvas      = m_fixed_aspect_ratio ? canvas_size : input_image.size();
+        char*      outbuf_i    = outbuf + i * canvas.area() * m_channels * element_size;
 
-        if (m_fixed_aspect_ratio)
+        if ((cv_type == CV_32F || is_half) && input_image.depth() == CV_8U)
         {
-            // zero out the output buffer as the image may not fill the canvas
-            for (int j = 0; j < m_stype.get_byte_size(); j++)
+            // convert, normalize and scatter the channels in one pass
+            size_t count  = canvas.area() * input_image.channels();
+            float* target = reinterpret_cast<float*>(outbuf_i);
+            if (is_half)
             {
-                outbuf[j] = 0;
+                // half types are narrowed from a float copy of the canvas kept per thread
+                thread_local static vector<float> half_buffer;
+                if (half_buffer.size() < count)
+                {
+                    half_buffer.resize(count);
+                }
+                target = half_buffer.data();
             }
-
-            vector<size_t> shape = m_stype.get_shape();
-            // methods for image_var
-            if (m_channel_major)
+            image::convert_scale_channels(input_image,
+                                          target,
+                                          canvas,
+                                          m_channel_major,
+                                          m_scale.data(),
+                                          m_offset.data());
+            if (m_fixed_aspect_ratio)
             {
-                // Split into separate channels
-                int      width           = shape[1];
-                int      height          = shape[2];
-                int      pix_per_channel = width * height;
-                cv::Mat  b(width, height, CV_8U, outbuf);
-                cv::Mat  g(width, height, CV_8U, outbuf + pix_per_channel);
-                cv::Mat  r(width, height, CV_8U, outbuf + 2 * pix_per_channel);
-                cv::Rect roi(0, 0, input_image.cols, input_image.rows);
-                cv::Mat  b_roi       = b(roi);
-                cv::Mat  g_roi       = g(roi);
-                cv::Mat  r_roi       = r(roi);
-                cv::Mat  channels[3] = {b_roi, g_roi, r_roi};
-                cv::split(input_image, channels);
+                clear_outside(reinterpret_cast<char*>(target),
+                              canvas,
+                              input_image.size(),
+                              sizeof(float));
             }
-            else
+            if (is_half)
             {
-                int     channels = shape[2];
-                int     width    = shape[1];
-                int     height   = shape[0];
-                cv::Mat output(height, width, CV_8UC(channels), outbuf);
-                cv::Mat target_roi = output(cv::Rect(0, 0, input_image.cols, input_image.rows));
-                input_image.copyTo(target_roi);
+                convert_to_half(target, outbuf_i, count, otype);
             }
         }
+        else if (m_fixed_aspect_ratio ||
+                 (cv_type == CV_8U && m_channel_major && input_image.type() == CV_8UC3))
+        {
+            place(input_image, outbuf_i, canvas);
+        }
         else
         {
-            // methods for image
+            // methods for image, with lists kept per thread to save allocating them
+            thread_local static vector<cv::Mat> source;
+            thread_local static vector<cv::Mat> target;
+            thread_local static vector<int>     from_to;
+            source.clear();
+            target.clear();
+            from_to.clear();
             source.push_back(input_image);
             if (m_channel_major)
             {
                 for (int ch = 0; ch < m_channels; ch++)
                 {
-                    target.emplace_back(
-                        img.size(), cv_type, (char*)(outbuf_i + ch * img.total() * element_size));
+                    char* plane = outbuf_i + ch * input_image.total() * element_size;
+                    target.emplace_back(input_image.size(), cv_type, plane);
                     from_to.push_back(ch);
                     from_to.push_back(ch);
                 }
@@ -275,6 +439,70 @@ void image::loader::load(const vector<void*>& outlist, shared_ptr<image::decoded
                 }
             }
             image::convert_mix_channels(source, target, from_to);
+
+            // let go of the image so that its buffer can be reused
+            source.clear();
+        }
+    }
+}
+
+void image::loader::place(const cv::Mat& input_image, char* outbuf, const cv::Size2i& canvas) const
+{
+    auto   cv_type      = m_stype.get_otype().get_cv_type();
+    size_t element_size = m_stype.get_otype().get_size();
+    size_t plane_size   = canvas.area() * element_size;
+
+    cv::Rect roi(cv::Point2i(0, 0), input_image.size());
+    if (m_channel_major)
+    {
+        // converted images go through a buffer kept per thread
+        thread_local static cv::Mat conversion_buffer;
+        const cv::Mat*              converted = &input_image;
+        if (input_image.depth() != cv_type)
+        {
+            input_image.convertTo(conversion_buffer, cv_type);
+            converted = &conversion_buffer;
+        }
+
+        if (converted->type() == CV_8UC3)
+        {
+            uint8_t* planes = reinterpret_cast<uint8_t*>(outbuf);
+            image::split_channels(
+                *converted, planes, planes + plane_size, planes + 2 * plane_size, canvas.width);
+        }
+        else
+        {
+            // channels is 1 or 3
+            cv::Mat channels[3];
+            for (int ch = 0; ch < m_channels; ch++)
+            {
+                channels[ch] = cv::Mat(canvas, cv_type, outbuf + ch * plane_size)(roi);
+            }
+            cv::split(*converted, channels);
         }
     }
+    else
+    {
+        // converts straight into the canvas when the types differ
+        cv::Mat output(canvas, CV_MAKETYPE(cv_type, m_channels), outbuf);
+        cv::Mat target_roi = output(roi);
+        input_image.convertTo(target_roi, cv_type);
+    }
+    clear_outside(outbuf, canvas, input_image.size(), element_size);
+}
+
+void image::loader::clear_outside(char*             outbuf,
+                                  const cv::Size2i& canvas,
+                                  const cv::Size2i& image_size,
+                                  size_t            element_size) const
+{
+    // zero the canvas around the image, it may not fill the canvas
+    if (m_channel_major)
+    {
+        image::clear_outside(outbuf, canvas, image_size, element_size, m_channels);
+    }
+    else
+    {
+        image::clear_outside(outbuf, canvas, image_size, element_size * m_channels, 1);
+    }
 }
@@ -63,8 +63,15 @@ public:
     uint32_t    width;
     std::string output_type{"uint8_t"};
 
-    bool     channel_major = true;
-    uint32_t channels      = 3;
+    bool     channel_major   = true;
+    uint32_t channels        = 3;
+    bool     reduced_decode  = false;
+    bool     roi_decode      = false;
+    bool     fused_transform = false;
+
+    // per channel normalization (value - mean) / stddev, in BGR order
+    std::vector<float> mean;
+    std::vector<float> stddev;
 
     std::string name;
 
@@ -83,6 +90,11 @@ private:
         ADD_SCALAR(name, mode::OPTIONAL),
         ADD_SCALAR(channel_major, mode::OPTIONAL),
         ADD_SCALAR(channels, mode::OPTIONAL, [](uint32_t v) { return v == 1 || v == 3; }),
+        ADD_SCALAR(reduced_decode, mode::OPTIONAL),
+        ADD_SCALAR(roi_decode, mode::OPTIONAL),
+        ADD_SCALAR(fused_transform, mode::OPTIONAL),
+        ADD_SCALAR(mean, mode::OPTIONAL),
+        ADD_SCALAR(stddev, mode::OPTIONAL),
         ADD_SCALAR(output_type, mode::OPTIONAL, [](const std::string& v) {
             return output_type::is_valid_type(v);
         })};
@@ -125,6 +137,9 @@ public:
         return get_image_size().area() * get_image_channels() * get_image_count();
     }
     cv::Size2i image_size() const override { return _images[0].size(); }
+    // Called by object_pool when the decoded comes back, lets go of the images and keeps
+    // only the capacity of the list
+    void reset() { _images.clear(); }
 protected:
     bool all_images_are_same_size()
     {
@@ -145,10 +160,20 @@ public:
     ~extractor() {}
     virtual std::shared_ptr<image::decoded> extract(const void*, size_t) const override;
 
+    // Decodes a JPEG at 1/reduction of its size (reduction is 1, 2, 4 or 8) using
+    // DCT domain scaling, which is much cheaper than a full decode and resize
+    std::shared_ptr<image::decoded> extract(const void*, size_t, int reduction) const;
+
+    // Decodes only the region roi of a JPEG decoded at 1/reduction of its size.
+    // Returns nullptr when that is not possible and a full decode is needed.
+    std::shared_ptr<image::decoded>
+        extract_roi(const void*, size_t, int reduction, const cv::Rect& roi) const;
+
     int get_channel_count() { return _color_mode == CV_LOAD_IMAGE_COLOR ? 3 : 1; }
 private:
     int _pixel_type;
     int _color_mode;
+    int _channels;
 };
 
 class nervana::image::transformer
@@ -161,7 +186,20 @@ public:
         transform(std::shared_ptr<augment::image::params>,
                   std::shared_ptr<image::decoded>) const override;
 
-    cv::Mat transform_single_image(std::shared_ptr<augment::image::params>, cv::Mat&) const;
+    // buffer is storage for the output, used when it already has the output size and type
+    cv::Mat transform_single_image(std::shared_ptr<augment::image::params>,
+                                   cv::Mat&,
+                                   cv::Mat buffer = cv::Mat()) const;
+
+    // Largest reduction (1, 2, 4 or 8) at which the crop still covers the output size
+    static int decode_reduction(const augment::image::params&);
+
+    // True when the transform only reads pixels inside the cropbox
+    static bool roi_decode_supported(const augment::image::params&);
+
+    // Maps params made for the full size image onto an image decoded at 1/reduction
+    static std::shared_ptr<augment::image::params>
+        reduce_params(const augment::image::params&, int reduction, cv::Size2i decoded_size);
 
 private:
     image::photometric photo;
@@ -176,9 +214,16 @@ public:
 
 private:
     void split(cv::Mat&, char*);
-
-    bool       m_channel_major;
-    bool       m_fixed_aspect_ratio;
-    shape_type m_stype;
-    uint32_t   m_channels;
+    void place(const cv::Mat& image, char* outbuf, const cv::Size2i& canvas) const;
+    void clear_outside(char*             outbuf,
+                       const cv::Size2i& canvas,
+                       const cv::Size2i& image_size,
+                       size_t            element_size) const;
+
+    bool               m_channel_major;
+    bool               m_fixed_aspect_ratio;
+    shape_type         m_stype;
+    uint32_t           m_channels;
+    std::vector<float> m_scale;
+    std::vector<float> m_offset;
 };
@@ -0,0 +1,71 @@
+/*******************************************************************************
+* Copyright 2016-2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#pragma once
+
+#include "etl_image.hpp"
+
+namespace nervana
+{
+    namespace multicrop
+    {
+        class config;
+    }
+}
+
+/**
+ * \brief Configuration for multicrop ETL
+ *
+ * Emits crop_count independently augmented views of each image, e.g. for test time
+ * augmentation or for self-supervised training, as a [crops, ...] item whose views
+ * are laid out like the output of the image ETL described by the image element.
+ */
+class nervana::multicrop::config : public interface::config
+{
+public:
+    uint32_t               crop_count;
+    nervana::image::config image;
+    std::string            name;
+
+    config(nlohmann::json js)
+        : image(js["image"])
+    {
+        if (js.is_null())
+        {
+            throw std::runtime_error("missing multicrop config in json config");
+        }
+
+        for (auto& info : config_list)
+        {
+            info->parse(js);
+        }
+        verify_config("multicrop", config_list, js);
+
+        auto                     view  = image.get_shape_type();
+        std::vector<size_t>      shape = view.get_shape();
+        std::vector<std::string> names = view.get_names();
+        shape.insert(shape.begin(), crop_count);
+        names.insert(names.begin(), "crops");
+        add_shape_type(shape, names, view.get_otype());
+    }
+
+private:
+    config() {}
+    std::vector<std::shared_ptr<interface::config_info_interface>> config_list = {
+        ADD_SCALAR(crop_count, mode::REQUIRED, [](uint32_t v) { return v > 0; }),
+        ADD_SCALAR(name, mode::OPTIONAL),
+        ADD_IGNORE(image)};
+};
@@ -0,0 +1,216 @@
+/*******************************************************************************
+* Copyright 2016-2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+
+#include <cmath>
+
+#include "fft.hpp"
+
+using namespace std;
+using namespace nervana;
+
+namespace
+{
+    typedef complex<float> cpx;
+
+    // std::complex multiplication checks for infinities, which is slow
+    inline cpx mul(const cpx& a, const cpx& b)
+    {
+        return cpx(a.real() * b.real() - a.imag() * b.imag(),
+                   a.real() * b.imag() + a.imag() * b.real());
+    }
+
+    vector<cpx> make_twiddles(int count, int n)
+    {
+        vector<cpx> twiddles(count);
+        for (int i = 0; i < count; i++)
+        {
+            double phase = -2.0 * M_PI * i / n;
+            twiddles[i]  = cpx(cos(phase), sin(phase));
+        }
+        return twiddles;
+    }
+}
+
+real_fft::real_fft(int n)
+    : m_n{n}
+    , m_count{n % 2 == 0 ? n / 2 : n}
+    , m_max_factor{1}
+{
+    if (n < 1)
+    {
+        throw invalid_argument("fft length must be positive");
+    }
+
+    // radix 4 first as it has the cheapest butterfly
+    int remaining = m_count;
+    int p         = 4;
+    while (remaining > 1)
+    {
+        while (remaining % p != 0)
+        {
+            p = p == 4 ? 2 : p == 2 ? 3 : p + 2;
+            if (p * p > remaining)
+            {
+                p = remaining;
+            }
+        }
+        remaining /= p;
+        m_factors.push_back(p);
+        m_factors.push_back(remaining);
+        m_max_factor = max(m_max_factor, p);
+    }
+
+    m_twiddles = make_twiddles(m_count, m_count);
+    if (n % 2 == 0)
+    {
+        m_split = make_twiddles(m_count + 1, n);
+    }
+}
+
+void real_fft::magnitude(const int16_t* samples, const float* window, float* out) const
+{
+    thread_local vector<complex> buffer;
+    buffer.resize(2 * m_count + m_max_factor);
+    complex* in      = buffer.data();
+    complex* freq    = in + m_count;
+    complex* scratch = freq + m_count;
+
+    // even sizes pack pairs of samples into one complex value
+    int step = m_n % 2 == 0 ? 2 : 1;
+    for (int i = 0; i < m_count; i++)
+    {
+        float re = samples[i * step];
+        float im = step == 2 ? samples[i * step + 1] : 0.0f;
+        if (window)
+        {
+            re *= window[i * step];
+            im *= step == 2 ? window[i * step + 1] : 0.0f;
+        }
+        in[i] = complex(re, im);
+    }
+
+    transform(in, freq, scratch);
+
+    if (step == 1)
+    {
+        for (int k = 0; k < bins(); k++)
+        {
+            out[k] = abs(freq[k]);
+        }
+        return;
+    }
+
+    // separate the transforms of the even and odd samples and combine them
+    for (int k = 0; k <= m_count; k++)
+    {
+        complex z     = freq[k == m_count ? 0 : k];
+        complex zc    = conj(freq[k == 0 ? 0 : m_count - k]);
+        complex even  = (z + zc) * 0.5f;
+        complex odd   = (z - zc) * 0.5f;
+        complex value = even + mul(m_split[k], complex(odd.imag(), -odd.real()));
+        out[k]        = sqrt(value.real() * value.real() + value.imag() * value.imag());
+    }
+}
+
+void real_fft::transform(const complex* in, complex* out, complex* scratch) const
+{
+    if (m_factors.empty())
+    {
+        out[0] = in[0];
+        return;
+    }
+    work(out, in, 1, m_factors.data(), scratch);
+}
+
+// Mixed radix decimation in time: transforms the p interleaved subsequences of length m
+// into consecutive blocks of out, then combines them with radix p butterflies
+void real_fft::work(
+    complex* out, const complex* in, size_t fstride, const int* factors, complex* scratch) const
+{
+    const int p = factors[0];
+    const int m = factors[1];
+
+    if (m == 1)
+    {
+        for (int j = 0; j < p; j++)
+        {
+            out[j] = in[j * fstride];
+        }
+    }
+    else
+    {
+        for (int j = 0; j < p; j++)
+        {
+            work(out + j * m, in + j * fstride, fstride * p, factors + 2, scratch);
+        }
+    }
+
+    const complex* tw = m_twiddles.data();
+    if (p == 2)
+    {
+        for (int k = 0; k < m; k++)
+        {
+            complex t  = mul(out[k + m], tw[k * fstride]);
+            out[k + m] = out[k] - t;
+            out[k] += t;
+        }
+    }
+    else if (p == 4)
+    {
+        for (int k = 0; k < m; k++)
+        {
+            complex s0     = mul(out[k + m], tw[k * fstride]);
+            complex s1     = mul(out[k + 2 * m], tw[2 * k * fstride]);
+            complex s2     = mul(out[k + 3 * m], tw[3 * k * fstride]);
+            complex s5     = out[k] - s1;
+            complex s3     = s0 + s2;
+            complex s4     = s0 - s2;
+            complex s6     = out[k] + s1;
+            out[k]         = s6 + s3;
+            out[k + 2 * m] = s6 - s3;
+            out[k + m]     = complex(s5.real() + s4.imag(), s5.imag() - s4.real());
+            out[k + 3 * m] = complex(s5.real() - s4.imag(), s5.imag() + s4.real());
+        }
+    }
+    else
+    {
+        const size_t n = m_count;
+        for (int u = 0; u < m; u++)
+        {
+            for (int q = 0; q < p; q++)
+            {
+                scratch[q] = out[u + q * m];
+            }
+            for (int q1 = 0; q1 < p; q1++)
+            {
+                size_t  k      = u + q1 * m;
+                size_t  twidx  = 0;
+                complex result = scratch[0];
+                for (int q = 1; q < p; q++)
+                {
+                    twidx += fstride * k;
+                    if (twidx >= n)
+                    {
+                        twidx -= n;
+                    }
+                    result += mul(scratch[q], tw[twidx]);
+                }
+                out[k] = result;
+            }
+        }
+    }
+}
@@ -0,0 +1,65 @@
+/*******************************************************************************
+* Copyright 2016-2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+
+#pragma once
+
+#include <complex>
+#include <cstdint>
+#include <vector>
+
+namespace nervana
+{
+    class real_fft;
+}
+
+/**
+ * \brief Plan for the FFT of real frames of a fixed length
+ *
+ * The twiddle factors and the factorization of the length are computed once, so a plan
+ * can be kept and shared by all threads.  Even lengths are done as a complex FFT of half
+ * the length.  Lengths with prime factors other than 2, 3 and 5 are supported but slower.
+ */
+class nervana::real_fft
+{
+public:
+    explicit real_fft(int n);
+
+    int size() const { return m_n; }
+    // number of frequencies from 0 to the Nyquist frequency
+    int bins() const { return m_n / 2 + 1; }
+
+    // Writes the magnitudes of the bins() frequencies of the size() samples, multiplied by
+    // window when it is not null
+    void magnitude(const int16_t* samples, const float* window, float* out) const;
+
+private:
+    typedef std::complex<float> complex;
+
+    void transform(const complex* in, complex* out, complex* scratch) const;
+    void work(complex*       out,
+              const complex* in,
+              size_t         fstride,
+              const int*     factors,
+              complex*       scratch) const;
+
+    int                  m_n;
+    int                  m_count;      // length of the complex transform
+    int                  m_max_factor; // largest radix, for the butterfly scratch
+    std::vector<int>     m_factors;    // pairs of radix and remaining length
+    std::vector<complex> m_twiddles;   // of the complex transform
+    std::vector<complex> m_split;      // to split the half length transform of even sizes
+};
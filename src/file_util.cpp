@@ -28,6 +28,7 @@
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/file.h>
+#include <sys/mman.h>
 #include <iostream>
 
 #include "file_util.hpp"
@@ -297,3 +298,42 @@ void nervana::file_util::release_lock(int fd, const std::string& filename)
         close(fd);
     }
 }
+
+nervana::memory_mapped_file::memory_mapped_file(const string& filename)
+    : m_filename{filename}
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        throw std::runtime_error("error opening file '" + filename + "' " + strerror(errno));
+    }
+
+    struct stat stats;
+    if (fstat(fd, &stats) == -1)
+    {
+        close(fd);
+        throw std::runtime_error("error reading size of file '" + filename + "'");
+    }
+
+    m_size = stats.st_size;
+    if (m_size > 0)
+    {
+        void* p = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED)
+        {
+            close(fd);
+            throw std::runtime_error("error mapping file '" + filename + "' " + strerror(errno));
+        }
+        m_data = static_cast<const char*>(p);
+    }
+    // the mapping stays valid after the descriptor is closed
+    close(fd);
+}
+
+nervana::memory_mapped_file::~memory_mapped_file()
+{
+    if (m_data != nullptr)
+    {
+        munmap(const_cast<char*>(m_data), m_size);
+    }
+}
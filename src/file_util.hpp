@@ -23,6 +23,7 @@
 namespace nervana
 {
     class file_util;
+    class memory_mapped_file;
 }
 
 class nervana::file_util
@@ -51,3 +52,27 @@ private:
                                      std::function<void(const std::string& file, bool is_dir)> func,
                                      bool recurse = false);
 };
+
+/* memory_mapped_file
+ *
+ * Read-only mapping of an entire file. The mapping is released when the
+ * object is destroyed. An empty file maps to a null data pointer.
+ */
+class nervana::memory_mapped_file
+{
+public:
+    memory_mapped_file(const std::string& filename);
+    ~memory_mapped_file();
+
+    const char* data() const { return m_data; }
+    size_t      size() const { return m_size; }
+    const std::string& filename() const { return m_filename; }
+
+private:
+    memory_mapped_file(const memory_mapped_file&) = delete;
+    memory_mapped_file& operator=(const memory_mapped_file&) = delete;
+
+    std::string m_filename;
+    const char* m_data{nullptr};
+    size_t      m_size{0};
+};
@@ -0,0 +1,206 @@
+/*******************************************************************************
+* Copyright 2016-2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define AEON_X86
+#endif
+
+#include "cpu_features.hpp"
+#include "float16.hpp"
+
+using namespace std;
+using namespace nervana;
+
+namespace
+{
+    inline uint32_t float_bits(float f)
+    {
+        uint32_t bits;
+        memcpy(&bits, &f, sizeof(bits));
+        return bits;
+    }
+
+    inline float bits_float(uint32_t bits)
+    {
+        float f;
+        memcpy(&f, &bits, sizeof(f));
+        return f;
+    }
+
+    uint16_t to_half(float f)
+    {
+        uint32_t bits = float_bits(f);
+        uint16_t sign = (bits >> 16) & 0x8000;
+        uint32_t abs  = bits & 0x7FFFFFFF;
+        if (abs >= 0x7F800000)
+        {
+            // infinity or quiet NaN
+            return sign | (abs > 0x7F800000 ? 0x7E00 : 0x7C00);
+        }
+        if (abs >= 0x477FF000)
+        {
+            // 65520 and up round to infinity
+            return sign | 0x7C00;
+        }
+        if (abs < 0x38800000)
+        {
+            // subnormal, adding 0.5 leaves the rounded mantissa in the low bits
+            float rounded = bits_float(abs) + 0.5f;
+            return sign | uint16_t(float_bits(rounded) - 0x3F000000);
+        }
+        // rebias the exponent from 127 to 15 and round the mantissa to 10 bits
+        uint32_t odd = (abs >> 13) & 1;
+        abs += 0xC8000FFF + odd;
+        return sign | uint16_t(abs >> 13);
+    }
+
+    uint16_t to_bfloat16(float f)
+    {
+        uint32_t bits = float_bits(f);
+        if ((bits & 0x7FFFFFFF) > 0x7F800000)
+        {
+            return (bits >> 16) | 0x40;
+        }
+        return (bits + 0x7FFF + ((bits >> 16) & 1)) >> 16;
+    }
+
+#ifdef AEON_X86
+    __attribute__((target("avx,f16c"))) size_t
+        float_to_half_f16c(const float* src, uint16_t* dst, size_t count)
+    {
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            __m128i v = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), v);
+        }
+        return i;
+    }
+
+    size_t float_to_bfloat16_sse2(const float* src, uint16_t* dst, size_t count)
+    {
+        const __m128i bias  = _mm_set1_epi32(0x7FFF);
+        const __m128i one   = _mm_set1_epi32(1);
+        const __m128i quiet = _mm_set1_epi32(0x00400000);
+        size_t        i     = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            __m128i half[2];
+            for (int k = 0; k < 2; k++)
+            {
+                __m128  f    = _mm_loadu_ps(src + i + k * 4);
+                __m128i bits = _mm_castps_si128(f);
+                __m128i odd  = _mm_and_si128(_mm_srli_epi32(bits, 16), one);
+                __m128i r    = _mm_add_epi32(bits, _mm_add_epi32(bias, odd));
+                __m128i nan  = _mm_castps_si128(_mm_cmpunord_ps(f, f));
+                r            = _mm_or_si128(_mm_and_si128(nan, _mm_or_si128(bits, quiet)),
+                                 _mm_andnot_si128(nan, r));
+                // the arithmetic shift keeps the 16 bits intact through the signed pack
+                half[k] = _mm_srai_epi32(r, 16);
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+                             _mm_packs_epi32(half[0], half[1]));
+        }
+        return i;
+    }
+#endif
+}
+
+void nervana::float_to_half(const float* src, uint16_t* dst, size_t count)
+{
+    size_t i = 0;
+#ifdef AEON_X86
+    static const bool f16c = cpu::has_f16c();
+    if (f16c)
+    {
+        i = float_to_half_f16c(src, dst, count);
+    }
+#endif
+    for (; i < count; i++)
+    {
+        dst[i] = to_half(src[i]);
+    }
+}
+
+void nervana::float_to_bfloat16(const float* src, uint16_t* dst, size_t count)
+{
+    size_t i = 0;
+#ifdef AEON_X86
+    i = float_to_bfloat16_sse2(src, dst, count);
+#endif
+    for (; i < count; i++)
+    {
+        dst[i] = to_bfloat16(src[i]);
+    }
+}
+
+float nervana::half_to_float(uint16_t value)
+{
+    uint32_t sign     = uint32_t(value & 0x8000) << 16;
+    uint32_t exponent = (value >> 10) & 0x1F;
+    uint32_t mantissa = value & 0x3FF;
+    if (exponent == 0)
+    {
+        // zero or subnormal, mantissa * 2^-24
+        float f = mantissa * (1.0f / 16777216.0f);
+        return sign ? -f : f;
+    }
+    if (exponent == 31)
+    {
+        return bits_float(sign | 0x7F800000 | (mantissa << 13));
+    }
+    return bits_float(sign | ((exponent + 112) << 23) | (mantissa << 13));
+}
+
+float nervana::bfloat16_to_float(uint16_t value)
+{
+    return bits_float(uint32_t(value) << 16);
+}
+
+void nervana::convert_to_half(const float* src, void* dst, size_t count, const output_type& type)
+{
+    if (type.m_tp_name == "float16")
+    {
+        float_to_half(src, reinterpret_cast<uint16_t*>(dst), count);
+    }
+    else if (type.m_tp_name == "bfloat16")
+    {
+        float_to_bfloat16(src, reinterpret_cast<uint16_t*>(dst), count);
+    }
+    else
+    {
+        throw invalid_argument("convert_to_half needs float16 or bfloat16, not " +
+                               type.m_tp_name);
+    }
+}
+
+void nervana::convert_to_half(const cv::Mat& src, void* dst, const output_type& type)
+{
+    if (src.depth() != CV_32F)
+    {
+        throw invalid_argument("convert_to_half needs a float matrix");
+    }
+    size_t    row_size = src.cols * src.channels();
+    uint16_t* out      = reinterpret_cast<uint16_t*>(dst);
+    for (int row = 0; row < src.rows; row++)
+    {
+        convert_to_half(src.ptr<float>(row), out + row * row_size, row_size, type);
+    }
+}
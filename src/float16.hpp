@@ -0,0 +1,41 @@
+/*******************************************************************************
+* Copyright 2016-2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <opencv2/core/core.hpp>
+
+#include "typemap.hpp"
+
+namespace nervana
+{
+    // IEEE half precision and bfloat16 conversions.  Floats are rounded to the nearest
+    // even value and NaN stays NaN.  Half precision uses F16C when the CPU has it and
+    // bfloat16 uses SSE2.
+    void float_to_half(const float* src, uint16_t* dst, size_t count);
+    void float_to_bfloat16(const float* src, uint16_t* dst, size_t count);
+    float half_to_float(uint16_t value);
+    float bfloat16_to_float(uint16_t value);
+
+    // Writes count floats in the 16 bit format of type, which must be a half type
+    void convert_to_half(const float* src, void* dst, size_t count, const output_type& type);
+
+    // Writes a float matrix in the 16 bit format of type, rows are packed
+    void convert_to_half(const cv::Mat& src, void* dst, const output_type& type);
+}
@@ -0,0 +1,714 @@
+/*******************************************************************************
+* Copyright 2016-2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "fused_transform.hpp"
+#include "float16.hpp"
+#include "image.hpp"
+
+using namespace std;
+using namespace nervana;
+
+namespace
+{
+    // Upper bound of samples per axis averaged for one downscaled output pixel
+    const int max_supersample = 8;
+
+    // Rounds and saturates like the uint8 images of the regular pipeline
+    inline float quantize(float v)
+    {
+        return min(max(nearbyintf(v), 0.0f), 255.0f);
+    }
+
+    struct sampler
+    {
+        const cv::Mat* image;
+        bool           replicate; // resize replicates the border, warpAffine pads with black
+
+        void sample(float x, float y, float* bgr) const
+        {
+            int cols = image->cols;
+            int rows = image->rows;
+            if (replicate)
+            {
+                x = min(max(x, 0.0f), float(cols - 1));
+                y = min(max(y, 0.0f), float(rows - 1));
+            }
+            int   x0 = floor(x);
+            int   y0 = floor(y);
+            float fx = x - x0;
+            float fy = y - y0;
+
+            const int   xs[2] = {x0, x0 + 1};
+            const int   ys[2] = {y0, y0 + 1};
+            const float wx[2] = {1.0f - fx, fx};
+            const float wy[2] = {1.0f - fy, fy};
+            for (int j = 0; j < 2; j++)
+            {
+                int yy = replicate ? min(ys[j], rows - 1) : ys[j];
+                if (yy < 0 || yy >= rows || wy[j] == 0.0f)
+                {
+                    continue;
+                }
+                const uint8_t* row = image->ptr<uint8_t>(yy);
+                for (int i = 0; i < 2; i++)
+                {
+                    int xx = replicate ? min(xs[i], cols - 1) : xs[i];
+                    if (xx < 0 || xx >= cols || wx[i] == 0.0f)
+                    {
+                        continue;
+                    }
+                    float          w = wx[i] * wy[j];
+                    const uint8_t* p = row + 3 * xx;
+                    bgr[0] += w * p[0];
+                    bgr[1] += w * p[1];
+                    bgr[2] += w * p[2];
+                }
+            }
+        }
+    };
+
+    // Bilinear taps along one axis when there is no rotation, so that sampling is
+    // separable.  Every output coordinate has k samples of two taps each, in the order
+    // sampler::sample visits them.  Taps that sampler would skip get zero weight.
+    void make_taps(vector<int>&   index,
+                   vector<float>& weight,
+                   int            count,
+                   int            k,
+                   float          scale,
+                   int            first,
+                   float          offset,
+                   bool           flip,
+                   int            size,
+                   bool           replicate,
+                   bool           expand)
+    {
+        index.resize(size_t(count) * k * 2);
+        weight.resize(index.size());
+        size_t t = 0;
+        for (int u = 0; u < count; u++)
+        {
+            int position = flip ? count - 1 - u : u;
+            for (int i = 0; i < k; i++)
+            {
+                float x     = (position + (i + 0.5f) / k) * scale - 0.5f + first - offset;
+                bool  valid = !(expand && (x <= -1.0f || x >= size));
+                if (replicate)
+                {
+                    x = min(max(x, 0.0f), float(size - 1));
+                }
+                int         x0   = floor(x);
+                float       fx   = x - x0;
+                const float w[2] = {1.0f - fx, fx};
+                for (int j = 0; j < 2; j++, t++)
+                {
+                    int xx = replicate ? min(x0 + j, size - 1) : x0 + j;
+                    if (valid && xx >= 0 && xx < size && w[j] != 0.0f)
+                    {
+                        index[t]  = xx;
+                        weight[t] = w[j];
+                    }
+                    else
+                    {
+                        index[t]  = 0;
+                        weight[t] = 0.0f;
+                    }
+                }
+            }
+        }
+    }
+
+#ifdef __SSE2__
+    inline __m128 load_bgr(const uint8_t* p)
+    {
+        // three bytes only, a four byte load could read past the end of the image
+        __m128i v    = _mm_cvtsi32_si128(p[0] | (p[1] << 8) | (p[2] << 16));
+        __m128i zero = _mm_setzero_si128();
+        return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(v, zero), zero));
+    }
+
+    // Separable version of the sampler loop, one pixel of all three channels per vector.
+    // The products and sums are the same as sampler::sample in the same order.
+    void sample_row_simd(const cv::Mat&       image,
+                         const int*           row_index,
+                         const float*         row_weight,
+                         int                  ky,
+                         const vector<int>&   column_index,
+                         const vector<float>& column_weight,
+                         int                  kx,
+                         int                  width,
+                         float                inv_k,
+                         float*               b,
+                         float*               g,
+                         float*               r)
+    {
+        const uint8_t* rows[2 * max_supersample];
+        for (int j = 0; j < 2 * ky; j++)
+        {
+            rows[j] = image.ptr<uint8_t>(row_index[j]);
+        }
+        const __m128 scale = _mm_set1_ps(inv_k);
+        for (int u = 0; u < width; u++)
+        {
+            const int*   cx  = &column_index[size_t(u) * kx * 2];
+            const float* wx  = &column_weight[size_t(u) * kx * 2];
+            __m128       acc = _mm_setzero_ps();
+            for (int j = 0; j < ky; j++)
+            {
+                for (int i = 0; i < kx; i++)
+                {
+                    for (int y = 2 * j; y < 2 * j + 2; y++)
+                    {
+                        for (int x = 2 * i; x < 2 * i + 2; x++)
+                        {
+                            __m128 w = _mm_set1_ps(wx[x] * row_weight[y]);
+                            __m128 p = load_bgr(rows[y] + 3 * cx[x]);
+                            acc      = _mm_add_ps(acc, _mm_mul_ps(w, p));
+                        }
+                    }
+                }
+            }
+            float bgr[4];
+            _mm_storeu_ps(bgr, _mm_mul_ps(acc, scale));
+            b[u] = bgr[0];
+            g[u] = bgr[1];
+            r[u] = bgr[2];
+        }
+    }
+#endif
+
+    // Quantizes the resampled row and applies the color matrix
+    void color_row_scalar(float* b, float* g, float* r, int width, const float* m)
+    {
+        for (int i = 0; i < width; i++)
+        {
+            float pb = quantize(b[i]);
+            float pg = quantize(g[i]);
+            float pr = quantize(r[i]);
+            if (m)
+            {
+                b[i] = quantize(m[0] * pb + m[1] * pg + m[2] * pr);
+                g[i] = quantize(m[3] * pb + m[4] * pg + m[5] * pr);
+                r[i] = quantize(m[6] * pb + m[7] * pg + m[8] * pr);
+            }
+            else
+            {
+                b[i] = pb;
+                g[i] = pg;
+                r[i] = pr;
+            }
+        }
+    }
+
+    // Contrast around the channel mean followed by lighting noise
+    void finish_plane_scalar(
+        float* p, size_t count, float contrast, float offset, float lighting, float scale)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            float v = p[i];
+            if (contrast != 1.0f)
+            {
+                v = quantize(v * contrast + offset);
+            }
+            if (scale != 1.0f || lighting != 0.0f)
+            {
+                v = quantize((v + lighting) * scale);
+            }
+            p[i] = v;
+        }
+    }
+
+#ifdef __SSE2__
+    inline __m128 quantize(__m128 v)
+    {
+        // round half to even like nearbyintf, the values are far inside the int32 range
+        v = _mm_cvtepi32_ps(_mm_cvtps_epi32(v));
+        return _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(255.0f));
+    }
+
+    void color_row_simd(float* b, float* g, float* r, int width, const float* m)
+    {
+        int i = 0;
+        for (; i + 4 <= width; i += 4)
+        {
+            __m128 pb = quantize(_mm_loadu_ps(b + i));
+            __m128 pg = quantize(_mm_loadu_ps(g + i));
+            __m128 pr = quantize(_mm_loadu_ps(r + i));
+            if (m)
+            {
+                __m128 ob  = _mm_mul_ps(_mm_set1_ps(m[0]), pb);
+                __m128 og  = _mm_mul_ps(_mm_set1_ps(m[3]), pb);
+                __m128 orr = _mm_mul_ps(_mm_set1_ps(m[6]), pb);
+                ob         = _mm_add_ps(ob, _mm_mul_ps(_mm_set1_ps(m[1]), pg));
+                og         = _mm_add_ps(og, _mm_mul_ps(_mm_set1_ps(m[4]), pg));
+                orr        = _mm_add_ps(orr, _mm_mul_ps(_mm_set1_ps(m[7]), pg));
+                ob         = _mm_add_ps(ob, _mm_mul_ps(_mm_set1_ps(m[2]), pr));
+                og         = _mm_add_ps(og, _mm_mul_ps(_mm_set1_ps(m[5]), pr));
+                orr        = _mm_add_ps(orr, _mm_mul_ps(_mm_set1_ps(m[8]), pr));
+                pb         = quantize(ob);
+                pg         = quantize(og);
+                pr         = quantize(orr);
+            }
+            _mm_storeu_ps(b + i, pb);
+            _mm_storeu_ps(g + i, pg);
+            _mm_storeu_ps(r + i, pr);
+        }
+        color_row_scalar(b + i, g + i, r + i, width - i, m);
+    }
+
+    void finish_plane_simd(
+        float* p, size_t count, float contrast, float offset, float lighting, float scale)
+    {
+        bool   do_contrast = contrast != 1.0f;
+        bool   do_lighting = scale != 1.0f || lighting != 0.0f;
+        __m128 c           = _mm_set1_ps(contrast);
+        __m128 o           = _mm_set1_ps(offset);
+        __m128 l           = _mm_set1_ps(lighting);
+        __m128 s           = _mm_set1_ps(scale);
+        size_t i           = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128 v = _mm_loadu_ps(p + i);
+            if (do_contrast)
+            {
+                v = quantize(_mm_add_ps(_mm_mul_ps(v, c), o));
+            }
+            if (do_lighting)
+            {
+                v = quantize(_mm_mul_ps(_mm_add_ps(v, l), s));
+            }
+            _mm_storeu_ps(p + i, v);
+        }
+        finish_plane_scalar(p + i, count - i, contrast, offset, lighting, scale);
+    }
+#endif
+
+    template <typename T>
+    void store_plane(const float* src, size_t count, T* dst, size_t stride, bool)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            dst[i * stride] = cv::saturate_cast<T>(src[i]);
+        }
+    }
+
+#ifdef __SSE2__
+    template <>
+    void store_plane<float>(const float* src, size_t count, float* dst, size_t stride, bool simd)
+    {
+        size_t i = 0;
+        if (simd && stride == 1)
+        {
+            for (; i + 4 <= count; i += 4)
+            {
+                _mm_storeu_ps(dst + i, _mm_loadu_ps(src + i));
+            }
+        }
+        for (; i < count; i++)
+        {
+            dst[i * stride] = src[i];
+        }
+    }
+
+    template <>
+    void store_plane<uint8_t>(
+        const float* src, size_t count, uint8_t* dst, size_t stride, bool simd)
+    {
+        size_t i = 0;
+        if (simd && stride == 1)
+        {
+            // values are already whole numbers in [0, 255]
+            for (; i + 16 <= count; i += 16)
+            {
+                __m128i a = _mm_cvtps_epi32(_mm_loadu_ps(src + i));
+                __m128i b = _mm_cvtps_epi32(_mm_loadu_ps(src + i + 4));
+                __m128i c = _mm_cvtps_epi32(_mm_loadu_ps(src + i + 8));
+                __m128i d = _mm_cvtps_epi32(_mm_loadu_ps(src + i + 12));
+                __m128i v = _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+                _mm_storeu_si128((__m128i*)(dst + i), v);
+            }
+        }
+        for (; i < count; i++)
+        {
+            dst[i * stride] = cv::saturate_cast<uint8_t>(src[i]);
+        }
+    }
+#endif
+
+    // Stores one finished output row, planes is the b, g and r rows back to back
+    template <typename T>
+    void store_row(const float* planes,
+                   int          width,
+                   int          row,
+                   size_t       area,
+                   bool         channel_major,
+                   char*        output,
+                   bool         simd)
+    {
+        T* dst = reinterpret_cast<T*>(output);
+        for (int c = 0; c < 3; c++)
+        {
+            if (channel_major)
+            {
+                store_plane<T>(planes + c * width, width, dst + c * area + row * width, 1, simd);
+            }
+            else
+            {
+                store_plane<T>(planes + c * width, width, dst + row * width * 3 + c, 3, simd);
+            }
+        }
+    }
+
+    void store_half_row(const float*       planes,
+                        int                width,
+                        int                row,
+                        size_t             area,
+                        bool               channel_major,
+                        const output_type& otype,
+                        float*             interleaved,
+                        char*              output)
+    {
+        uint16_t* dst = reinterpret_cast<uint16_t*>(output);
+        if (channel_major)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                convert_to_half(planes + c * width, dst + c * area + row * width, width, otype);
+            }
+        }
+        else
+        {
+            store_row<float>(planes, width, 0, width, false, (char*)interleaved, false);
+            convert_to_half(interleaved, dst + row * width * 3, width * 3, otype);
+        }
+    }
+
+    // Colored pixels are whole numbers in [0, 255], so rows kept for the contrast pass
+    // are stored as bytes
+    void load_plane(const uint8_t* src, float* dst, int count)
+    {
+        int i = 0;
+#ifdef __SSE2__
+        __m128i zero = _mm_setzero_si128();
+        for (; i + 8 <= count; i += 8)
+        {
+            __m128i v = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(src + i)), zero);
+            _mm_storeu_ps(dst + i, _mm_cvtepi32_ps(_mm_unpacklo_epi16(v, zero)));
+            _mm_storeu_ps(dst + i + 4, _mm_cvtepi32_ps(_mm_unpackhi_epi16(v, zero)));
+        }
+#endif
+        for (; i < count; i++)
+        {
+            dst[i] = src[i];
+        }
+    }
+}
+
+image::fused_transform::fused_transform(bool channel_major, const output_type& otype)
+    : m_channel_major{channel_major}
+    , m_otype{otype}
+#ifdef __SSE2__
+    , m_simd{true}
+#else
+    , m_simd{false}
+#endif
+{
+}
+
+bool image::fused_transform::is_supported(const augment::image::params& img_xform,
+                                          const cv::Mat&                input)
+{
+    bool padded = img_xform.padding != 0 &&
+                  (img_xform.padding_crop_offset.width != img_xform.padding ||
+                   img_xform.padding_crop_offset.height != img_xform.padding);
+#ifdef PYTHON_PLUGIN
+    if (img_xform.user_plugin)
+    {
+        return false;
+    }
+#endif
+    return input.type() == CV_8UC3 && !padded && img_xform.debug_output_directory.empty() &&
+           img_xform.cropbox.area() > 0 && img_xform.output_size.area() > 0;
+}
+
+void image::fused_transform::run(const cv::Mat&                input,
+                                 const augment::image::params& img_xform,
+                                 char*                         output) const
+{
+    const int    width  = img_xform.output_size.width;
+    const int    height = img_xform.output_size.height;
+    const size_t area   = size_t(width) * height;
+    const bool   simd   = m_simd;
+
+    // output pixel -> cropbox, the scale of image::resize and the flip
+    const cv::Rect& crop = img_xform.cropbox;
+    const float     sx   = float(crop.width) / width;
+    const float     sy   = float(crop.height) / height;
+    const int       kx   = min(max(int(ceil(sx)), 1), max_supersample);
+    const int       ky   = min(max(int(ceil(sy)), 1), max_supersample);
+
+    // canvas -> image before expand
+    const bool  expand   = img_xform.expand_ratio > 1.0;
+    const float offset_x = expand ? img_xform.expand_offset.width : 0;
+    const float offset_y = expand ? img_xform.expand_offset.height : 0;
+
+    // rotated image -> decoded image, the inverse of image::rotate
+    const bool rotate = img_xform.angle != 0;
+    float      rot[6] = {1, 0, 0, 0, 1, 0};
+    if (rotate)
+    {
+        cv::Point2i center(input.cols / 2, input.rows / 2);
+        cv::Mat     m = cv::getRotationMatrix2D(center, img_xform.angle, 1.0);
+        cv::Mat     inv;
+        cv::invertAffineTransform(m, inv);
+        for (int i = 0; i < 6; i++)
+        {
+            rot[i] = inv.at<double>(i / 3, i % 3);
+        }
+    }
+
+    sampler src{&input, !rotate && !expand};
+
+    // saturation, brightness and hue matrix of photometric::cbsjitter
+    cv::Mat      color_mtx;
+    const float* color = nullptr;
+    if (img_xform.brightness != 1.0 || img_xform.saturation != 1.0 || img_xform.hue != 0)
+    {
+        color_mtx =
+            photometric::color_matrix(img_xform.brightness, img_xform.saturation, img_xform.hue);
+        color = color_mtx.ptr<float>();
+    }
+
+    // contrast and lighting of photometric::lighting
+    float lighting[3] = {0, 0, 0};
+    float scale       = 1.0f;
+    if (img_xform.lighting.size() > 0)
+    {
+        vector<float> alphas_data = img_xform.lighting;
+        cv::Mat       alphas(3, 1, CV_32FC1, alphas_data.data());
+        alphas = photometric::CPCA * photometric::CSTD.mul(alphas);
+        for (int c = 0; c < 3; c++)
+        {
+            lighting[c] = alphas.at<float>(c);
+        }
+        scale = 1.0f / (1.0f + img_xform.color_noise_std);
+    }
+    const float contrast = img_xform.contrast;
+
+    typedef void (*row_store)(const float*, int, int, size_t, bool, char*, bool);
+    row_store store = nullptr;
+    if (!m_otype.is_half())
+    {
+        switch (m_otype.get_cv_type())
+        {
+        case CV_8U: store = store_row<uint8_t>; break;
+        case CV_8S: store = store_row<int8_t>; break;
+        case CV_16U: store = store_row<uint16_t>; break;
+        case CV_16S: store = store_row<int16_t>; break;
+        case CV_32S: store = store_row<int32_t>; break;
+        case CV_32F: store = store_row<float>; break;
+        case CV_64F: store = store_row<double>; break;
+        default: throw invalid_argument("fused_transform: unsupported output type");
+        }
+    }
+
+    // per thread scratch, resized only when it grows
+    thread_local vector<float>   row_buffer;
+    thread_local vector<float>   interleaved;
+    thread_local vector<uint8_t> staged;
+    thread_local vector<int>     column_index;
+    thread_local vector<float>   column_weight;
+    thread_local vector<int>     row_index;
+    thread_local vector<float>   row_weight;
+    if (row_buffer.size() < size_t(width) * 3)
+    {
+        row_buffer.resize(size_t(width) * 3);
+        interleaved.resize(size_t(width) * 3);
+    }
+    float* b = row_buffer.data();
+    float* g = b + width;
+    float* r = g + width;
+
+#ifdef __SSE2__
+    // without rotation the sampling is separable, so the taps are computed once per axis
+    const bool separable = simd && !rotate;
+    if (separable)
+    {
+        bool replicate = !expand;
+        make_taps(column_index,
+                  column_weight,
+                  width,
+                  kx,
+                  sx,
+                  crop.x,
+                  offset_x,
+                  img_xform.flip,
+                  input.cols,
+                  replicate,
+                  expand);
+        make_taps(row_index,
+                  row_weight,
+                  height,
+                  ky,
+                  sy,
+                  crop.y,
+                  offset_y,
+                  false,
+                  input.rows,
+                  replicate,
+                  expand);
+    }
+#endif
+
+    // samples output row v and applies the color matrix
+    const float inv_k      = 1.0f / (kx * ky);
+    auto        sample_row = [&](int v) {
+#ifdef __SSE2__
+        if (separable)
+        {
+            size_t t = size_t(v) * ky * 2;
+            sample_row_simd(input,
+                            &row_index[t],
+                            &row_weight[t],
+                            ky,
+                            column_index,
+                            column_weight,
+                            kx,
+                            width,
+                            inv_k,
+                            b,
+                            g,
+                            r);
+            color_row_simd(b, g, r, width, color);
+            return;
+        }
+#endif
+        for (int u = 0; u < width; u++)
+        {
+            int   column = img_xform.flip ? width - 1 - u : u;
+            float bgr[3] = {0, 0, 0};
+            for (int j = 0; j < ky; j++)
+            {
+                float y = (v + (j + 0.5f) / ky) * sy - 0.5f + crop.y - offset_y;
+                for (int i = 0; i < kx; i++)
+                {
+                    float x = (column + (i + 0.5f) / kx) * sx - 0.5f + crop.x - offset_x;
+                    if (expand && (x <= -1.0f || y <= -1.0f || x >= input.cols || y >= input.rows))
+                    {
+                        continue;
+                    }
+                    if (rotate)
+                    {
+                        float rx = rot[0] * x + rot[1] * y + rot[2];
+                        float ry = rot[3] * x + rot[4] * y + rot[5];
+                        src.sample(rx, ry, bgr);
+                    }
+                    else
+                    {
+                        src.sample(x, y, bgr);
+                    }
+                }
+            }
+            b[u] = bgr[0] * inv_k;
+            g[u] = bgr[1] * inv_k;
+            r[u] = bgr[2] * inv_k;
+        }
+#ifdef __SSE2__
+        if (simd)
+        {
+            color_row_simd(b, g, r, width, color);
+            return;
+        }
+#endif
+        color_row_scalar(b, g, r, width, color);
+    };
+
+    // applies contrast and lighting to the row and stores it in the output
+    auto finish_row = [&](int v, const double* sums) {
+        for (int c = 0; c < 3; c++)
+        {
+            float  offset = sums ? (1.0f - contrast) * float(sums[c] / area) : 0.0f;
+            float* plane  = row_buffer.data() + c * width;
+#ifdef __SSE2__
+            if (simd)
+            {
+                finish_plane_simd(plane, width, contrast, offset, lighting[c], scale);
+                continue;
+            }
+#endif
+            finish_plane_scalar(plane, width, contrast, offset, lighting[c], scale);
+        }
+
+        if (store)
+        {
+            store(row_buffer.data(), width, v, area, m_channel_major, output, simd);
+        }
+        else
+        {
+            store_half_row(row_buffer.data(),
+                           width,
+                           v,
+                           area,
+                           m_channel_major,
+                           m_otype,
+                           interleaved.data(),
+                           output);
+        }
+    };
+
+    if (contrast == 1.0f)
+    {
+        // every row is finished as soon as it is sampled
+        for (int v = 0; v < height; v++)
+        {
+            sample_row(v);
+            finish_row(v, nullptr);
+        }
+        return;
+    }
+
+    // contrast needs the channel means of the whole colored image, so the colored rows
+    // are kept as bytes until the sums are known
+    if (staged.size() < area * 3)
+    {
+        staged.resize(area * 3);
+    }
+    double sums[3] = {0, 0, 0};
+    for (int v = 0; v < height; v++)
+    {
+        sample_row(v);
+        for (int u = 0; u < width; u++)
+        {
+            sums[0] += b[u];
+            sums[1] += g[u];
+            sums[2] += r[u];
+        }
+        store_plane<uint8_t>(row_buffer.data(), width * 3, &staged[v * width * 3], 1, simd);
+    }
+    for (int v = 0; v < height; v++)
+    {
+        load_plane(&staged[v * width * 3], row_buffer.data(), width * 3);
+        finish_row(v, sums);
+    }
+}
@@ -0,0 +1,68 @@
+/*******************************************************************************
+* Copyright 2016-2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#pragma once
+
+#include <opencv2/core/core.hpp>
+
+#include "augment_image.hpp"
+#include "typemap.hpp"
+
+namespace nervana
+{
+    namespace image
+    {
+        class fused_transform;
+    }
+}
+
+/**
+ * \brief Single pass image transform and load
+ *
+ * Maps every output pixel through one affine transform (flip, resize, crop, expand and
+ * rotation) back to the decoded image and samples it there, then applies saturation,
+ * brightness, hue, contrast and lighting per pixel and writes the result straight into
+ * the output buffer in its final type and layout.  This replaces the chain of
+ * intermediate images made by image::transformer and image::loader.
+ *
+ * Sampling is bilinear, with supersampling when downscaling, so the output matches
+ * the regular pipeline within a small tolerance rather than exactly.
+ *
+ * Rows are finished one at a time in per-thread row buffers and stored straight into
+ * the output. Contrast needs the channel means of the whole image, so with contrast
+ * the colored rows are kept as bytes until the second pass. Without rotation the
+ * sampling is separable, and the SIMD kernel precomputes the taps of each axis and
+ * samples all three channels of a pixel at once.
+ */
+class nervana::image::fused_transform
+{
+public:
+    fused_transform(bool channel_major, const output_type& otype);
+
+    // True when the params and image only need steps implemented here
+    static bool is_supported(const augment::image::params&, const cv::Mat& input);
+
+    // Writes params.output_size pixels to output
+    void run(const cv::Mat& input, const augment::image::params&, char* output) const;
+
+    // Uses the scalar kernels even when SIMD is available, for testing
+    void set_simd(bool enable) { m_simd = enable; }
+
+private:
+    bool        m_channel_major;
+    output_type m_otype;
+    bool        m_simd;
+};
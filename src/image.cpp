@@ -14,12 +14,28 @@
 * limitations under the License.
 *******************************************************************************/
 
+#include <cmath>
+#include <cstring>
+#include <functional>
 #include <iostream>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
+
 #include "image.hpp"
 #include "util.hpp"
 #include "log.hpp"
 
+#ifdef JPEG_TURBO_FOUND
+#include <csetjmp>
+#include <cstdio>
+#include <jpeglib.h>
+#endif
+
 using namespace nervana;
 using namespace std;
 
@@ -120,6 +136,190 @@ void image::convert_mix_channels(vector<cv::Mat>& source,
     }
 }
 
+namespace
+{
+    // target[i] = source[i] * scale[i % channels] + offset[i % channels], channels 1 or 3
+    void convert_scale_row(const uint8_t* source,
+                           float*         target,
+                           size_t         count,
+                           int            channels,
+                           const float*   scale,
+                           const float*   offset)
+    {
+        size_t i = 0;
+#ifdef __SSE2__
+        // 12 values per step keep the channel pattern of 1 and 3 channels aligned
+        __m128  s[3];
+        __m128  o[3];
+        for (int k = 0; k < 3; k++)
+        {
+            float sv[4];
+            float ov[4];
+            for (int j = 0; j < 4; j++)
+            {
+                sv[j] = scale[(k * 4 + j) % channels];
+                ov[j] = offset[(k * 4 + j) % channels];
+            }
+            s[k] = _mm_loadu_ps(sv);
+            o[k] = _mm_loadu_ps(ov);
+        }
+        __m128i zero = _mm_setzero_si128();
+        for (; i + 12 <= count; i += 12)
+        {
+            int32_t tail;
+            memcpy(&tail, source + i + 8, sizeof(tail));
+            __m128i lo = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(source + i)), zero);
+            __m128i hi = _mm_unpacklo_epi8(_mm_cvtsi32_si128(tail), zero);
+            __m128  v0 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero));
+            __m128  v1 = _mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero));
+            __m128  v2 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero));
+            _mm_storeu_ps(target + i, _mm_add_ps(_mm_mul_ps(v0, s[0]), o[0]));
+            _mm_storeu_ps(target + i + 4, _mm_add_ps(_mm_mul_ps(v1, s[1]), o[1]));
+            _mm_storeu_ps(target + i + 8, _mm_add_ps(_mm_mul_ps(v2, s[2]), o[2]));
+        }
+#endif
+        for (; i < count; i++)
+        {
+            int c     = i % channels;
+            target[i] = source[i] * scale[c] + offset[c];
+        }
+    }
+}
+
+void image::convert_scale_channels(const cv::Mat&    source,
+                                   float*            target,
+                                   const cv::Size2i& canvas_size,
+                                   bool              channel_major,
+                                   const float*      scale,
+                                   const float*      offset)
+{
+    int channels = source.channels();
+    if (source.depth() != CV_8U || (channels != 1 && channels != 3))
+    {
+        throw invalid_argument("convert_scale_channels needs an 8 bit image with 1 or 3 channels");
+    }
+    if (source.cols > canvas_size.width || source.rows > canvas_size.height)
+    {
+        throw invalid_argument("convert_scale_channels image is larger than the canvas");
+    }
+
+    size_t plane_size = canvas_size.area();
+    if (!channel_major || channels == 1)
+    {
+        for (int row = 0; row < source.rows; row++)
+        {
+            convert_scale_row(source.ptr<uint8_t>(row),
+                              target + row * canvas_size.width * channels,
+                              source.cols * channels,
+                              channels,
+                              scale,
+                              offset);
+        }
+        return;
+    }
+
+    // the channels of a row are split through a buffer kept per thread
+    thread_local static vector<uint8_t> planes;
+    if (planes.size() < size_t(source.cols) * 3)
+    {
+        planes.resize(size_t(source.cols) * 3);
+    }
+    for (int row = 0; row < source.rows; row++)
+    {
+        const uint8_t* p = source.ptr<uint8_t>(row);
+        for (int col = 0; col < source.cols; col++)
+        {
+            planes[col]                   = p[col * 3];
+            planes[source.cols + col]     = p[col * 3 + 1];
+            planes[source.cols * 2 + col] = p[col * 3 + 2];
+        }
+        for (int c = 0; c < 3; c++)
+        {
+            convert_scale_row(&planes[source.cols * c],
+                              target + c * plane_size + row * canvas_size.width,
+                              source.cols,
+                              1,
+                              scale + c,
+                              offset + c);
+        }
+    }
+}
+
+void image::split_channels(
+    const cv::Mat& source, uint8_t* b, uint8_t* g, uint8_t* r, size_t stride)
+{
+    if (source.type() != CV_8UC3)
+    {
+        throw invalid_argument("split_channels needs a CV_8UC3 image");
+    }
+#ifdef __SSSE3__
+    // byte shuffles that gather one channel of 16 pixels from three 16 byte loads
+    const __m128i masks[3][3] = {
+        {_mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1),
+         _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1),
+         _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13)},
+        {_mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1),
+         _mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1),
+         _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14)},
+        {_mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1),
+         _mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1),
+         _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15)}};
+#endif
+    uint8_t* planes[3] = {b, g, r};
+    for (int row = 0; row < source.rows; row++)
+    {
+        const uint8_t* p   = source.ptr<uint8_t>(row);
+        size_t         out = row * stride;
+        int            col = 0;
+#ifdef __SSSE3__
+        for (; col + 16 <= source.cols; col += 16)
+        {
+            __m128i v0 = _mm_loadu_si128((const __m128i*)(p + col * 3));
+            __m128i v1 = _mm_loadu_si128((const __m128i*)(p + col * 3 + 16));
+            __m128i v2 = _mm_loadu_si128((const __m128i*)(p + col * 3 + 32));
+            for (int c = 0; c < 3; c++)
+            {
+                __m128i v = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(v0, masks[c][0]),
+                                                      _mm_shuffle_epi8(v1, masks[c][1])),
+                                         _mm_shuffle_epi8(v2, masks[c][2]));
+                _mm_storeu_si128((__m128i*)(planes[c] + out + col), v);
+            }
+        }
+#endif
+        for (; col < source.cols; col++)
+        {
+            b[out + col] = p[col * 3];
+            g[out + col] = p[col * 3 + 1];
+            r[out + col] = p[col * 3 + 2];
+        }
+    }
+}
+
+void image::clear_outside(char*             canvas,
+                          const cv::Size2i& canvas_size,
+                          const cv::Size2i& roi_size,
+                          size_t            pixel_size,
+                          size_t            planes)
+{
+    size_t row_size   = canvas_size.width * pixel_size;
+    size_t used_size  = roi_size.width * pixel_size;
+    size_t plane_size = row_size * canvas_size.height;
+    for (size_t plane = 0; plane < planes; plane++)
+    {
+        char* p = canvas + plane * plane_size;
+        if (used_size < row_size)
+        {
+            for (int row = 0; row < roi_size.height; row++)
+            {
+                memset(p + row * row_size + used_size, 0, row_size - used_size);
+            }
+        }
+        // the rows below the image are contiguous
+        size_t below = (canvas_size.height - roi_size.height) * row_size;
+        memset(p + roi_size.height * row_size, 0, below);
+    }
+}
+
 float image::calculate_scale(const cv::Size& size, int output_width, int output_height)
 {
     float      im_scale = (float)output_width / (float)size.width;
@@ -211,6 +411,227 @@ void image::expand(const cv::Mat& input,
     input.copyTo((output)(bbox_roi));
 }
 
+namespace
+{
+    // Calls func(marker, payload, payload_size) for every marker segment of a JPEG stream
+    // up to the start of scan, until func returns false.  Returns false if the data is
+    // not a JPEG stream or is truncated.
+    bool for_each_jpeg_segment(const void*                                           data,
+                               size_t                                                size,
+                               std::function<bool(uint8_t, const uint8_t*, size_t)> func)
+    {
+        const uint8_t* p   = static_cast<const uint8_t*>(data);
+        const uint8_t* end = p + size;
+
+        // SOI
+        if (size < 4 || p[0] != 0xFF || p[1] != 0xD8)
+        {
+            return false;
+        }
+        p += 2;
+
+        while (p + 4 <= end)
+        {
+            if (p[0] != 0xFF)
+            {
+                return false;
+            }
+            uint8_t marker = p[1];
+            if (marker == 0xFF)
+            {
+                // fill byte
+                p++;
+                continue;
+            }
+            p += 2;
+            if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7))
+            {
+                // standalone markers carry no length
+                continue;
+            }
+            if (marker == 0xD9 || marker == 0xDA)
+            {
+                // EOI or SOS
+                return true;
+            }
+
+            size_t length = (p[0] << 8) | p[1];
+            if (length < 2 || p + length > end)
+            {
+                return false;
+            }
+            if (!func(marker, p + 2, length - 2))
+            {
+                return true;
+            }
+            p += length;
+        }
+        return false;
+    }
+
+    uint32_t read_exif(const uint8_t* p, size_t bytes, bool big_endian)
+    {
+        uint32_t rc = 0;
+        for (size_t i = 0; i < bytes; i++)
+        {
+            rc |= uint32_t(p[big_endian ? i : bytes - 1 - i]) << (8 * (bytes - 1 - i));
+        }
+        return rc;
+    }
+}
+
+bool image::jpeg_size(const void* data, size_t size, cv::Size2i& image_size)
+{
+    bool found = false;
+    for_each_jpeg_segment(data, size, [&](uint8_t marker, const uint8_t* p, size_t length) {
+        // SOFn, excluding DHT, JPG and DAC which share the range
+        bool is_sof = marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 &&
+                      marker != 0xCC;
+        if (is_sof && length >= 5)
+        {
+            // precision, height, width
+            image_size.height = (p[1] << 8) | p[2];
+            image_size.width  = (p[3] << 8) | p[4];
+            found             = image_size.width > 0 && image_size.height > 0;
+        }
+        return !is_sof;
+    });
+    return found;
+}
+
+int image::jpeg_orientation(const void* data, size_t size)
+{
+    int orientation = 1;
+    for_each_jpeg_segment(data, size, [&](uint8_t marker, const uint8_t* p, size_t length) {
+        // APP1 holding "Exif\0\0" followed by a TIFF header
+        if (marker != 0xE1 || length < 14 || memcmp(p, "Exif\0\0", 6) != 0)
+        {
+            return true;
+        }
+        const uint8_t* tiff       = p + 6;
+        size_t         tiff_size  = length - 6;
+        bool           big_endian = tiff[0] == 'M';
+        uint32_t       ifd        = read_exif(tiff + 4, 4, big_endian);
+        if (ifd + 2 > tiff_size)
+        {
+            return false;
+        }
+        uint32_t entry_count = read_exif(tiff + ifd, 2, big_endian);
+        for (uint32_t i = 0; i < entry_count; i++)
+        {
+            const uint8_t* entry = tiff + ifd + 2 + i * 12;
+            if (entry + 12 > tiff + tiff_size)
+            {
+                break;
+            }
+            if (read_exif(entry, 2, big_endian) == 0x0112)
+            {
+                orientation = read_exif(entry + 8, 2, big_endian);
+                break;
+            }
+        }
+        return false;
+    });
+    return orientation;
+}
+
+#ifdef JPEG_TURBO_FOUND
+namespace
+{
+    struct jpeg_error_handler
+    {
+        jpeg_error_mgr pub;
+        jmp_buf        jump;
+    };
+
+    void jpeg_error_exit(j_common_ptr cinfo)
+    {
+        longjmp(reinterpret_cast<jpeg_error_handler*>(cinfo->err)->jump, 1);
+    }
+
+    void jpeg_output_message(j_common_ptr)
+    {
+        // warnings about corrupt data are reported by the full decode fallback
+    }
+}
+#endif
+
+bool image::decode_jpeg_roi(const void*     data,
+                            size_t          size,
+                            int             channels,
+                            int             reduction,
+                            const cv::Rect& roi,
+                            cv::Mat&        output)
+{
+#ifdef JPEG_TURBO_FOUND
+    if (roi.width <= 0 || roi.height <= 0 || (channels != 1 && channels != 3))
+    {
+        return false;
+    }
+
+    jpeg_decompress_struct cinfo;
+    jpeg_error_handler     err;
+    cinfo.err              = jpeg_std_error(&err.pub);
+    err.pub.error_exit     = jpeg_error_exit;
+    err.pub.output_message = jpeg_output_message;
+
+    // a local that is changed after setjmp is indeterminate after the longjmp, so the
+    // jump target is set again once buffer is allocated and buffer is left alone after
+    cv::Mat buffer;
+    if (setjmp(err.jump))
+    {
+        jpeg_destroy_decompress(&cinfo);
+        return false;
+    }
+
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, (unsigned char*)data, size);
+    jpeg_read_header(&cinfo, TRUE);
+    cinfo.out_color_space = channels == 3 ? JCS_EXT_BGR : JCS_GRAYSCALE;
+    cinfo.scale_num       = 1;
+    cinfo.scale_denom     = reduction;
+    jpeg_start_decompress(&cinfo);
+
+    if (roi.x + roi.width > (int)cinfo.output_width ||
+        roi.y + roi.height > (int)cinfo.output_height)
+    {
+        jpeg_destroy_decompress(&cinfo);
+        return false;
+    }
+
+    // the horizontal crop is widened to iMCU boundaries
+    JDIMENSION x_offset = roi.x;
+    JDIMENSION width    = roi.width;
+    jpeg_crop_scanline(&cinfo, &x_offset, &width);
+
+    buffer.create(roi.height, cinfo.output_width, CV_8UC(channels));
+    if (setjmp(err.jump))
+    {
+        jpeg_destroy_decompress(&cinfo);
+        return false;
+    }
+    jpeg_skip_scanlines(&cinfo, roi.y);
+    for (int row = 0; row < roi.height;)
+    {
+        JSAMPROW   line  = buffer.ptr(row);
+        JDIMENSION lines = jpeg_read_scanlines(&cinfo, &line, 1);
+        if (lines == 0)
+        {
+            jpeg_destroy_decompress(&cinfo);
+            return false;
+        }
+        row += lines;
+    }
+    jpeg_abort_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+
+    output = buffer(cv::Rect(roi.x - x_offset, 0, roi.width, roi.height));
+    return true;
+#else
+    return false;
+#endif
+}
+
 /* Transform:
     image::config will be a supplied bunch of params used by this provider.
     on each record, the transformer will use the config along with the supplied
@@ -254,52 +675,181 @@ void image::photometric::lighting(cv::Mat& inout, vector<float> lighting, float
     }
 }
 
+namespace
+{
+    inline uint8_t color_pixel(const float* m, int c, float b, float g, float r)
+    {
+        return cv::saturate_cast<uint8_t>(
+            nearbyintf(m[c * 3] * b + m[c * 3 + 1] * g + m[c * 3 + 2] * r));
+    }
+
+    // Applies the 3x3 color matrix m to a CV_8UC3 image in place and adds up every
+    // channel of the result.  Each row is split into planes so that the vector kernel
+    // works on 16 pixels at a time.  The planes are a per-thread row buffer that is only
+    // resized when it grows.
+    void color_transform(cv::Mat& image, const float* m, double* sums)
+    {
+        int                                 width = image.cols;
+        thread_local static vector<uint8_t> planes;
+        if (planes.size() < size_t(width) * 3)
+        {
+            planes.resize(size_t(width) * 3);
+        }
+        uint8_t* b = planes.data();
+        uint8_t* g = b + width;
+        uint8_t* r = g + width;
+        for (int row = 0; row < image.rows; row++)
+        {
+            uint8_t* p = image.ptr<uint8_t>(row);
+            for (int j = 0; j < width; j++)
+            {
+                b[j] = p[j * 3];
+                g[j] = p[j * 3 + 1];
+                r[j] = p[j * 3 + 2];
+            }
+
+            uint64_t row_sums[3] = {0, 0, 0};
+            int      i           = 0;
+#ifdef __SSE2__
+            __m128i zero   = _mm_setzero_si128();
+            __m128i acc[3] = {zero, zero, zero};
+            __m128  mat[9];
+            for (int k = 0; k < 9; k++)
+            {
+                mat[k] = _mm_set1_ps(m[k]);
+            }
+            for (; i + 16 <= width; i += 16)
+            {
+                __m128i in[3] = {_mm_loadu_si128((const __m128i*)(b + i)),
+                                 _mm_loadu_si128((const __m128i*)(g + i)),
+                                 _mm_loadu_si128((const __m128i*)(r + i))};
+
+                // widen to 4 groups of 4 floats per channel
+                __m128 f[3][4];
+                for (int c = 0; c < 3; c++)
+                {
+                    __m128i lo = _mm_unpacklo_epi8(in[c], zero);
+                    __m128i hi = _mm_unpackhi_epi8(in[c], zero);
+                    f[c][0]    = _mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero));
+                    f[c][1]    = _mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero));
+                    f[c][2]    = _mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero));
+                    f[c][3]    = _mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero));
+                }
+
+                uint8_t* out[3] = {b + i, g + i, r + i};
+                for (int c = 0; c < 3; c++)
+                {
+                    // rounds half to even like nearbyintf, packing saturates to [0, 255]
+                    __m128i q[4];
+                    for (int k = 0; k < 4; k++)
+                    {
+                        __m128 v = _mm_mul_ps(mat[c * 3], f[0][k]);
+                        v        = _mm_add_ps(v, _mm_mul_ps(mat[c * 3 + 1], f[1][k]));
+                        v        = _mm_add_ps(v, _mm_mul_ps(mat[c * 3 + 2], f[2][k]));
+                        q[k]     = _mm_cvtps_epi32(v);
+                    }
+                    __m128i v = _mm_packus_epi16(_mm_packs_epi32(q[0], q[1]),
+                                                 _mm_packs_epi32(q[2], q[3]));
+                    _mm_storeu_si128((__m128i*)out[c], v);
+                    acc[c] = _mm_add_epi64(acc[c], _mm_sad_epu8(v, zero));
+                }
+            }
+            for (int c = 0; c < 3; c++)
+            {
+                uint64_t halves[2];
+                _mm_storeu_si128((__m128i*)halves, acc[c]);
+                row_sums[c] = halves[0] + halves[1];
+            }
+#endif
+            for (; i < width; i++)
+            {
+                float pb = b[i];
+                float pg = g[i];
+                float pr = r[i];
+                b[i]     = color_pixel(m, 0, pb, pg, pr);
+                g[i]     = color_pixel(m, 1, pb, pg, pr);
+                r[i]     = color_pixel(m, 2, pb, pg, pr);
+                row_sums[0] += b[i];
+                row_sums[1] += g[i];
+                row_sums[2] += r[i];
+            }
+
+            for (int j = 0; j < width; j++)
+            {
+                p[j * 3]     = b[j];
+                p[j * 3 + 1] = g[j];
+                p[j * 3 + 2] = r[j];
+            }
+            for (int c = 0; c < 3; c++)
+            {
+                sums[c] += row_sums[c];
+            }
+        }
+    }
+}
+
+cv::Mat image::photometric::color_matrix(float brightness, float saturation, int hue)
+{
+    /****************************
+    *  BRIGHTNESS & SATURATION  *
+    *****************************/
+    // float data[] = {0.114, 0.587, 0.299};   // NTSC
+    float         data[] = {0.0820, 0.6094, 0.3086};
+    const cv::Mat GSCL(3, 1, CV_32FC1, data);
+    cv::Mat       satmtx = brightness * (saturation * cv::Mat::eye(3, 3, CV_32FC1) +
+                                   (1 - saturation) * cv::Mat::ones(3, 1, CV_32FC1) * GSCL.t());
+    if (hue == 0)
+    {
+        return satmtx;
+    }
+
+    /*************
+    *  HUE SHIFT *
+    **************/
+    // BGR to YIQ, then rotate the chroma plane, hue is in the 0-180 units of 8 bit HSV
+    const double yiq_data[3][3] = {
+        {0.114, 0.587, 0.299}, {-0.322, -0.274, 0.596}, {0.312, -0.523, 0.211}};
+    const cv::Mat yiq(3, 3, CV_64FC1, (void*)yiq_data);
+    double        theta     = hue * 2.0 * CV_PI / 180.0;
+    const double  rot[3][3] = {
+        {1, 0, 0}, {0, cos(theta), sin(theta)}, {0, -sin(theta), cos(theta)}};
+    cv::Mat hue_mtx = yiq.inv() * cv::Mat(3, 3, CV_64FC1, (void*)rot) * yiq;
+    hue_mtx.convertTo(hue_mtx, CV_32FC1);
+    return hue_mtx * satmtx;
+}
+
 /*
 Implements hue shift as well as contrast, brightness, and saturation jittering using the following definitions:
-Hue: Add some multiple of 2 degrees to hue channel.
+Hue: Rotate the chroma of each pixel in YIQ space by some multiple of 2 degrees.
 Contrast: Add some multiple of the grayscale mean of the image.
 Brightness: Magnify the intensity of each pixel by photometric[1]
 Saturation: Add some multiple of the pixel's grayscale value to itself.
 photometric is filled with uniformly distributed values prior to calling this function
+
+Hue, saturation and brightness are folded into one color matrix applied in a single pass
+over the image, which also collects the mean used for contrast.
 */
 // adjusts contrast, brightness, and saturation according
 // to values in photometric[0], photometric[1], photometric[2], respectively
 void image::photometric::cbsjitter(
     cv::Mat& inout, float contrast, float brightness, float saturation, int hue)
 {
-    // Skip transformations if given deterministic settings
-    if (brightness != 1.0 || saturation != 1.0)
-    {
-        /****************************
-        *  BRIGHTNESS & SATURATION  *
-        *****************************/
-        // float data[] = {0.114, 0.587, 0.299};   // NTSC
-        float         data[] = {0.0820, 0.6094, 0.3086};
-        const cv::Mat GSCL(3, 1, CV_32FC1, data);
-        cv::Mat       satmtx = brightness * (saturation * cv::Mat::eye(3, 3, CV_32FC1) +
-                                       (1 - saturation) * cv::Mat::ones(3, 1, CV_32FC1) * GSCL.t());
-        cv::transform(inout, inout, satmtx);
-    }
+    double sums[3]  = {0, 0, 0};
+    bool   has_sums = false;
 
-    if (hue != 0)
+    // Skip transformations if given deterministic settings
+    if (brightness != 1.0 || saturation != 1.0 || hue != 0)
     {
-        /*************
-        *  HUE SHIFT *
-        **************/
-        cv::Mat hsv;
-        // Convert to HSV colorspae.
-        cv::cvtColor(inout, hsv, CV_BGR2HSV);
-
-        // Adjust the hue.
-        uint8_t* p = hsv.data;
-        for (int i = 0; i < hsv.size().area(); i++)
+        cv::Mat mtx = color_matrix(brightness, saturation, hue);
+        if (inout.type() == CV_8UC3)
         {
-            *p = (*p + hue) % 180;
-            p += 3;
+            color_transform(inout, mtx.ptr<float>(), sums);
+            has_sums = true;
+        }
+        else
+        {
+            cv::transform(inout, inout, mtx);
         }
-
-        // Back to BGR colorspace.
-        cvtColor(hsv, inout, CV_HSV2BGR);
     }
 
     if (contrast != 1.0)
@@ -307,10 +857,29 @@ void image::photometric::cbsjitter(
         /*************
         *  CONTRAST  *
         **************/
-        cv::Mat dst_img;
-        inout.convertTo(dst_img, CV_32FC3, contrast);
-        dst_img += (1.0 - contrast) * cv::mean(inout);
-        dst_img.convertTo(inout, CV_8UC3);
+        cv::Scalar mean;
+        if (has_sums)
+        {
+            double area = inout.total();
+            mean        = cv::Scalar(sums[0] / area, sums[1] / area, sums[2] / area);
+        }
+        else
+        {
+            mean = cv::mean(inout);
+        }
+
+        // v * contrast + (1 - contrast) * mean for every value of every channel
+        int     channels = inout.channels();
+        cv::Mat lut(1, 256, CV_8UC(channels));
+        for (int c = 0; c < channels; c++)
+        {
+            float offset = (1.0f - contrast) * float(mean[c]);
+            for (int v = 0; v < 256; v++)
+            {
+                lut.data[v * channels + c] = cv::saturate_cast<uint8_t>(v * contrast + offset);
+            }
+        }
+        cv::LUT(inout, lut, inout);
     }
 }
 
@@ -37,6 +37,29 @@ namespace nervana
                                   std::vector<cv::Mat>& target,
                                   std::vector<int>&     from_to);
 
+        // Converts an 8 bit image to float as value * scale[c] + offset[c] for channel c
+        // and writes it to the top left of a canvas of canvas_size pixels, either as one
+        // plane per channel or interleaved.  This is one pass over the image instead of
+        // a conversion followed by mixChannels.
+        void convert_scale_channels(const cv::Mat&    source,
+                                    float*            target,
+                                    const cv::Size2i& canvas_size,
+                                    bool              channel_major,
+                                    const float*      scale,
+                                    const float*      offset);
+
+        // Splits a CV_8UC3 image into three planes whose rows are stride bytes apart
+        void split_channels(
+            const cv::Mat& source, uint8_t* b, uint8_t* g, uint8_t* r, size_t stride);
+
+        // Zeroes the part of a canvas outside the roi_size pixels at its top left, for
+        // every one of planes planes of pixel_size byte pixels
+        void clear_outside(char*             canvas,
+                           const cv::Size2i& canvas_size,
+                           const cv::Size2i& roi_size,
+                           size_t            pixel_size,
+                           size_t            planes);
+
         void add_padding(cv::Mat& input, int padding, cv::Size2i crop_offset);
 
         float calculate_scale(const cv::Size& size, int output_width, int output_height);
@@ -48,6 +71,24 @@ namespace nervana
                                       float             scale);
         cv::Point2f cropbox_shift(const cv::Size2f&, const cv::Size2f&, float, float);
 
+        // Reads the frame size from the header of a JPEG stream without decoding it.
+        // Returns false if the data is not a JPEG or the frame header is not found.
+        bool jpeg_size(const void* data, size_t size, cv::Size2i& image_size);
+
+        // Reads the EXIF orientation of a JPEG stream, 1 when there is none.
+        int jpeg_orientation(const void* data, size_t size);
+
+        // Decodes only the region roi of a JPEG stream scaled by 1/reduction, with roi
+        // given in scaled pixels.  Only the iMCU rows and columns covering roi are
+        // decoded.  Returns false if the decode is not possible, in which case the
+        // caller falls back to a full decode.  Needs libjpeg-turbo.
+        bool decode_jpeg_roi(const void*     data,
+                             size_t          size,
+                             int             channels,
+                             int             reduction,
+                             const cv::Rect& roi,
+                             cv::Mat&        output);
+
         class photometric
         {
         public:
@@ -55,6 +96,10 @@ namespace nervana
             static void lighting(cv::Mat& inout, std::vector<float>, float color_noise_std);
             static void cbsjitter(
                 cv::Mat& inout, float contrast, float brightness, float saturation, int hue = 0);
+
+            // 3x3 matrix for BGR pixels that applies saturation and brightness followed by
+            // a rotation of the hue by hue * 2 degrees in YIQ space
+            static cv::Mat color_matrix(float brightness, float saturation, int hue);
             static void transform_hsv(cv::Mat&    image,
                                       const float h_gain,
                                       const float s_gain,
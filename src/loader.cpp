@@ -82,6 +82,16 @@ void loader_config::validate()
     {
         throw invalid_argument("iteration_mode must be one of ONCE, COUNT, or INFINITE");
     }
+
+    if (shard_index >= shard_count)
+    {
+        throw invalid_argument("shard_index must be less than shard_count");
+    }
+    if (shard_reshuffle && !cache_directory.empty())
+    {
+        // cached blocks would pin the first epoch's shard membership
+        throw invalid_argument("shard_reshuffle can not be used with cache_directory");
+    }
 }
 
 loader_local::loader_local(const std::string& config_string)
@@ -119,12 +129,20 @@ void loader_local::initialize(const json& config_json)
 
     if (nervana::manifest_nds::is_likely_json(lcfg.manifest_filename))
     {
+        if (lcfg.shard_reshuffle)
+        {
+            throw invalid_argument("shard_reshuffle is not supported for NDS manifests");
+        }
         m_manifest_nds = nervana::manifest_nds_builder()
                              .filename(lcfg.manifest_filename)
                              .block_size(lcfg.block_size)
                              .elements_per_record(2)
                              .shuffle(lcfg.shuffle_manifest)
                              .seed(lcfg.random_seed)
+                             .shard_count(lcfg.shard_count)
+                             .shard_index(lcfg.shard_index)
+                             .prefetch_count(lcfg.nds_prefetch_count)
+                             .spill_directory(lcfg.nds_spill_directory)
                              .make_shared();
 
         m_block_loader = std::make_shared<block_loader_nds>(m_manifest_nds, lcfg.block_size);
@@ -137,7 +155,11 @@ void loader_local::initialize(const json& config_json)
                                                      lcfg.manifest_root,
                                                      lcfg.subset_fraction,
                                                      lcfg.block_size,
-                                                     lcfg.random_seed);
+                                                     lcfg.random_seed,
+                                                     lcfg.manifest_index,
+                                                     lcfg.shard_count,
+                                                     lcfg.shard_index,
+                                                     lcfg.shard_reshuffle);
 
         // TODO: make the constructor throw this error
         if (record_count() == 0)
@@ -176,8 +198,23 @@ void loader_local::initialize(const json& config_json)
 
     const int decode_size =
         lcfg.batch_size * ((threads_num * m_input_multiplier - 1) / lcfg.batch_size + 1);
-    m_batch_iterator = make_shared<batch_iterator>(m_block_manager, decode_size);
+    m_decode_size = decode_size;
 
+    shared_ptr<async_manager_source<encoded_record_list>> record_source = m_block_manager;
+    if (lcfg.shuffle_buffer_size > 0)
+    {
+        m_shuffle_buffer = make_shared<shuffle_buffer>(m_block_manager,
+                                                       lcfg.shuffle_buffer_size,
+                                                       decode_size,
+                                                       record_count(),
+                                                       lcfg.random_seed);
+        record_source = m_shuffle_buffer;
+    }
+    m_batch_iterator = make_shared<batch_iterator>(record_source, decode_size);
+
+    // Records are decoded batch major and feature major batches are made by the tiled
+    // transpose in batch_iterator_fbm.  Decoding feature major in blocks leaves too few
+    // records per decode thread to write whole cache lines, and was measured slower.
     m_decoder = make_shared<batch_decoder>(m_batch_iterator,
                                            decode_size,
                                            lcfg.decode_thread_count,
@@ -185,9 +222,11 @@ void loader_local::initialize(const json& config_json)
                                            m_provider,
                                            lcfg.random_seed);
 
-    m_final_stage =
-        make_shared<batch_iterator_fbm>(m_decoder, lcfg.batch_size, m_provider, !lcfg.batch_major);
+    m_batch_iterator_fbm = make_shared<batch_iterator_fbm>(
+        m_decoder, lcfg.batch_size, lcfg.decode_thread_count, m_provider, !lcfg.batch_major);
+    m_final_stage = m_batch_iterator_fbm;
 
+    m_sequence_base     = m_manifest_file ? m_manifest_file->sequence_number() : 0;
     m_output_buffer_ptr = m_final_stage->next();
 
     if (lcfg.web_server_port != 0)
@@ -263,16 +302,144 @@ const fixed_buffer_map& loader::iterator::operator*() const
         throw std::runtime_error("empty buffer");
 }
 
+void loader_local::reset()
+{
+    m_final_stage->reset();
+    m_stream_batch      = 0;
+    m_sequence_base     = m_manifest_file ? m_manifest_file->sequence_number() : 0;
+    m_output_buffer_ptr = m_final_stage->next();
+    m_position          = 0;
+}
+
 void loader_local::increment_position()
 {
     m_output_buffer_ptr = m_final_stage->next();
     m_position++;
+    m_stream_batch++;
 
     // Wrap around if this is an infinite iterator
     if (m_batch_mode == BatchMode::INFINITE && m_position == m_batch_count_value)
     {
         m_position = 0;
     }
+
+    // states older than the decoder batch holding the current batch can not be restored
+    if (m_manifest_file)
+    {
+        size_t decoder_batch = m_stream_batch * m_batch_size / m_decode_size;
+        size_t stream_offset = decoder_batch * m_decode_size;
+        size_t epoch         = stream_offset / record_count();
+        m_decoder->release_states(decoder_batch);
+        if (m_shuffle_buffer)
+        {
+            m_shuffle_buffer->release_states(stream_offset);
+        }
+        m_block_manager->release_states(epoch);
+        m_manifest_file->release_states(m_sequence_base + m_block_manager->manifest_epoch(epoch));
+    }
+}
+
+json loader::save_state() const
+{
+    throw runtime_error("save_state is not supported by this loader");
+}
+
+void loader::restore_state(const json& state)
+{
+    throw runtime_error("restore_state is not supported by this loader");
+}
+
+void loader_local::check_state_support() const
+{
+    if (!m_manifest_file)
+    {
+        throw runtime_error("loader state is not supported for NDS manifests");
+    }
+}
+
+json loader_local::save_state() const
+{
+    check_state_support();
+
+    // The stream is restarted at the start of the decoder batch holding the current batch,
+    // so only that decoder batch is decoded again on restore.
+    size_t record_offset = m_stream_batch * m_batch_size;
+    size_t decoder_batch = record_offset / m_decode_size;
+    size_t stream_offset = decoder_batch * m_decode_size;
+    size_t epoch         = stream_offset / record_count();
+
+    json state = {{"version", 1},
+                  {"record_count", record_count()},
+                  {"batch_size", m_batch_size},
+                  {"decode_size", m_decode_size},
+                  {"stream_batch", m_stream_batch},
+                  {"position", m_position},
+                  {"epoch", epoch}};
+
+    // The blocks are read again from the stream offset or, with a shuffle buffer, from the
+    // earliest record held in the saved buffer.
+    size_t block_epoch  = epoch;
+    size_t block_offset = stream_offset % record_count();
+    if (m_shuffle_buffer)
+    {
+        json shuffle_state      = m_shuffle_buffer->get_state(stream_offset);
+        block_epoch             = shuffle_state.at("epoch");
+        block_offset            = shuffle_state.at("origin");
+        state["shuffle_buffer"] = std::move(shuffle_state);
+    }
+    json blocks = m_block_manager->get_state(block_epoch, block_offset);
+    if (blocks.at("source") == "manifest")
+    {
+        size_t manifest_epoch = blocks.at("manifest_epoch");
+        state["manifest"] =
+            m_manifest_file->get_state(m_sequence_base + manifest_epoch, block_offset);
+    }
+    state["blocks"]  = std::move(blocks);
+    state["decoder"] = m_decoder->get_state(decoder_batch);
+    return state;
+}
+
+void loader_local::restore_state(const json& state)
+{
+    check_state_support();
+    if (state.at("version") != 1 || state.at("record_count") != record_count() ||
+        state.at("batch_size") != m_batch_size || state.at("decode_size") != m_decode_size ||
+        (state.count("shuffle_buffer") != 0) != (m_shuffle_buffer != nullptr))
+    {
+        throw invalid_argument("loader state does not match the loader configuration");
+    }
+
+    size_t stream_batch  = state.at("stream_batch");
+    size_t record_offset = stream_batch * m_batch_size;
+    size_t decoder_batch = record_offset / m_decode_size;
+    size_t epoch         = state.at("epoch");
+    if (epoch != decoder_batch * m_decode_size / record_count())
+    {
+        throw invalid_argument("loader state is inconsistent");
+    }
+
+    // stop the pipeline, then position every stage at the start of the decoder batch
+    m_final_stage->reset();
+    const json& blocks      = state.at("blocks");
+    size_t      block_index = 0;
+    if (blocks.at("source") == "manifest")
+    {
+        const json& manifest_state = state.at("manifest");
+        m_manifest_file->set_state(manifest_state, blocks.at("manifest_epoch"));
+        block_index = manifest_state.at("block_index");
+    }
+    m_block_manager->set_state(blocks, block_index);
+    if (m_shuffle_buffer)
+    {
+        m_shuffle_buffer->set_state(state.at("shuffle_buffer"), decoder_batch * m_decode_size);
+    }
+    m_decoder->set_state(state.at("decoder"), decoder_batch);
+    m_batch_iterator_fbm->skip_records(record_offset - decoder_batch * m_decode_size);
+
+    m_stream_batch      = stream_batch;
+    m_sequence_base     = 0;
+    m_position          = state.at("position");
+    m_output_buffer_ptr = m_final_stage->next();
 }
 
 std::unique_ptr<loader> loader_factory::get_loader(const std::string& config)
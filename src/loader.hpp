@@ -35,6 +35,7 @@
 #include "block_loader_file.hpp"
 #include "block_loader_nds.hpp"
 #include "block_manager.hpp"
+#include "shuffle_buffer.hpp"
 #include "log.hpp"
 #include "util.hpp"
 #include "web_app.hpp"
@@ -58,9 +59,16 @@ public:
 
     std::string                 cache_directory      = "";
     int                         block_size           = 5000;
+    int                         shuffle_buffer_size  = 0;
     float                       subset_fraction      = 1.0;
     bool                        shuffle_enable       = false;
     bool                        shuffle_manifest     = false;
+    bool                        manifest_index       = false;
+    uint32_t                    shard_count          = 1;
+    uint32_t                    shard_index          = 0;
+    bool                        shard_reshuffle      = false;
+    uint32_t                    nds_prefetch_count   = 1;
+    std::string                 nds_spill_directory  = "";
     bool                        pinned               = false;
     bool                        batch_major          = true;
     uint32_t                    random_seed          = 0;
@@ -89,6 +97,13 @@ private:
                    [](decltype(subset_fraction) v) { return v <= 1.0f && v >= 0.0f; }),
         ADD_SCALAR(shuffle_enable, mode::OPTIONAL),
         ADD_SCALAR(shuffle_manifest, mode::OPTIONAL),
+        ADD_SCALAR(shuffle_buffer_size, mode::OPTIONAL, [](int v) { return v >= 0; }),
+        ADD_SCALAR(manifest_index, mode::OPTIONAL),
+        ADD_SCALAR(shard_count, mode::OPTIONAL, [](uint32_t v) { return v > 0; }),
+        ADD_SCALAR(shard_index, mode::OPTIONAL),
+        ADD_SCALAR(shard_reshuffle, mode::OPTIONAL),
+        ADD_SCALAR(nds_prefetch_count, mode::OPTIONAL, [](uint32_t v) { return v > 0; }),
+        ADD_SCALAR(nds_spill_directory, mode::OPTIONAL),
         ADD_SCALAR(decode_thread_count, mode::OPTIONAL),
         ADD_SCALAR(pinned, mode::OPTIONAL),
         ADD_SCALAR(random_seed, mode::OPTIONAL),
@@ -172,6 +187,11 @@ public:
     virtual nlohmann::json          get_current_config() const = 0;
     virtual const char*             get_session_id() const     = 0;
 
+    // save_state() describes the stream at the current batch. restore_state() on a loader
+    // created with the same configuration continues the stream from that batch.
+    virtual nlohmann::json save_state() const;
+    virtual void           restore_state(const nlohmann::json& state);
+
 protected:
     virtual void increment_position() = 0;
 };
@@ -219,21 +239,20 @@ public:
     iterator&               get_end_iter() override { return m_end_iter; }
     const fixed_buffer_map* get_output_buffer() const override { return m_output_buffer_ptr; }
     const size_t&           position() override { return m_position; }
-    void                    reset() override
-    {
-        m_final_stage->reset();
-        m_output_buffer_ptr = m_final_stage->next();
-        m_position          = 0;
-    }
+    void                    reset() override;
 
     nlohmann::json get_current_config() const override { return m_current_config; }
     const char*    get_session_id() const override { return ""; }
+    nlohmann::json save_state() const override;
+    void           restore_state(const nlohmann::json& state) override;
+
 private:
     friend class nervana::loader::iterator;
 
     loader_local() = delete;
     void initialize(const nlohmann::json& config_json);
     void increment_position() override;
+    void check_state_support() const;
 
     iterator                                                m_current_iter;
     iterator                                                m_end_iter;
@@ -241,14 +260,19 @@ private:
     std::shared_ptr<manifest_nds>                           m_manifest_nds;
     std::shared_ptr<block_loader_source>                    m_block_loader;
     std::shared_ptr<block_manager>                          m_block_manager;
+    std::shared_ptr<shuffle_buffer>                         m_shuffle_buffer;
     std::shared_ptr<batch_iterator>                         m_batch_iterator;
     std::shared_ptr<provider_interface>                     m_provider;
     std::shared_ptr<batch_decoder>                          m_decoder;
+    std::shared_ptr<batch_iterator_fbm>                     m_batch_iterator_fbm;
     std::shared_ptr<async_manager_source<fixed_buffer_map>> m_final_stage;
     int                                                     m_batch_size;
+    size_t                                                  m_decode_size;
     BatchMode                                               m_batch_mode;
     int                                                     m_batch_count_value;
     size_t                                                  m_position{0};
+    size_t                                                  m_stream_batch{0};
+    size_t                                                  m_sequence_base{0};
     fixed_buffer_map*                                       m_output_buffer_ptr{nullptr};
     nlohmann::json                                          m_current_config;
     std::shared_ptr<web_app>                                m_debug_web_app;
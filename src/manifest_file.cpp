@@ -15,15 +15,24 @@
 *******************************************************************************/
 
 #include <sys/stat.h>
+#include <unistd.h>
 
 #include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
+#include <future>
 #include <iomanip>
 #include <iostream>
 #include <iterator>
+#include <limits>
 #include <numeric>
 #include <sstream>
 #include <string>
+#include <thread>
 
 #include "manifest_file.hpp"
 #include "util.hpp"
@@ -47,26 +56,148 @@ namespace errors
         "neon doc/source/loading_data.rst#aeon-dataloader for more information.";
 }
 
+namespace
+{
+    // Layout of the binary manifest index:
+    //   index_header
+    //   source filename, manifest_root, padded to 8 bytes
+    //   element types, one byte each, padded to 8 bytes
+    //   record_count * element_count + 1 element offsets into the data section
+    //   element data
+    // The offsets are 8 byte aligned so that a mapped index is used as the record table.
+    const char index_magic[8] = {'A', 'E', 'O', 'N', 'I', 'D', 'X', '3'};
+
+    struct index_header
+    {
+        char     magic[8];
+        uint64_t manifest_size;
+        int64_t  manifest_mtime_sec;
+        int64_t  manifest_mtime_nsec;
+        uint64_t record_count;
+        uint64_t element_count;
+        uint64_t source_size;
+        uint64_t root_size;
+        float    subset_fraction;
+        uint32_t crc;
+    };
+
+    bool get_manifest_stats(const string& filename, index_header& header)
+    {
+        struct stat stats;
+        if (stat(filename.c_str(), &stats) == -1)
+        {
+            return false;
+        }
+        header.manifest_size = stats.st_size;
+#ifdef __APPLE__
+        header.manifest_mtime_sec  = stats.st_mtimespec.tv_sec;
+        header.manifest_mtime_nsec = stats.st_mtimespec.tv_nsec;
+#else
+        header.manifest_mtime_sec  = stats.st_mtim.tv_sec;
+        header.manifest_mtime_nsec = stats.st_mtim.tv_nsec;
+#endif
+        return true;
+    }
+
+    size_t index_padding(size_t size) { return (8 - size % 8) % 8; }
+
+    // true when the conversion consumed all of text apart from trailing white space,
+    // such as the carriage return of a manifest with DOS line endings
+    bool converted(const string& text, const char* end)
+    {
+        const char* last = text.data() + text.size();
+        if (end == text.data())
+        {
+            return false;
+        }
+        while (end < last && isspace(static_cast<unsigned char>(*end)))
+        {
+            end++;
+        }
+        return end == last;
+    }
+
+    // parsed as a double and truncated toward zero like the stod conversion this replaced,
+    // so "1.0" and "1e3" are accepted
+    bool parse_int32(const string& text, int32_t& value)
+    {
+        char* end = nullptr;
+        errno     = 0;
+        double rc = trunc(strtod(text.c_str(), &end));
+        if (errno != 0 || !converted(text, end) || !(rc >= numeric_limits<int32_t>::min()) ||
+            !(rc <= numeric_limits<int32_t>::max()))
+        {
+            return false;
+        }
+        value = static_cast<int32_t>(rc);
+        return true;
+    }
+
+    bool parse_float(const string& text, float& value)
+    {
+        char* end = nullptr;
+        errno     = 0;
+        float rc  = strtof(text.c_str(), &end);
+        if (errno != 0 || !converted(text, end))
+        {
+            return false;
+        }
+        value = rc;
+        return true;
+    }
+
+    // balanced slice [first, second) of the records, shard sizes differ by at most one
+    pair<size_t, size_t> shard_range(size_t record_count, size_t shard_count, size_t shard_index)
+    {
+        size_t size      = record_count / shard_count;
+        size_t remainder = record_count % shard_count;
+        size_t first     = shard_index * size + std::min(shard_index, remainder);
+        return make_pair(first, first + size + (shard_index < remainder ? 1 : 0));
+    }
+}
+
 manifest_file::manifest_file(const string& filename,
                              bool          shuffle,
                              const string& root,
                              float         subset_fraction,
                              size_t        block_size,
-                             uint32_t      seed)
+                             uint32_t      seed,
+                             bool          use_index,
+                             size_t        shard_count,
+                             size_t        shard_index,
+                             bool          shard_reshuffle)
     : m_source_filename(filename)
     , m_record_count{0}
     , m_shuffle{shuffle}
     , m_random{seed ? seed : random_device{}()}
+    , m_seed{seed}
+    , m_shard_count{shard_count}
+    , m_shard_index{shard_index}
+    , m_shard_reshuffle{shard_reshuffle}
 {
-    // for now parse the entire manifest on creation
-    ifstream infile(m_source_filename);
+    check_shard_config();
 
-    if (!infile.is_open())
+    // for now parse the entire manifest on creation
+    if (!file_util::exists(m_source_filename))
     {
         throw std::runtime_error("Manifest file " + m_source_filename + " doesn't exist.");
     }
 
-    initialize(infile, block_size, root, subset_fraction);
+    if (!use_index || !load_index(root, subset_fraction))
+    {
+        vector<record> record_list;
+        {
+            memory_mapped_file infile(m_source_filename);
+            record_list = parse(infile.data(), infile.size());
+        }
+        prepare_records(record_list, root, subset_fraction);
+        pack_records(record_list);
+        if (use_index)
+        {
+            save_index(root, subset_fraction);
+        }
+    }
+    create_blocks(block_size);
 }
 
 manifest_file::manifest_file(std::istream&      stream,
@@ -74,11 +205,19 @@ manifest_file::manifest_file(std::istream&      stream,
                              const std::string& root,
                              float              subset_fraction,
                              size_t             block_size,
-                             uint32_t           seed)
+                             uint32_t           seed,
+                             size_t             shard_count,
+                             size_t             shard_index,
+                             bool               shard_reshuffle)
     : m_record_count{0}
     , m_shuffle{shuffle}
     , m_random{seed ? seed : random_device{}()}
+    , m_seed{seed}
+    , m_shard_count{shard_count}
+    , m_shard_index{shard_index}
+    , m_shard_reshuffle{shard_reshuffle}
 {
+    check_shard_config();
     initialize(stream, block_size, root, subset_fraction);
 }
 
@@ -104,8 +243,7 @@ void manifest_file::initialize(std::istream&      stream,
                                float              subset_fraction)
 {
     // parse istream is and load the entire thing into m_record_list
-    size_t                 element_count = 0;
-    size_t                 line_number   = 0;
+    size_t                 line_number = 0;
     string                 line;
     vector<vector<string>> record_list;
 
@@ -118,45 +256,13 @@ void manifest_file::initialize(std::istream&      stream,
         }
         else if (line[0] == m_metadata_char)
         {
-            // trim off the metadata char at the beginning of the line
-            line = line.substr(1);
             if (m_element_types.empty() == false)
             {
                 // Element types must be defined before any data
                 throw std::invalid_argument(errors::no_header);
             }
-            vector<string> element_list = split(line, m_delimiter_char);
-            for (const string& type : element_list)
-            {
-                if (type == get_file_type_id())
-                {
-                    m_element_types.push_back(element_t::FILE);
-                }
-                else if (type == get_binary_type_id())
-                {
-                    m_element_types.push_back(element_t::BINARY);
-                }
-                else if (type == get_string_type_id())
-                {
-                    m_element_types.push_back(element_t::STRING);
-                }
-                else if (type == get_ascii_int_type_id())
-                {
-                    m_element_types.push_back(element_t::ASCII_INT);
-                }
-                else if (type == get_ascii_float_type_id())
-                {
-                    m_element_types.push_back(element_t::ASCII_FLOAT);
-                }
-                else
-                {
-                    ostringstream ss;
-                    ss << "invalid metadata type '" << type;
-                    ss << "' at line " << line_number;
-                    throw std::invalid_argument(ss.str());
-                }
-            }
-            element_count = m_element_types.size();
+            // trim off the metadata char at the beginning of the line
+            parse_element_types(line.substr(1), line_number);
         }
         else if (line[0] == m_comment_char)
         {
@@ -164,29 +270,220 @@ void manifest_file::initialize(std::istream&      stream,
         }
         else
         {
-            vector<string> element_list = split(line, m_delimiter_char);
-            if (m_element_types.empty())
-            {
-                throw std::invalid_argument(errors::no_header);
-            }
+            parse_record(line.data(), line.data() + line.size(), line_number, record_list);
+        }
+        line_number++;
+    }
+
+    prepare_records(record_list, root, subset_fraction);
+    pack_records(record_list);
+    vector<record>().swap(record_list);
+    create_blocks(block_size);
+}
 
-            if (element_list.size() != element_count)
+vector<manifest_file::record> manifest_file::parse(const char* data, size_t size)
+{
+    const char* end         = data + size;
+    const char* p           = data;
+    size_t      line_number = 0;
+
+    // Element types must be defined before any data so everything up to the first
+    // record is parsed serially
+    while (p < end)
+    {
+        const char* eol = static_cast<const char*>(memchr(p, '\n', end - p));
+        if (eol == nullptr)
+        {
+            eol = end;
+        }
+        if (eol == p || *p == m_comment_char)
+        {
+            // Skip comments and empty lines
+        }
+        else if (*p == m_metadata_char)
+        {
+            if (m_element_types.empty() == false)
             {
-                ostringstream ss;
-                ss << "at line: " << line_number;
-                ss << ", manifest file has a line with differing number of elements (";
-                ss << element_list.size() << ") vs (" << element_count << "): ";
-
-                std::copy(element_list.begin(),
-                          element_list.end(),
-                          ostream_iterator<std::string>(ss, " "));
-                throw std::runtime_error(ss.str());
+                throw std::invalid_argument(errors::no_header);
             }
-            record_list.push_back(element_list);
+            parse_element_types(string(p + 1, eol), line_number);
+        }
+        else
+        {
+            break;
         }
+        p = (eol < end) ? eol + 1 : end;
         line_number++;
     }
 
+    // split the remainder into chunks which end on a line boundary
+    size_t remainder   = end - p;
+    size_t chunk_count = std::min<size_t>(std::thread::hardware_concurrency(),
+                                          remainder / m_min_chunk_size);
+    chunk_count = std::max<size_t>(chunk_count, 1);
+
+    vector<const char*> bounds{p};
+    for (size_t i = 1; i < chunk_count; i++)
+    {
+        const char* boundary = std::max(p + remainder * i / chunk_count, bounds.back());
+        const char* eol = static_cast<const char*>(memchr(boundary, '\n', end - boundary));
+        bounds.push_back(eol == nullptr ? end : eol + 1);
+    }
+    bounds.push_back(end);
+
+    // line numbers are only needed for error messages but must match the serial parser
+    vector<size_t> first_line(chunk_count, line_number);
+    {
+        vector<future<size_t>> line_counts;
+        for (size_t i = 0; i + 1 < chunk_count; i++)
+        {
+            line_counts.push_back(async(launch::async, [&bounds, i]() {
+                return static_cast<size_t>(std::count(bounds[i], bounds[i + 1], '\n'));
+            }));
+        }
+        for (size_t i = 0; i < line_counts.size(); i++)
+        {
+            first_line[i + 1] = first_line[i] + line_counts[i].get();
+        }
+    }
+
+    vector<future<vector<record>>> chunks;
+    for (size_t i = 0; i < chunk_count; i++)
+    {
+        chunks.push_back(async(launch::async,
+                               &manifest_file::parse_chunk,
+                               this,
+                               bounds[i],
+                               bounds[i + 1],
+                               first_line[i]));
+    }
+
+    // merge in chunk order so the first error and the record order match the serial parser
+    vector<vector<record>> parsed;
+    size_t                 total = 0;
+    for (future<vector<record>>& chunk : chunks)
+    {
+        parsed.push_back(chunk.get());
+        total += parsed.back().size();
+    }
+
+    vector<record> record_list;
+    record_list.reserve(total);
+    for (vector<record>& chunk : parsed)
+    {
+        std::move(chunk.begin(), chunk.end(), back_inserter(record_list));
+        vector<record>().swap(chunk);
+    }
+
+    return record_list;
+}
+
+void manifest_file::parse_element_types(const string& line, size_t line_number)
+{
+    vector<string> element_list = split(line, m_delimiter_char);
+    for (const string& type : element_list)
+    {
+        if (type == get_file_type_id())
+        {
+            m_element_types.push_back(element_t::FILE);
+        }
+        else if (type == get_binary_type_id())
+        {
+            m_element_types.push_back(element_t::BINARY);
+        }
+        else if (type == get_string_type_id())
+        {
+            m_element_types.push_back(element_t::STRING);
+        }
+        else if (type == get_ascii_int_type_id())
+        {
+            m_element_types.push_back(element_t::ASCII_INT);
+        }
+        else if (type == get_ascii_float_type_id())
+        {
+            m_element_types.push_back(element_t::ASCII_FLOAT);
+        }
+        else
+        {
+            ostringstream ss;
+            ss << "invalid metadata type '" << type;
+            ss << "' at line " << line_number;
+            throw std::invalid_argument(ss.str());
+        }
+    }
+}
+
+void manifest_file::parse_record(const char*     begin,
+                                 const char*     end,
+                                 size_t          line_number,
+                                 vector<record>& record_list) const
+{
+    record element_list;
+    element_list.reserve(m_element_types.size());
+    for (const char* p = begin;;)
+    {
+        const char* delimiter = static_cast<const char*>(memchr(p, m_delimiter_char, end - p));
+        if (delimiter == nullptr)
+        {
+            element_list.emplace_back(p, end);
+            break;
+        }
+        element_list.emplace_back(p, delimiter);
+        p = delimiter + 1;
+    }
+
+    if (m_element_types.empty())
+    {
+        throw std::invalid_argument(errors::no_header);
+    }
+
+    if (element_list.size() != m_element_types.size())
+    {
+        ostringstream ss;
+        ss << "at line: " << line_number;
+        ss << ", manifest file has a line with differing number of elements (";
+        ss << element_list.size() << ") vs (" << m_element_types.size() << "): ";
+
+        std::copy(
+            element_list.begin(), element_list.end(), ostream_iterator<std::string>(ss, " "));
+        throw std::runtime_error(ss.str());
+    }
+    record_list.push_back(std::move(element_list));
+}
+
+vector<manifest_file::record>
+    manifest_file::parse_chunk(const char* begin, const char* end, size_t line_number) const
+{
+    vector<record> record_list;
+    for (const char* p = begin; p < end; line_number++)
+    {
+        const char* eol = static_cast<const char*>(memchr(p, '\n', end - p));
+        if (eol == nullptr)
+        {
+            eol = end;
+        }
+        if (eol == p || *p == m_comment_char)
+        {
+            // Skip comments and empty lines
+        }
+        else if (*p == m_metadata_char)
+        {
+            // Element types must be defined before any data
+            throw std::invalid_argument(errors::no_header);
+        }
+        else
+        {
+            parse_record(p, eol, line_number, record_list);
+        }
+        p = (eol < end) ? eol + 1 : end;
+    }
+    return record_list;
+}
+
+void manifest_file::prepare_records(vector<record>& record_list,
+                                    const string&   root,
+                                    float           subset_fraction)
+{
     affirm(subset_fraction > 0.0 && subset_fraction <= 1.0,
            "subset_fraction must be >= 0 and <= 1");
     generate_subset(record_list, subset_fraction);
@@ -205,8 +502,7 @@ void manifest_file::initialize(std::istream&      stream,
     }
     m_crc_engine.TruncatedFinal((uint8_t*)&m_computed_crc, sizeof(m_computed_crc));
 
-    if (m_shuffle)
-        std::shuffle(record_list.begin(), record_list.end(), m_random);
+    convert_scalars(record_list);
 
     if (!root.empty())
     {
@@ -222,22 +518,162 @@ void manifest_file::initialize(std::istream&      stream,
             }
         }
     }
+}
 
-    // now that we have a list of all records, create blocks
-    std::vector<block_info> block_list = generate_block_list(m_record_count, block_size);
-    for (auto info : block_list)
+void manifest_file::convert_scalars(vector<record>& record_list) const
+{
+    for (size_t i = 0; i < m_element_types.size(); i++)
     {
-        vector<vector<string>> block;
-        for (int i = info.start(); i < info.end(); i++)
+        element_t type = m_element_types[i];
+        if (type != element_t::ASCII_INT && type != element_t::ASCII_FLOAT)
+        {
+            continue;
+        }
+
+        for (record& r : record_list)
         {
-            block.push_back(record_list[i]);
+            string& element = r[i];
+            int32_t int_value;
+            float   float_value;
+            if (type == element_t::ASCII_INT && parse_int32(element, int_value))
+            {
+                element.assign((const char*)&int_value, sizeof(int_value));
+            }
+            else if (type == element_t::ASCII_FLOAT && parse_float(element, float_value))
+            {
+                element.assign((const char*)&float_value, sizeof(float_value));
+            }
+            else
+            {
+                ostringstream ss;
+                ss << "invalid "
+                   << (type == element_t::ASCII_INT ? get_ascii_int_type_id()
+                                                    : get_ascii_float_type_id());
+                ss << " value '" << element << "' in manifest";
+                throw std::invalid_argument(ss.str());
+            }
         }
-        m_block_list.push_back(block);
     }
+}
 
-    m_block_load_sequence.reserve(m_block_list.size());
-    m_block_load_sequence.resize(m_block_list.size());
-    iota(m_block_load_sequence.begin(), m_block_load_sequence.end(), 0);
+void manifest_file::pack_records(const vector<record>& record_list)
+{
+    size_t data_size = 0;
+    for (const record& r : record_list)
+    {
+        for (const string& element : r)
+        {
+            data_size += element.size();
+        }
+    }
+
+    m_packed_data.clear();
+    m_packed_data.reserve(data_size);
+    m_packed_offsets.clear();
+    m_packed_offsets.reserve(record_list.size() * m_element_types.size() + 1);
+    m_packed_offsets.push_back(0);
+    for (const record& r : record_list)
+    {
+        for (const string& element : r)
+        {
+            m_packed_data.insert(m_packed_data.end(), element.begin(), element.end());
+            m_packed_offsets.push_back(m_packed_data.size());
+        }
+    }
+
+    m_index.reset();
+    m_element_data    = m_packed_data.data();
+    m_element_offsets = m_packed_offsets.data();
+}
+
+void manifest_file::create_blocks(size_t block_size)
+{
+    m_block_size = block_size;
+
+    vector<size_t> record_list(m_record_count);
+    iota(record_list.begin(), record_list.end(), 0);
+    if (m_shuffle)
+        std::shuffle(record_list.begin(), record_list.end(), m_random);
+
+    if (m_shard_count > 1)
+    {
+        // shards hold different records so they must not share a cache
+        uint64_t         shard[] = {m_shard_count, m_shard_index};
+        CryptoPP::CRC32C crc;
+        crc.Update((const uint8_t*)&m_computed_crc, sizeof(m_computed_crc));
+        crc.Update((const uint8_t*)shard, sizeof(shard));
+        crc.TruncatedFinal((uint8_t*)&m_computed_crc, sizeof(m_computed_crc));
+
+        if (m_shard_reshuffle)
+        {
+            m_shard_source.swap(record_list);
+            select_shard();
+            save_sequence_state(0);
+            return;
+        }
+
+        auto range = shard_range(record_list.size(), m_shard_count, m_shard_index);
+        record_list.erase(record_list.begin() + range.second, record_list.end());
+        record_list.erase(record_list.begin(), record_list.begin() + range.first);
+    }
+
+    build_blocks(record_list);
+    save_sequence_state(0);
+}
+
+void manifest_file::build_blocks(const vector<size_t>& record_list)
+{
+    m_record_count = record_list.size();
+    m_block_list.clear();
+
+    // now that we have a list of all records, create blocks
+    std::vector<block_info> block_list = generate_block_list(m_record_count, m_block_size);
+    for (auto info : block_list)
+    {
+        manifest_block block;
+        block.m_manifest = this;
+        block.m_records.assign(record_list.begin() + info.start(),
+                               record_list.begin() + info.end());
+        m_block_list.push_back(std::move(block));
+    }
+
+    // shard sizes are fixed so the load sequence survives a reshuffle
+    if (m_block_load_sequence.size() != m_block_list.size())
+    {
+        m_block_load_sequence.resize(m_block_list.size());
+        iota(m_block_load_sequence.begin(), m_block_load_sequence.end(), 0);
+    }
+}
+
+void manifest_file::select_shard()
+{
+    // every shard derives the same permutation from the shared seed and the epoch
+    vector<size_t> permutation(m_shard_source.size());
+    iota(permutation.begin(), permutation.end(), 0);
+    std::minstd_rand0 random(m_seed + m_epoch);
+    std::shuffle(permutation.begin(), permutation.end(), random);
+
+    auto           range = shard_range(permutation.size(), m_shard_count, m_shard_index);
+    vector<size_t> record_list;
+    record_list.reserve(range.second - range.first);
+    for (size_t i = range.first; i < range.second; i++)
+    {
+        record_list.push_back(m_shard_source[permutation[i]]);
+    }
+    build_blocks(record_list);
+}
+
+void manifest_file::check_shard_config() const
+{
+    if (m_shard_count == 0 || m_shard_index >= m_shard_count)
+    {
+        throw std::invalid_argument("shard_index must be less than shard_count");
+    }
+    if (m_shard_count > 1 && (m_shuffle || m_shard_reshuffle) && m_seed == 0)
+    {
+        throw std::invalid_argument(
+            "shuffling a sharded manifest requires a nonzero random_seed shared by all shards");
+    }
 }
 
 const std::vector<manifest_file::element_t>& manifest_file::get_element_types() const
@@ -247,23 +683,275 @@ const std::vector<manifest_file::element_t>& manifest_file::get_element_types()
 
 vector<vector<string>>* manifest_file::next()
 {
-    vector<vector<string>>* rc = nullptr;
+    manifest_block* block = next_block();
+    if (block == nullptr)
+    {
+        return nullptr;
+    }
+    m_string_block.resize(block->size());
+    for (size_t i = 0; i < block->size(); i++)
+    {
+        m_string_block[i] = (*block)[i];
+    }
+    return &m_string_block;
+}
+
+manifest_block* manifest_file::next_block()
+{
+    manifest_block* rc = nullptr;
     if (m_counter < m_block_list.size())
     {
         auto load_index = m_block_load_sequence[m_counter];
         rc              = &(m_block_list[load_index]);
         m_counter++;
+
+        // a restored state may start part way into its first block
+        if (m_block_offset > 0)
+        {
+            m_partial_block.m_manifest = this;
+            m_partial_block.m_records.assign(rc->m_records.begin() + m_block_offset,
+                                             rc->m_records.end());
+            m_block_offset = 0;
+            rc             = &m_partial_block;
+        }
     }
     return rc;
 }
 
 void manifest_file::reset()
 {
+    if (m_shard_reshuffle && m_shard_count > 1)
+    {
+        m_epoch++;
+        select_shard();
+    }
     if (m_shuffle)
     {
         shuffle(m_block_load_sequence.begin(), m_block_load_sequence.end(), m_random);
     }
-    m_counter = 0;
+    m_counter      = 0;
+    m_block_offset = 0;
+    save_sequence_state(m_sequence_number + 1);
+}
+
+void manifest_file::save_sequence_state(size_t sequence_number)
+{
+    stringstream random;
+    random << m_random;
+
+    nlohmann::json state = {{"block_load_sequence", m_block_load_sequence},
+                            {"random", random.str()},
+                            {"shard_epoch", m_epoch}};
+
+    lock_guard<mutex> lock(m_state_mutex);
+    m_sequence_number                  = sequence_number;
+    m_sequence_states[sequence_number] = std::move(state);
+}
+
+size_t manifest_file::sequence_number() const
+{
+    lock_guard<mutex> lock(m_state_mutex);
+    return m_sequence_number;
+}
+
+nlohmann::json manifest_file::get_state(size_t sequence_number, size_t record_offset) const
+{
+    nlohmann::json state;
+    {
+        lock_guard<mutex> lock(m_state_mutex);
+        auto              it = m_sequence_states.find(sequence_number);
+        if (it == m_sequence_states.end())
+        {
+            throw runtime_error("manifest state for sequence " +
+                                std::to_string(sequence_number) + " is no longer available");
+        }
+        state = it->second;
+    }
+
+    // block sizes do not change between sequences, only their order does
+    vector<size_t>     sequence = state["block_load_sequence"];
+    vector<block_info> blocks   = generate_block_list(m_record_count, m_block_size);
+    size_t             index    = 0;
+    while (index < sequence.size() && record_offset >= blocks[sequence[index]].count())
+    {
+        record_offset -= blocks[sequence[index]].count();
+        index++;
+    }
+    if (index == sequence.size())
+    {
+        throw invalid_argument("record offset is beyond the end of the manifest");
+    }
+
+    state["block_index"]  = index;
+    state["block_offset"] = record_offset;
+    return state;
+}
+
+void manifest_file::set_state(const nlohmann::json& state, size_t sequence_number)
+{
+    vector<size_t> sequence    = state.at("block_load_sequence");
+    size_t         shard_epoch = state.at("shard_epoch");
+    if (sequence.size() != m_block_list.size())
+    {
+        throw invalid_argument("manifest state does not match the manifest");
+    }
+
+    stringstream random(state.at("random").get<string>());
+    random >> m_random;
+    if (m_shard_reshuffle && m_shard_count > 1 && shard_epoch != m_epoch)
+    {
+        m_epoch = shard_epoch;
+        select_shard();
+    }
+    m_block_load_sequence = sequence;
+    m_counter             = state.at("block_index");
+    m_block_offset        = state.at("block_offset");
+
+    {
+        lock_guard<mutex> lock(m_state_mutex);
+        m_sequence_states.clear();
+    }
+    save_sequence_state(sequence_number);
+}
+
+void manifest_file::release_states(size_t sequence_number)
+{
+    lock_guard<mutex> lock(m_state_mutex);
+    m_sequence_states.erase(m_sequence_states.begin(),
+                            m_sequence_states.lower_bound(sequence_number));
+}
+
+bool manifest_file::load_index(const string& root, float subset_fraction)
+{
+    string       index_filename = get_index_filename();
+    index_header expected;
+    if (!file_util::exists(index_filename) || !get_manifest_stats(m_source_filename, expected))
+    {
+        return false;
+    }
+
+    shared_ptr<memory_mapped_file> index = make_shared<memory_mapped_file>(index_filename);
+    const char*                    p     = index->data();
+    const char*                    end   = p + index->size();
+    index_header                   header;
+    if (index->size() < sizeof(header))
+    {
+        return false;
+    }
+    memcpy(&header, p, sizeof(header));
+    p += sizeof(header);
+
+    if (memcmp(header.magic, index_magic, sizeof(index_magic)) != 0 ||
+        header.manifest_size != expected.manifest_size ||
+        header.manifest_mtime_sec != expected.manifest_mtime_sec ||
+        header.manifest_mtime_nsec != expected.manifest_mtime_nsec ||
+        header.subset_fraction != subset_fraction ||
+        header.source_size != m_source_filename.size() || header.root_size != root.size())
+    {
+        return false;
+    }
+
+    // every count is checked against the bytes left in the file before it is used in
+    // arithmetic, so a damaged header cannot overflow the size computations below
+    size_t available = static_cast<size_t>(end - p);
+    if (header.element_count == 0 || header.element_count > available ||
+        header.record_count > available / header.element_count / sizeof(uint64_t))
+    {
+        return false;
+    }
+    size_t names_size   = header.source_size + header.root_size;
+    size_t types_size   = header.element_count + index_padding(header.element_count);
+    size_t offset_count = header.record_count * header.element_count + 1;
+    names_size += index_padding(names_size);
+    if (names_size > available || types_size > available - names_size ||
+        offset_count > (available - names_size - types_size) / sizeof(uint64_t) ||
+        m_source_filename.compare(0, string::npos, p, header.source_size) != 0 ||
+        root.compare(0, string::npos, p + header.source_size, header.root_size) != 0)
+    {
+        return false;
+    }
+    p += names_size;
+
+    vector<element_t> element_types;
+    for (size_t i = 0; i < header.element_count; i++)
+    {
+        if (static_cast<uint8_t>(p[i]) > static_cast<uint8_t>(element_t::ASCII_FLOAT))
+        {
+            return false;
+        }
+        element_types.push_back(static_cast<element_t>(p[i]));
+    }
+    p += types_size;
+
+    // the offsets and element data are used in place for as long as the manifest lives
+    const uint64_t* offsets = reinterpret_cast<const uint64_t*>(p);
+    p += offset_count * sizeof(uint64_t);
+    if (offsets[0] != 0 || offsets[offset_count - 1] > static_cast<uint64_t>(end - p) ||
+        !std::is_sorted(offsets, offsets + offset_count))
+    {
+        return false;
+    }
+
+    m_element_types   = element_types;
+    m_record_count    = header.record_count;
+    m_computed_crc    = header.crc;
+    m_element_data    = p;
+    m_element_offsets = offsets;
+    m_index           = index;
+    m_packed_data.clear();
+    m_packed_offsets.clear();
+    return true;
+}
+
+void manifest_file::save_index(const string& root, float subset_fraction) const
+{
+    string       index_filename = get_index_filename();
+    string       tmp_filename   = index_filename + "." + std::to_string(getpid());
+    index_header header;
+    if (!get_manifest_stats(m_source_filename, header))
+    {
+        return;
+    }
+    // called before the records are split into blocks so m_record_count covers the table
+    memcpy(header.magic, index_magic, sizeof(index_magic));
+    header.record_count    = m_record_count;
+    header.element_count   = m_element_types.size();
+    header.source_size     = m_source_filename.size();
+    header.root_size       = root.size();
+    header.subset_fraction = subset_fraction;
+    header.crc             = m_computed_crc;
+
+    {
+        size_t        offset_count = header.record_count * header.element_count + 1;
+        const uint8_t padding[8]   = {};
+        ofstream      out(tmp_filename, ios::binary);
+        out.write((const char*)&header, sizeof(header));
+        out.write(m_source_filename.data(), m_source_filename.size());
+        out.write(root.data(), root.size());
+        out.write((const char*)padding, index_padding(m_source_filename.size() + root.size()));
+        for (element_t type : m_element_types)
+        {
+            out.put(static_cast<char>(type));
+        }
+        out.write((const char*)padding, index_padding(m_element_types.size()));
+        out.write((const char*)m_element_offsets, offset_count * sizeof(uint64_t));
+        out.write(m_element_data, m_element_offsets[offset_count - 1]);
+
+        out.close();
+        if (out.fail())
+        {
+            WARN << "unable to write manifest index " << index_filename;
+            file_util::remove_file(tmp_filename);
+            return;
+        }
+    }
+
+    // rename so that a concurrent reader never sees a partially written index
+    if (rename(tmp_filename.c_str(), index_filename.c_str()) != 0)
+    {
+        WARN << "unable to write manifest index " << index_filename;
+        file_util::remove_file(tmp_filename);
+    }
 }
 
 void manifest_file::generate_subset(vector<vector<string>>& record_list, float subset_fraction)
@@ -296,13 +984,20 @@ uint32_t manifest_file::get_crc()
     return m_computed_crc;
 }
 
-const std::vector<std::string>& manifest_file::operator[](size_t offset) const
+const vector<string>& manifest_file::operator[](size_t offset) const
 {
-    for (const vector<record>& block : m_block_list)
+    for (const manifest_block& block : m_block_list)
     {
         if (offset < block.size())
         {
-            return block[offset];
+            lock_guard<mutex> lock(m_string_mutex);
+            size_t            record_number = block.m_records[offset];
+            auto              it            = m_string_records.find(record_number);
+            if (it == m_string_records.end())
+            {
+                it = m_string_records.emplace(record_number, block[offset]).first;
+            }
+            return it->second;
         }
         else
         {
@@ -311,3 +1006,44 @@ const std::vector<std::string>& manifest_file::operator[](size_t offset) const
     }
     throw out_of_range("record not found in manifest");
 }
+
+const char* manifest_block::data(size_t index, size_t element) const
+{
+    return m_manifest->element_data(m_records[index], element);
+}
+
+size_t manifest_block::element_size(size_t index, size_t element) const
+{
+    return m_manifest->element_size(m_records[index], element);
+}
+
+string manifest_block::element(size_t index, size_t element) const
+{
+    return string(data(index, element), element_size(index, element));
+}
+
+vector<string> manifest_block::operator[](size_t index) const
+{
+    vector<string> rc;
+    for (size_t i = 0; i < m_manifest->elements_per_record(); i++)
+    {
+        rc.push_back(element(index, i));
+    }
+    return rc;
+}
+
+bool manifest_block::operator==(const manifest_block& other) const
+{
+    if (size() != other.size())
+    {
+        return false;
+    }
+    for (size_t i = 0; i < size(); i++)
+    {
+        if ((*this)[i] != other[i])
+        {
+            return false;
+        }
+    }
+    return true;
+}
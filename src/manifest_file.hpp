@@ -19,8 +19,12 @@
 #include <vector>
 #include <string>
 #include <random>
+#include <map>
+#include <memory>
+#include <mutex>
 
 #include "manifest.hpp"
+#include "json.hpp"
 #include "async_manager.hpp"
 #include "crc.hpp"
 
@@ -38,30 +42,89 @@
  * that it will be better to use the filename and last modified time as
  * a key instead.
  *
+ * Records are kept in one packed table of element data and offsets rather than
+ * as strings, and next() returns blocks of record numbers into that table.
+ *
+ * When use_index is set the parsed manifest is stored in a binary index next
+ * to the manifest file. The index is keyed on the manifest path, size and
+ * modification time as well as manifest_root and subset_fraction and is used
+ * in place of parsing the manifest on later runs. An index that is loaded stays
+ * mapped and serves as the record table, so elements are read from it in place.
+ *
+ * With shard_count > 1 only the shard_index'th of shard_count balanced slices
+ * of the records is kept. All ranks must use the same seed so that they slice
+ * the same permutation. With shard_reshuffle the permutation is drawn again
+ * from seed and the epoch number on every reset(), so shard membership changes
+ * each epoch without any communication between ranks.
+ *
+ * ASCII_INT and ASCII_FLOAT elements are converted when the manifest is
+ * loaded, so records returned by next() hold their binary int32/float value
+ * rather than the text from the manifest. ASCII_INT accepts any decimal
+ * number, such as "1.0" or "1e3", and truncates it toward zero. A value that
+ * is out of range or is followed by anything other than white space is
+ * rejected. The 4 byte values live in the record table like any other
+ * element and block_loader_file refers to them in place.
+ *
  */
 namespace nervana
 {
     class manifest_file;
+    class manifest_block;
+    class memory_mapped_file;
 }
 
+/* manifest_block
+ *
+ * A block of records returned by manifest_file::next_block(). The block only holds
+ * record numbers, element data stays in the manifest's record table and is
+ * valid for the lifetime of the manifest. operator[] copies a record out as
+ * strings.
+ */
+class nervana::manifest_block
+{
+    friend class manifest_file;
+
+public:
+    size_t size() const { return m_records.size(); }
+    const char* data(size_t index, size_t element) const;
+    size_t element_size(size_t index, size_t element) const;
+    std::string element(size_t index, size_t element) const;
+    std::vector<std::string> operator[](size_t index) const;
+    bool operator==(const manifest_block& other) const;
+    bool operator!=(const manifest_block& other) const { return !(*this == other); }
+
+private:
+    const manifest_file* m_manifest{nullptr};
+    std::vector<size_t>  m_records;
+};
+
 class nervana::manifest_file
     : public nervana::async_manager_source<std::vector<std::vector<std::string>>>,
       public nervana::manifest
 {
+    friend class manifest_block;
+
 public:
     manifest_file(const std::string& filename,
                   bool               shuffle,
                   const std::string& root            = "",
                   float              subset_fraction = 1.0,
                   size_t             block_size      = 5000,
-                  uint32_t           seed            = 0);
+                  uint32_t           seed            = 0,
+                  bool               use_index       = false,
+                  size_t             shard_count     = 1,
+                  size_t             shard_index     = 0,
+                  bool               shard_reshuffle = false);
 
     manifest_file(std::istream&      stream,
                   bool               shuffle,
                   const std::string& root            = "",
                   float              subset_fraction = 1.0,
                   size_t             block_size      = 5000,
-                  uint32_t           seed            = 0);
+                  uint32_t           seed            = 0,
+                  size_t             shard_count     = 1,
+                  size_t             shard_index     = 0,
+                  bool               shard_reshuffle = false);
 
     virtual ~manifest_file() {}
     typedef std::vector<std::string> record;
@@ -69,13 +132,18 @@ public:
     std::string cache_id() override;
     std::string version() override;
 
+    // next() copies the records of the next block out as strings, the block is valid
+    // until the following call. next_block() returns the block without copying, its
+    // elements are read in place from the record table.
     std::vector<std::vector<std::string>>* next() override;
+    manifest_block*                        next_block();
     void                                   reset() override;
 
     size_t   block_count() const { return m_block_list.size(); }
     size_t   record_count() const override { return m_record_count; }
     size_t   elements_per_record() const override { return m_element_types.size(); }
     uint32_t get_crc();
+    std::string get_index_filename() const { return m_source_filename + ".index"; }
 
     static char                   get_delimiter() { return m_delimiter_char; }
     static char                   get_comment_char() { return m_comment_char; }
@@ -87,19 +155,63 @@ public:
     static const std::string&     get_ascii_float_type_id() { return m_ascii_float_type_id; }
     const std::vector<element_t>& get_element_types() const;
 
+    // the strings are copied out of the record table on first use and kept for the
+    // lifetime of the manifest
     const std::vector<std::string>& operator[](size_t offset) const;
 
+    // Each reset() draws a new block load sequence and takes a sequence number. The
+    // state at the start of every sequence is kept until released so that a reader
+    // can later be positioned at any record of that sequence.
+    size_t         sequence_number() const;
+    nlohmann::json get_state(size_t sequence_number, size_t record_offset) const;
+    void           set_state(const nlohmann::json& state, size_t sequence_number);
+    void           release_states(size_t sequence_number);
+
 protected:
     void initialize(std::istream&      stream,
                     size_t             block_size,
                     const std::string& root,
                     float              subset_fraction);
 
+    // parse an in-memory manifest, splitting the records into line-aligned chunks
+    // which are parsed concurrently
+    std::vector<record> parse(const char* data, size_t size);
+
 private:
+    void parse_element_types(const std::string& line, size_t line_number);
+    void parse_record(const char*          begin,
+                      const char*          end,
+                      size_t               line_number,
+                      std::vector<record>& record_list) const;
+    std::vector<record> parse_chunk(const char* begin, const char* end, size_t line_number) const;
+    void prepare_records(std::vector<record>& record_list,
+                         const std::string&   root,
+                         float                subset_fraction);
+    void convert_scalars(std::vector<record>& record_list) const;
+    void pack_records(const std::vector<record>& record_list);
+    void create_blocks(size_t block_size);
+    void build_blocks(const std::vector<size_t>& record_list);
+    void select_shard();
+    void check_shard_config() const;
+    void save_sequence_state(size_t sequence_number);
+    bool load_index(const std::string& root, float subset_fraction);
+    void save_index(const std::string& root, float subset_fraction) const;
     void generate_subset(std::vector<std::vector<std::string>>&, float subset_fraction);
 
+    const char* element_data(size_t record_number, size_t element) const
+    {
+        size_t index = record_number * m_element_types.size() + element;
+        return m_element_data + m_element_offsets[index];
+    }
+
+    size_t element_size(size_t record_number, size_t element) const
+    {
+        size_t index = record_number * m_element_types.size() + element;
+        return m_element_offsets[index + 1] - m_element_offsets[index];
+    }
+
     std::string                      m_source_filename;
-    std::vector<std::vector<record>> m_block_list;
+    std::vector<manifest_block>      m_block_list;
     CryptoPP::CRC32C                 m_crc_engine;
     uint32_t                         m_computed_crc;
     size_t                           m_counter{0};
@@ -111,9 +223,33 @@ private:
     std::vector<size_t>              m_block_load_sequence;
     bool                             m_shuffle;
     std::minstd_rand0                m_random;
+    uint32_t                         m_seed;
+    size_t                           m_block_size{0};
+    size_t                           m_shard_count;
+    size_t                           m_shard_index;
+    bool                             m_shard_reshuffle;
+    size_t                           m_epoch{0};
+    std::vector<size_t>              m_shard_source;
+    size_t                           m_sequence_number{0};
+    std::map<size_t, nlohmann::json> m_sequence_states;
+    mutable std::mutex               m_state_mutex;
+    size_t                           m_block_offset{0};
+    manifest_block                   m_partial_block;
+    std::vector<record>              m_string_block;
+    mutable std::map<size_t, record> m_string_records;
+    mutable std::mutex               m_string_mutex;
+
+    // record table, element e of record r starts at
+    // m_element_data + m_element_offsets[r * element count + e]
+    const char*                         m_element_data{nullptr};
+    const uint64_t*                     m_element_offsets{nullptr};
+    std::vector<char>                   m_packed_data;
+    std::vector<uint64_t>               m_packed_offsets;
+    std::shared_ptr<memory_mapped_file> m_index;
     static const std::string         m_file_type_id;
     static const std::string         m_binary_type_id;
     static const std::string         m_string_type_id;
     static const std::string         m_ascii_int_type_id;
     static const std::string         m_ascii_float_type_id;
+    static const size_t              m_min_chunk_size = 1 << 20;
 };
@@ -15,8 +15,10 @@
 *******************************************************************************/
 
 #include <fstream>
+#include <iomanip>
 #include <numeric>
 #include <sstream>
+#include <unistd.h>
 
 #include <curl/curl.h>
 #include <curl/easy.h>
@@ -25,6 +27,8 @@
 #include "manifest_nds.hpp"
 #include "interface.hpp"
 #include "cpio.hpp"
+#include "file_util.hpp"
+#include "log.hpp"
 
 using namespace std;
 using namespace nervana;
@@ -45,32 +49,59 @@ network_client::network_client(const std::string& baseurl,
     curl_global_init(CURL_GLOBAL_ALL);
 }
 
+network_client::network_client(const network_client& other)
+    : m_baseurl(other.m_baseurl)
+    , m_token(other.m_token)
+    , m_collection_id(other.m_collection_id)
+    , m_shard_count(other.m_shard_count)
+    , m_shard_index(other.m_shard_index)
+    , m_macrobatch_size(other.m_macrobatch_size)
+{
+    // the curl handle is not shared, the copy opens its own on first use
+    curl_global_init(CURL_GLOBAL_ALL);
+}
+
 network_client::~network_client()
 {
+    if (m_curl)
+    {
+        curl_easy_cleanup(m_curl);
+    }
     curl_global_cleanup();
 }
 
 size_t network_client::callback(void* ptr, size_t size, size_t nmemb, void* stream)
 {
-    stringstream& ss = *(stringstream*)stream;
+    ostream& os = *(ostream*)stream;
     // callback used by curl.  writes data from ptr into the
-    // stringstream passed in to `stream`.
-    ss.write((const char*)ptr, size * nmemb);
-    return size * nmemb;
+    // stream passed in to `stream`.  returning a short count aborts
+    // the transfer when the stream fails, e.g. a full disk
+    os.write((const char*)ptr, size * nmemb);
+    return os ? size * nmemb : 0;
 }
 
-void network_client::get(const string& url, stringstream& stream)
+void network_client::get(const string& url, ostream& stream)
 {
-    // reuse curl connection across requests
-    void* m_curl = curl_easy_init();
+    // reuse curl connection across requests.  curl keeps the connection to the
+    // server open in the handle's cache, so consecutive requests skip the TCP
+    // (and TLS) handshake when the server allows keep-alive
+    if (!m_curl)
+    {
+        m_curl = curl_easy_init();
+        if (!m_curl)
+        {
+            throw std::runtime_error("curl_easy_init failed");
+        }
+        curl_easy_setopt(m_curl, CURLOPT_WRITEFUNCTION, callback);
+        curl_easy_setopt(m_curl, CURLOPT_NOPROXY, "127.0.0.1,localhost");
+        curl_easy_setopt(m_curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    }
 
     // given a url, make an HTTP GET request and fill stream with
     // the body of the response
 
     curl_easy_setopt(m_curl, CURLOPT_URL, url.c_str());
-    curl_easy_setopt(m_curl, CURLOPT_WRITEFUNCTION, callback);
     curl_easy_setopt(m_curl, CURLOPT_WRITEDATA, &stream);
-    curl_easy_setopt(m_curl, CURLOPT_NOPROXY, "127.0.0.1,localhost");
 
     // Perform the request, res will get the return code
     CURLcode res = curl_easy_perform(m_curl);
@@ -88,11 +119,8 @@ void network_client::get(const string& url, stringstream& stream)
             ss << " curl return: " << curl_easy_strerror(res);
         }
 
-        curl_easy_cleanup(m_curl);
         throw std::runtime_error(ss.str());
     }
-
-    curl_easy_cleanup(m_curl);
 }
 
 string network_client::load_block_url(size_t block_num)
@@ -180,6 +208,18 @@ manifest_nds_builder& manifest_nds_builder::seed(uint32_t seed)
     return *this;
 }
 
+manifest_nds_builder& manifest_nds_builder::prefetch_count(size_t prefetch_count)
+{
+    m_prefetch_count = prefetch_count;
+    return *this;
+}
+
+manifest_nds_builder& manifest_nds_builder::spill_directory(const std::string& spill_directory)
+{
+    m_spill_directory = spill_directory;
+    return *this;
+}
+
 void manifest_nds_builder::parse_json(const std::string& filename)
 {
     // parse json
@@ -243,6 +283,10 @@ manifest_nds manifest_nds_builder::create()
     {
         throw invalid_argument("elements_per_record is required");
     }
+    if (m_prefetch_count == 0)
+    {
+        throw invalid_argument("prefetch_count must be greater than 0");
+    }
 
     return manifest_nds(m_base_url,
                         m_token,
@@ -252,11 +296,17 @@ manifest_nds manifest_nds_builder::create()
                         m_shard_count,
                         m_shard_index,
                         m_shuffle,
-                        m_seed);
+                        m_seed,
+                        m_prefetch_count,
+                        m_spill_directory);
 }
 
 std::shared_ptr<manifest_nds> manifest_nds_builder::make_shared()
 {
+    if (m_prefetch_count == 0)
+    {
+        throw invalid_argument("prefetch_count must be greater than 0");
+    }
     return std::shared_ptr<manifest_nds>(new manifest_nds(m_base_url,
                                                           m_token,
                                                           m_collection_id,
@@ -265,7 +315,9 @@ std::shared_ptr<manifest_nds> manifest_nds_builder::make_shared()
                                                           m_shard_count,
                                                           m_shard_index,
                                                           m_shuffle,
-                                                          m_seed));
+                                                          m_seed,
+                                                          m_prefetch_count,
+                                                          m_spill_directory));
 }
 
 manifest_nds::manifest_nds(const std::string& base_url,
@@ -276,7 +328,9 @@ manifest_nds::manifest_nds(const std::string& base_url,
                            size_t             shard_count,
                            size_t             shard_index,
                            bool               enable_shuffle,
-                           uint32_t           seed)
+                           uint32_t           seed,
+                           size_t             prefetch_count,
+                           const std::string& spill_directory)
     : m_base_url(base_url)
     , m_token(token)
     , m_collection_id(collection_id)
@@ -285,9 +339,25 @@ manifest_nds::manifest_nds(const std::string& base_url,
     , m_current_block_number{0}
     , m_shuffle{enable_shuffle}
     , m_rnd{seed ? seed : random_device{}()}
+    , m_prefetch_count{prefetch_count}
+    , m_prefetch_block_number{0}
 {
     load_metadata();
 
+    if (!spill_directory.empty())
+    {
+        open_spill(spill_directory, block_size, shard_count, shard_index);
+    }
+
+    if (m_prefetch_count > 1)
+    {
+        m_prefetch_clients.reserve(m_prefetch_count);
+        for (size_t i = 0; i < m_prefetch_count; i++)
+        {
+            m_prefetch_clients.push_back(m_network_client);
+        }
+    }
+
     m_block_load_sequence.reserve(m_block_count);
     m_block_load_sequence.resize(m_block_count);
     iota(m_block_load_sequence.begin(), m_block_load_sequence.end(), 0);
@@ -338,31 +408,188 @@ manifest_nds::manifest_nds(const std::string& base_url,
     // }
 }
 
+manifest_nds::manifest_nds(const manifest_nds& other)
+    : m_base_url(other.m_base_url)
+    , m_token(other.m_token)
+    , m_collection_id(other.m_collection_id)
+    , m_elements_per_record(other.m_elements_per_record)
+    , m_record_count(other.m_record_count)
+    , m_block_count(other.m_block_count)
+    , m_network_client(other.m_network_client)
+    , m_current_block_number(other.m_current_block_number)
+    , m_block_load_sequence(other.m_block_load_sequence)
+    , m_current_block(other.m_current_block)
+    , m_shuffle(other.m_shuffle)
+    , m_rnd(other.m_rnd)
+    , m_prefetch_count(other.m_prefetch_count)
+    , m_prefetch_block_number(other.m_current_block_number)
+    , m_prefetch_clients(other.m_prefetch_clients)
+    , m_spill_dir(other.m_spill_dir)
+{
+    // requests in flight belong to the source, the copy issues its own
+}
+
+manifest_nds::~manifest_nds()
+{
+    // outstanding requests reference this object's clients
+    drain_prefetch();
+}
+
 encoded_record_list* manifest_nds::next()
 {
     encoded_record_list* rc = nullptr;
 
     if (m_current_block_number < m_block_count)
     {
-        rc = load_block(m_block_load_sequence[m_current_block_number]);
+        if (m_prefetch_count > 1)
+        {
+            prefetch();
+            future<encoded_record_list> pending = move(m_prefetch_queue.front());
+            m_prefetch_queue.pop_front();
+            try
+            {
+                m_current_block = pending.get();
+            }
+            catch (...)
+            {
+                // the failed block has left the queue, so restart prefetching from it
+                // rather than skipping it on the next call
+                drain_prefetch();
+                throw;
+            }
+            rc = &m_current_block;
 
-        m_current_block_number++;
+            // keep the pipe full while the caller consumes this block
+            m_current_block_number++;
+            prefetch();
+        }
+        else
+        {
+            rc = load_block(m_block_load_sequence[m_current_block_number]);
+            m_current_block_number++;
+        }
     }
 
     return rc;
 }
 
+void manifest_nds::reset()
+{
+    drain_prefetch();
+    if (!m_spill_dir.empty())
+    {
+        // the object count is fetched again every epoch so that blocks spilled
+        // from a collection that has since changed are not served.  the pipeline
+        // keeps the counts it was sized with at construction
+        size_t record_count = m_record_count;
+        size_t block_count  = m_block_count;
+        load_metadata();
+        validate_spill();
+        m_record_count = record_count;
+        m_block_count  = block_count;
+    }
+    if (m_shuffle)
+    {
+        shuffle(m_block_load_sequence.begin(), m_block_load_sequence.end(), m_rnd);
+    }
+    m_current_block_number  = 0;
+    m_prefetch_block_number = 0;
+}
+
+void manifest_nds::prefetch()
+{
+    // issue requests in load sequence order so the queue front is always the
+    // next block to deliver
+    while (m_prefetch_queue.size() < m_prefetch_count && m_prefetch_block_number < m_block_count)
+    {
+        size_t          slot        = m_prefetch_block_number % m_prefetch_count;
+        network_client& client      = m_prefetch_clients[slot];
+        size_t          block_index = m_block_load_sequence[m_prefetch_block_number];
+        m_prefetch_queue.push_back(async(launch::async, [this, &client, block_index]() {
+            encoded_record_list block;
+            fetch_block(client, block_index, block);
+            return block;
+        }));
+        m_prefetch_block_number++;
+    }
+}
+
+void manifest_nds::drain_prefetch()
+{
+    for (auto& f : m_prefetch_queue)
+    {
+        f.wait();
+    }
+    m_prefetch_queue.clear();
+    m_prefetch_block_number = m_current_block_number;
+}
+
 encoded_record_list* manifest_nds::load_block(size_t block_index)
 {
-    // not much use in mutlithreading here since in most cases, our next step is
-    // to shuffle the entire BufferPair, which requires the entire buffer loaded.
     m_current_block.clear();
+    fetch_block(m_network_client, block_index, m_current_block);
+    return &m_current_block;
+}
+
+void manifest_nds::fetch_block(network_client&      client,
+                               size_t               block_index,
+                               encoded_record_list& block)
+{
+    string url = client.load_block_url(block_index);
+    if (m_spill_dir.empty())
+    {
+        // get data from url and write it into cpio_stream
+        stringstream stream;
+        client.get(url, stream);
+        read_block(stream, block);
+        return;
+    }
+
+    // the macrobatch is written straight to disk rather than buffered in memory.
+    // the partial file gets a per process name and is renamed once complete so
+    // that concurrent loaders sharing the directory never read a torn file
+    string path = spill_block_path(block_index);
+    if (!file_util::exists(path))
+    {
+        stringstream tmp;
+        tmp << path << "." << getpid() << ".tmp";
+        string tmp_path = tmp.str();
+        try
+        {
+            ofstream spill(tmp_path, ios::binary);
+            if (!spill)
+            {
+                throw runtime_error("unable to write nds spill file " + tmp_path);
+            }
+            client.get(url, spill);
+            spill.close();
+            if (!spill)
+            {
+                throw runtime_error("unable to write nds spill file " + tmp_path);
+            }
+        }
+        catch (...)
+        {
+            file_util::remove_file(tmp_path);
+            throw;
+        }
+        if (rename(tmp_path.c_str(), path.c_str()) != 0)
+        {
+            file_util::remove_file(tmp_path);
+            throw runtime_error("unable to rename nds spill file " + tmp_path);
+        }
+    }
 
-    // get data from url and write it into cpio_stream
-    stringstream stream;
-    string       url = m_network_client.load_block_url(block_index);
-    m_network_client.get(url, stream);
+    ifstream stream(path, ios::binary);
+    if (!stream)
+    {
+        throw runtime_error("unable to read nds spill file " + path);
+    }
+    read_block(stream, block);
+}
 
+void manifest_nds::read_block(istream& stream, encoded_record_list& block)
+{
     // parse cpio_stream into dest one record (consisting of multiple elements) at a time
     nervana::cpio::reader reader(stream);
     size_t                record_count = reader.record_count();
@@ -379,9 +606,111 @@ encoded_record_list* manifest_nds::load_block(size_t block_index)
             }
             record.add_element(buffer);
         }
-        m_current_block.add_record(record);
+        block.add_record(record);
     }
-    return &m_current_block;
+}
+
+void manifest_nds::open_spill(const std::string& spill_root,
+                              size_t             block_size,
+                              size_t             shard_count,
+                              size_t             shard_index)
+{
+    // one directory per collection view, since block contents depend on the
+    // macrobatch size and the shard
+    stringstream contents;
+    contents << m_base_url << " " << m_collection_id << " " << block_size << " " << shard_count
+             << " " << shard_index;
+    stringstream name;
+    name << "aeon_nds_" << hex << setw(16) << setfill('0')
+         << std::hash<std::string>()(contents.str());
+
+    if (!file_util::exists(spill_root))
+    {
+        file_util::make_directory(spill_root);
+    }
+    m_spill_dir = file_util::path_join(spill_root, name.str());
+    if (!file_util::exists(m_spill_dir))
+    {
+        file_util::make_directory(m_spill_dir);
+    }
+    validate_spill();
+}
+
+void manifest_nds::validate_spill()
+{
+    // spilled blocks are discarded when the object count differs from the one
+    // recorded when they were written. metadata that is missing or cannot be
+    // parsed does not prove the blocks stale, so it is only written again
+    string         metadata_path = file_util::path_join(m_spill_dir, "metadata.json");
+    nlohmann::json current       = {{"record_count", m_record_count},
+                              {"macro_batch_per_shard", m_block_count}};
+    nlohmann::json spilled;
+    if (file_util::exists(metadata_path))
+    {
+        try
+        {
+            spilled = nlohmann::json::parse(file_util::read_file_to_string(metadata_path));
+        }
+        catch (const std::exception&)
+        {
+        }
+    }
+
+    if (spilled.is_null())
+    {
+        write_spill_metadata(current.dump());
+    }
+    else if (spilled != current)
+    {
+        WARN << "nds collection " << m_collection_id << " changed since it was spilled, discarding "
+             << m_spill_dir;
+
+        // the directory is renamed away before it is removed so that a concurrent
+        // loader never reads blocks from a directory that is being emptied. if the
+        // rename fails another loader has already moved it
+        stringstream stale;
+        stale << m_spill_dir << "." << getpid() << ".stale";
+        if (rename(m_spill_dir.c_str(), stale.str().c_str()) == 0)
+        {
+            file_util::remove_directory(stale.str());
+        }
+        if (!file_util::exists(m_spill_dir))
+        {
+            file_util::make_directory(m_spill_dir);
+        }
+        write_spill_metadata(current.dump());
+    }
+}
+
+void manifest_nds::write_spill_metadata(const string& metadata) const
+{
+    // written to a per process file and renamed so that readers never see a torn file
+    string       metadata_path = file_util::path_join(m_spill_dir, "metadata.json");
+    stringstream tmp;
+    tmp << metadata_path << "." << getpid() << ".tmp";
+    string tmp_path = tmp.str();
+    {
+        ofstream f(tmp_path);
+        f << metadata;
+        f.close();
+        if (!f)
+        {
+            file_util::remove_file(tmp_path);
+            throw runtime_error("unable to write nds spill metadata " + tmp_path);
+        }
+    }
+    if (rename(tmp_path.c_str(), metadata_path.c_str()) != 0)
+    {
+        file_util::remove_file(tmp_path);
+        throw runtime_error("unable to rename nds spill metadata " + tmp_path);
+    }
+}
+
+string manifest_nds::spill_block_path(size_t block_index) const
+{
+    stringstream ss;
+    ss << "block_" << block_index << ".cpio";
+    return file_util::path_join(m_spill_dir, ss.str());
 }
 
 string manifest_nds::cache_id()
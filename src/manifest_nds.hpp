@@ -16,6 +16,8 @@
 
 #pragma once
 
+#include <deque>
+#include <future>
 #include <string>
 
 #include "manifest.hpp"
@@ -38,13 +40,13 @@ public:
                    size_t             block_size,
                    size_t             shard_count,
                    size_t             shard_index);
-    network_client(const network_client&) = default;
+    network_client(const network_client&);
 
     ~network_client();
 
     static size_t callback(void* ptr, size_t size, size_t nmemb, void* stream);
 
-    void get(const std::string& url, std::stringstream& stream);
+    void get(const std::string& url, std::ostream& stream);
 
     std::string load_block_url(size_t block_num);
 
@@ -57,6 +59,7 @@ private:
     const int         m_shard_count;
     const int         m_shard_index;
     uint32_t          m_macrobatch_size;
+    void*             m_curl = nullptr;
 };
 
 class nervana::manifest_nds_builder
@@ -72,6 +75,8 @@ public:
     manifest_nds_builder& shard_index(size_t shard_index);
     manifest_nds_builder& shuffle(bool enable);
     manifest_nds_builder& seed(uint32_t seed);
+    manifest_nds_builder& prefetch_count(size_t prefetch_count);
+    manifest_nds_builder& spill_directory(const std::string& spill_directory);
     manifest_nds                  create();
     std::shared_ptr<manifest_nds> make_shared();
 
@@ -87,6 +92,8 @@ private:
     size_t      m_shard_index         = 0;
     size_t      m_shuffle             = false;
     uint32_t    m_seed                = 0;
+    size_t      m_prefetch_count      = 1;
+    std::string m_spill_directory;
 };
 
 class nervana::manifest_nds : public nervana::async_manager_source<encoded_record_list>,
@@ -95,17 +102,10 @@ class nervana::manifest_nds : public nervana::async_manager_source<encoded_recor
     friend class manifest_nds_builder;
 
 public:
-    manifest_nds(const manifest_nds&) = default;
-    virtual ~manifest_nds() {}
+    manifest_nds(const manifest_nds&);
+    virtual ~manifest_nds();
     encoded_record_list* next() override;
-    void                 reset() override
-    {
-        if (m_shuffle)
-        {
-            shuffle(m_block_load_sequence.begin(), m_block_load_sequence.end(), m_rnd);
-        }
-        m_current_block_number = 0;
-    }
+    void                 reset() override;
 
     size_t               record_count() const override { return m_record_count; }
     size_t               elements_per_record() const override { return 2; }
@@ -119,7 +119,18 @@ public:
     static bool is_likely_json(const std::string filename);
 
 private:
-    void load_metadata();
+    void        load_metadata();
+    void        fetch_block(network_client& client, size_t block_index, encoded_record_list& block);
+    void        read_block(std::istream& stream, encoded_record_list& block);
+    void        prefetch();
+    void        drain_prefetch();
+    void        open_spill(const std::string& spill_root,
+                           size_t             block_size,
+                           size_t             shard_count,
+                           size_t             shard_index);
+    void        validate_spill();
+    void        write_spill_metadata(const std::string& metadata) const;
+    std::string spill_block_path(size_t block_index) const;
 
     const std::string   m_base_url;
     const std::string   m_token;
@@ -134,6 +145,17 @@ private:
     bool                m_shuffle;
     std::minstd_rand0   m_rnd;
 
+    // macrobatch requests kept in flight; fetch k uses client k % m_prefetch_count so
+    // no curl handle is ever shared between two outstanding requests
+    size_t                                       m_prefetch_count;
+    size_t                                       m_prefetch_block_number;
+    std::vector<network_client>                  m_prefetch_clients;
+    std::deque<std::future<encoded_record_list>> m_prefetch_queue;
+
+    // downloaded macrobatches are kept here as cpio files and served from disk
+    // in later epochs while the collection's object count is unchanged
+    std::string m_spill_dir;
+
     manifest_nds() = delete;
     manifest_nds(const std::string& base_url,
                  const std::string& token,
@@ -143,7 +165,9 @@ private:
                  size_t             shard_count,
                  size_t             shard_index,
                  bool               shuffle,
-                 uint32_t           seed = 0);
+                 uint32_t           seed            = 0,
+                 size_t             prefetch_count  = 1,
+                 const std::string& spill_directory = "");
 
     static size_t write_data(void* ptr, size_t size, size_t nmemb, void* stream);
 };
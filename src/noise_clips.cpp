@@ -16,7 +16,12 @@
 
 #include <sstream>
 #include <fstream>
+#include <map>
+#include <mutex>
+#include <tuple>
 #include <sys/stat.h>
+#include <unistd.h>
+#include <smmintrin.h>
 
 #include "noise_clips.hpp"
 #include "file_util.hpp"
@@ -24,12 +29,67 @@
 using namespace std;
 using namespace nervana;
 
-noise_clips::noise_clips(const std::string noiseIndexFile, const std::string noiseRoot)
+namespace
 {
+    // bank file:
+    //   bank_header
+    //   noise root, padded to 8 bytes
+    //   the sample count of each clip
+    //   the samples of all clips as host order int16, so they can be used where they are mapped
+    // The size and modification time of the index file it was made from tell when it is
+    // out of date.
+    const char bank_magic[8] = {'N', 'O', 'I', 'S', 'E', 'B', 'K', '2'};
+
+    struct bank_header
+    {
+        char     magic[8];
+        uint64_t index_size;
+        int64_t  index_mtime_sec;
+        int64_t  index_mtime_nsec;
+        uint64_t root_size;
+        uint64_t clip_count;
+    };
+
+    bool get_index_stats(const string& filename, bank_header& header)
+    {
+        struct stat stats;
+        if (stat(filename.c_str(), &stats) == -1)
+        {
+            return false;
+        }
+        header.index_size = stats.st_size;
+#ifdef __APPLE__
+        header.index_mtime_sec  = stats.st_mtimespec.tv_sec;
+        header.index_mtime_nsec = stats.st_mtimespec.tv_nsec;
+#else
+        header.index_mtime_sec  = stats.st_mtim.tv_sec;
+        header.index_mtime_nsec = stats.st_mtim.tv_nsec;
+#endif
+        return true;
+    }
+
+    size_t bank_padding(size_t size) { return (8 - size % 8) % 8; }
+}
+
+noise_clips::noise_clips(const std::string noiseIndexFile,
+                         const std::string noiseRoot,
+                         const std::string bankFile)
+    : _index_file{noiseIndexFile}
+    , _root_dir{noiseRoot}
+{
+    // a bank that is missing or was made from another index is made again
+    if (!bankFile.empty() && load_bank(bankFile))
+    {
+        return;
+    }
     if (!noiseIndexFile.empty())
     {
         load_index(noiseIndexFile, noiseRoot);
         load_data();
+        if (!bankFile.empty())
+        {
+            write_bank(bankFile);
+        }
     }
 }
 
@@ -41,6 +101,25 @@ noise_clips::~noise_clips()
     }
 }
 
+shared_ptr<noise_clips> noise_clips::get(const std::string& noiseIndexFile,
+                                         const std::string& noiseRoot,
+                                         const std::string& bankFile)
+{
+    typedef tuple<string, string, string>    key_t;
+    static map<key_t, weak_ptr<noise_clips>> clips;
+    static mutex                             clips_mutex;
+
+    lock_guard<mutex>       lock(clips_mutex);
+    key_t                   key(noiseIndexFile, noiseRoot, bankFile);
+    shared_ptr<noise_clips> instance = clips[key].lock();
+    if (!instance)
+    {
+        instance   = make_shared<noise_clips>(noiseIndexFile, noiseRoot, bankFile);
+        clips[key] = instance;
+    }
+    return instance;
+}
+
 void noise_clips::load_index(const std::string& index_file, const std::string& root_dir)
 {
     ifstream ifs(index_file);
@@ -73,7 +152,7 @@ void noise_clips::addNoise(cv::Mat& wav_mat,
                            bool     add_noise,
                            uint32_t noise_index,
                            float    noise_offset_fraction,
-                           float    noise_level)
+                           float    noise_level) const
 {
     // No-op if we have no noise files or randomly not adding noise on this datum
     if (!add_noise || _noise_data.empty())
@@ -84,49 +163,181 @@ void noise_clips::addNoise(cv::Mat& wav_mat,
     // Assume a single channel with 16 bit samples for now.
     affirm(wav_mat.cols == 1, "wav samples more than one column");
     affirm(wav_mat.type() == CV_16SC1, "wav not 16 bit signed");
+    affirm(wav_mat.isContinuous(), "wav samples not continuous");
 
-    // Collect enough noise data to cover the entire input clip.
-    cv::Mat        noise_dst = cv::Mat::zeros(wav_mat.size(), wav_mat.type());
     const cv::Mat& noise_src = _noise_data[noise_index % _noise_data.size()];
 
     affirm(noise_src.type() == wav_mat.type(), "noise type does not match wav type");
 
-    uint32_t src_offset = noise_src.rows * noise_offset_fraction;
-    uint32_t src_left   = noise_src.rows - src_offset;
-    uint32_t dst_offset = 0;
-    uint32_t dst_left   = wav_mat.rows;
+    // Mix in the noise clip from the offset, looping around to cover the entire input clip
+    const int16_t* noise      = noise_src.ptr<int16_t>();
+    int16_t*       wav        = wav_mat.ptr<int16_t>();
+    uint32_t       src_offset = noise_src.rows * noise_offset_fraction;
+    uint32_t       src_left   = noise_src.rows - src_offset;
+    uint32_t       dst_left   = wav_mat.rows;
 
     while (dst_left > 0)
     {
-        uint32_t copy_size = std::min(dst_left, src_left);
-        cv::Rect src_roi   = cv::Rect(cv::Point2i(0, src_offset), cv::Size2i(1, copy_size));
-        cv::Rect dst_roi   = cv::Rect(cv::Point2i(0, dst_offset), cv::Size2i(1, copy_size));
+        uint32_t mix_size = std::min(dst_left, src_left);
+        mix(wav, noise + src_offset, mix_size, noise_level);
+        wav += mix_size;
+        dst_left -= mix_size;
+        src_left   = noise_src.rows;
+        src_offset = 0; // loop around
+    }
+}
 
-        noise_src(src_roi).copyTo(noise_dst(dst_roi));
+// Rounds and saturates like cv::addWeighted(wav, 1, noise, level, 0, wav)
+void noise_clips::mix(int16_t* wav, const int16_t* noise, size_t count, float level)
+{
+    size_t i = 0;
+#ifdef __SSE4_1__
+    const __m128 scale = _mm_set1_ps(level);
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i w  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(wav + i));
+        __m128i n  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(noise + i));
+        __m128  w0 = _mm_cvtepi32_ps(_mm_cvtepi16_epi32(w));
+        __m128  w1 = _mm_cvtepi32_ps(_mm_cvtepi16_epi32(_mm_srli_si128(w, 8)));
+        __m128  n0 = _mm_cvtepi32_ps(_mm_cvtepi16_epi32(n));
+        __m128  n1 = _mm_cvtepi32_ps(_mm_cvtepi16_epi32(_mm_srli_si128(n, 8)));
+        __m128i r0 = _mm_cvtps_epi32(_mm_add_ps(w0, _mm_mul_ps(n0, scale)));
+        __m128i r1 = _mm_cvtps_epi32(_mm_add_ps(w1, _mm_mul_ps(n1, scale)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(wav + i), _mm_packs_epi32(r0, r1));
+    }
+#endif
+    for (; i < count; i++)
+    {
+        wav[i] = cv::saturate_cast<int16_t>(wav[i] + noise[i] * level);
+    }
+}
 
-        if (src_left > dst_left)
+void noise_clips::load_data()
+{
+    for (auto nfile : _noise_files)
+    {
+        int len = 0;
+        read_noise(nfile, &len);
+        cv::Mat clip = read_audio_from_mem(_buf, len);
+        if (clip.rows == 0)
         {
-            dst_left = 0;
+            throw std::runtime_error("noise_clips: no samples in " + nfile);
         }
-        else
+        _noise_data.push_back(clip);
+    }
+}
+
+bool noise_clips::load_bank(const std::string& bank_file)
+{
+    if (!file_util::exists(bank_file))
+    {
+        return false;
+    }
+    shared_ptr<memory_mapped_file> bank = make_shared<memory_mapped_file>(bank_file);
+
+    const char* data = bank->data();
+    size_t      size = bank->size();
+    bank_header header;
+    if (size < sizeof(header) || memcmp(data, bank_magic, sizeof(bank_magic)) != 0)
+    {
+        // a bank in an older format is made again when there is an index to make it from
+        if (!_index_file.empty())
         {
-            dst_left -= copy_size;
-            dst_offset += copy_size;
-            src_left   = noise_src.rows;
-            src_offset = 0; // loop around
+            return false;
         }
+        throw std::runtime_error("noise_clips: " + bank_file + " is not a noise bank");
+    }
+    memcpy(&header, data, sizeof(header));
+    size_t offset = sizeof(header) + header.root_size;
+    if (header.root_size > size - sizeof(header) || bank_padding(offset) > size - offset)
+    {
+        throw std::runtime_error("noise_clips: " + bank_file + " is truncated");
     }
-    // Superimpose noise without overflowing (opencv handles saturation cast for non CV_32S)
-    cv::addWeighted(wav_mat, 1.0f, noise_dst, noise_level, 0.0f, wav_mat);
+
+    if (!_index_file.empty())
+    {
+        bank_header expected;
+        if (!get_index_stats(_index_file, expected) ||
+            header.index_size != expected.index_size ||
+            header.index_mtime_sec != expected.index_mtime_sec ||
+            header.index_mtime_nsec != expected.index_mtime_nsec ||
+            header.root_size != _root_dir.size() ||
+            _root_dir.compare(0, string::npos, data + sizeof(header), header.root_size) != 0)
+        {
+            return false;
+        }
+    }
+
+    offset += bank_padding(offset);
+    uint64_t count = header.clip_count;
+    if (count == 0 || count > (size - offset) / sizeof(uint64_t))
+    {
+        throw std::runtime_error("noise_clips: " + bank_file + " is truncated");
+    }
+    size_t lengths = offset;
+    offset += count * sizeof(uint64_t);
+
+    for (uint64_t i = 0; i < count; i++)
+    {
+        uint64_t samples = unpack<uint64_t>(data, lengths + i * sizeof(uint64_t));
+        if (samples == 0 || samples > (size - offset) / sizeof(int16_t))
+        {
+            throw std::runtime_error("noise_clips: " + bank_file + " is truncated");
+        }
+        // It is bad to cast away const, but opencv does not support a const Mat.
+        // The clips are only read.
+        _noise_data.emplace_back(
+            static_cast<int>(samples), 1, CV_16SC1, const_cast<char*>(data + offset));
+        offset += samples * sizeof(int16_t);
+    }
+    _bank = bank;
+    return true;
 }
 
-void noise_clips::load_data()
+void noise_clips::write_bank(const std::string& bank_file) const
 {
-    for (auto nfile : _noise_files)
+    // without index stats the bank is made again once it is used with an index
+    bank_header header = {};
+    if (!_index_file.empty())
     {
-        int len = 0;
-        read_noise(nfile, &len);
-        _noise_data.push_back(read_audio_from_mem(_buf, len));
+        get_index_stats(_index_file, header);
+    }
+    memcpy(header.magic, bank_magic, sizeof(bank_magic));
+    header.root_size  = _root_dir.size();
+    header.clip_count = _noise_data.size();
+
+    string tmp_file = bank_file + "." + to_string(getpid());
+    {
+        const char padding[8] = {};
+        char       number[sizeof(uint64_t)];
+        ofstream   out(tmp_file, ios::binary);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(_root_dir.data(), _root_dir.size());
+        out.write(padding, bank_padding(sizeof(header) + _root_dir.size()));
+        for (const cv::Mat& clip : _noise_data)
+        {
+            pack<uint64_t>(number, clip.rows);
+            out.write(number, sizeof(number));
+        }
+        for (const cv::Mat& clip : _noise_data)
+        {
+            cv::Mat samples = clip.isContinuous() ? clip : clip.clone();
+            out.write(reinterpret_cast<const char*>(samples.data),
+                      samples.rows * sizeof(int16_t));
+        }
+        out.close();
+        if (out.fail())
+        {
+            file_util::remove_file(tmp_file);
+            throw std::runtime_error("noise_clips: could not write " + bank_file);
+        }
+    }
+
+    // rename so that a concurrent reader never sees a partially written bank
+    if (rename(tmp_file.c_str(), bank_file.c_str()) != 0)
+    {
+        file_util::remove_file(tmp_file);
+        throw std::runtime_error("noise_clips: could not write " + bank_file);
     }
 }
 
@@ -16,33 +16,63 @@
 
 #pragma once
 
+#include <memory>
 #include <opencv2/core/core.hpp>
 #include "util.hpp"
 
 namespace nervana
 {
     class noise_clips;
+    class memory_mapped_file;
 }
 
+/* noise_clips
+ *
+ * Noise clips mixed into audio records.  The clips are decoded from the files listed in
+ * the index file, or read with mmap from a bank file of already decoded clips.  get()
+ * shares one set of clips between all users in the process.
+ */
 class nervana::noise_clips
 {
 public:
-    noise_clips(const std::string noiseIndexFile, const std::string noiseRoot);
+    noise_clips(const std::string noiseIndexFile,
+                const std::string noiseRoot,
+                const std::string bankFile = "");
     virtual ~noise_clips();
+
+    // The clips for the index file, loaded on first use and released with the last user.
+    // With a bank file that does not exist yet, or was made from another version of the
+    // index file, the decoded clips are written to it.
+    static std::shared_ptr<noise_clips> get(const std::string& noiseIndexFile,
+                                            const std::string& noiseRoot,
+                                            const std::string& bankFile = "");
+
     void addNoise(cv::Mat& wav_mat,
                   bool     add_noise,
                   uint32_t noise_index,
                   float    noise_offset_fraction,
-                  float    noise_level);
+                  float    noise_level) const;
+
+    size_t         size() const { return _noise_data.size(); }
+    const cv::Mat& clip(size_t index) const { return _noise_data[index]; }
+    void           write_bank(const std::string& bankFile) const;
+
+    // Adds noise * level to count samples with saturation
+    static void mix(int16_t* wav, const int16_t* noise, size_t count, float level);
 
 private:
     void load_index(const std::string& index_file, const std::string& root_dir);
     void load_data();
+    // False when the bank does not exist or was made from another index or root
+    bool load_bank(const std::string& bank_file);
     void read_noise(std::string& noise_file, int* dataLen);
 
 private:
-    std::vector<cv::Mat>     _noise_data;
-    std::vector<std::string> _noise_files;
-    char*                    _buf    = 0;
-    int                      _bufLen = 0;
+    std::vector<cv::Mat>                _noise_data;
+    std::vector<std::string>            _noise_files;
+    std::string                         _index_file;
+    std::string                         _root_dir;
+    std::shared_ptr<memory_mapped_file> _bank;
+    char*                               _buf    = 0;
+    int                                 _bufLen = 0;
 };
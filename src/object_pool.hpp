@@ -0,0 +1,93 @@
+/*******************************************************************************
+* Copyright 2016-2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace nervana
+{
+    template <typename T>
+    class object_pool;
+}
+
+/**
+ * \brief Per thread pool of reusable shared objects
+ *
+ * acquire() hands out an object that nothing outside the pool references any more, so
+ * in steady state each decode thread cycles through the same few objects instead of
+ * allocating one, with its shared_ptr control block, per record.  T::reset() is called
+ * once on every object that has come back, before the next one is handed out, so an
+ * object idle in the pool holds no data beyond the capacity of its containers.
+ */
+template <typename T>
+class nervana::object_pool
+{
+public:
+    template <typename Create>
+    static std::shared_ptr<T> acquire(Create create)
+    {
+        std::vector<entry>& pool = thread_objects();
+        for (entry& e : pool)
+        {
+            if (e.in_use && e.object.use_count() == 1)
+            {
+                // the last user may have let go of it on another thread
+                std::atomic_thread_fence(std::memory_order_acquire);
+                e.object->reset();
+                e.in_use = false;
+            }
+        }
+        for (entry& e : pool)
+        {
+            if (!e.in_use)
+            {
+                e.in_use = true;
+                return e.object;
+            }
+        }
+
+        std::shared_ptr<T> rc = create();
+        if (pool.size() < max_pool_size)
+        {
+            pool.push_back({rc, true});
+        }
+        return rc;
+    }
+
+    static std::shared_ptr<T> acquire()
+    {
+        return acquire([]() { return std::make_shared<T>(); });
+    }
+
+private:
+    // enough for every object a record holds at once, e.g. the views of a multicrop
+    static const size_t max_pool_size = 32;
+
+    struct entry
+    {
+        std::shared_ptr<T> object;
+        bool               in_use;
+    };
+
+    static std::vector<entry>& thread_objects()
+    {
+        thread_local static std::vector<entry> objects;
+        return objects;
+    }
+};
@@ -14,6 +14,7 @@
 * limitations under the License.
 *******************************************************************************/
 
+#include <functional>
 #include <sstream>
 
 #include "provider.hpp"
@@ -91,11 +92,11 @@ provider::provider_base::provider_base(nlohmann::json                     js,
         {
             prov = static_pointer_cast<provider::interface>(make_shared<provider::label_map>(j));
         }
-        // else if (type == "multicrop")
-        // {
-        //     prov = static_pointer_cast<provider::interface>(
-        //         make_shared<provider::multicrop>(j, augmentation));
-        // }
+        else if (type == "multicrop")
+        {
+            prov = static_pointer_cast<provider::interface>(
+                make_shared<provider::multicrop>(j, augmentation));
+        }
         else
         {
             stringstream ss;
@@ -114,12 +115,34 @@ provider::provider_base::provider_base(nlohmann::json                     js,
 void provider::provider_base::provide(int                           idx,
                                       nervana::encoded_record_list& in_buf,
                                       nervana::fixed_buffer_map&    out_buf) const
+{
+    if (!out_buf.is_feature_major())
+    {
+        provide(idx, in_buf, out_buf, idx);
+        return;
+    }
+
+    // the record is made in a buffer that stays in cache and then scattered into its
+    // feature major positions
+    thread_local fixed_buffer_map record;
+    record.reshape(m_output_shapes, 1);
+    provide(idx, in_buf, record, 0);
+    for (const string& name : record.get_names())
+    {
+        out_buf[name]->write_item(idx, record[name]->get_item(0));
+    }
+}
+
+void provider::provider_base::provide(int                           idx,
+                                      nervana::encoded_record_list& in_buf,
+                                      nervana::fixed_buffer_map&    out_buf,
+                                      size_t                        out_idx) const
 {
     augmentation aug;
     int          index = 0;
     for (const shared_ptr<provider::interface>& provider : m_providers)
     {
-        provider->provide(idx, in_buf.record(idx).element(index++), out_buf, aug);
+        provider->provide(out_idx, in_buf.record(idx).element(index++), out_buf, aug);
     }
 }
 
@@ -154,15 +177,36 @@ provider::image::image(nlohmann::json js, nlohmann::json aug)
     , m_transformer{m_config}
     , m_augmentation_factory{aug}
     , m_loader{m_config, m_augmentation_factory.fixed_aspect_ratio}
+    , m_fused{m_config.channel_major, m_config.get_shape_type().get_otype()}
     , m_buffer_name{create_name(m_config.name, "image")}
 {
     m_output_shapes.emplace_back(make_pair(m_buffer_name, m_config.get_shape_type()));
 }
 
-void provider::image::provide(int                        idx,
-                              const std::vector<char>&   datum_in,
-                              nervana::fixed_buffer_map& out_buf,
-                              augmentation&              aug) const
+void provider::image::load(char*                                      datum_out,
+                           const shared_ptr<augment::image::params>&  params,
+                           const shared_ptr<nervana::image::decoded>& decoded) const
+{
+    // the fused kernel covers everything but the fixed aspect ratio canvas, which the
+    // loader pads around the image, and normalization, which the loader does while
+    // converting
+    if (m_config.fused_transform && !m_augmentation_factory.fixed_aspect_ratio &&
+        m_config.mean.empty() && m_config.stddev.empty() &&
+        decoded->get_image_count() == 1 &&
+        nervana::image::fused_transform::is_supported(*params, decoded->get_image(0)))
+    {
+        m_fused.run(decoded->get_image(0), *params, datum_out);
+    }
+    else
+    {
+        m_loader.load({datum_out}, m_transformer.transform(params, decoded));
+    }
+}
+
+void provider::image::provide(int                          idx,
+                              const variable_record_field& datum_in,
+                              nervana::fixed_buffer_map&   out_buf,
+                              augmentation&                aug) const
 {
     char* datum_out = out_buf[m_buffer_name]->get_item(idx);
 
@@ -173,15 +217,70 @@ void provider::image::provide(int                        idx,
         throw std::runtime_error(ss.str());
     }
 
+    // When the JPEG header gives the image size, the augmentation params are made
+    // before decoding so that only the part of the image the crop needs is decoded,
+    // either at a reduced size that still covers the crop or limited to the crop
+    // region.  The shared params stay in full size coordinates.
+    cv::Size2i header_size;
+    bool       params_from_header = false;
+    if ((m_config.reduced_decode || m_config.roi_decode) &&
+        aug.m_image_augmentations == nullptr &&
+        nervana::image::jpeg_size(datum_in.data(), datum_in.size(), header_size) &&
+        nervana::image::jpeg_orientation(datum_in.data(), datum_in.size()) == 1)
+    {
+        aug.m_image_augmentations = m_augmentation_factory.make_params(
+            header_size.width, header_size.height, m_config.width, m_config.height);
+        params_from_header = true;
+
+        auto& params    = *aug.m_image_augmentations;
+        int   reduction = 1;
+        if (m_config.reduced_decode)
+        {
+            reduction = nervana::image::transformer::decode_reduction(params);
+        }
+        cv::Size2i reduced_size((header_size.width + reduction - 1) / reduction,
+                                (header_size.height + reduction - 1) / reduction);
+        auto reduced_params =
+            nervana::image::transformer::reduce_params(params, reduction, reduced_size);
+
+        shared_ptr<nervana::image::decoded> decoded;
+        if (m_config.roi_decode && nervana::image::transformer::roi_decode_supported(params))
+        {
+            decoded = m_extractor.extract_roi(
+                datum_in.data(), datum_in.size(), reduction, reduced_params->cropbox);
+            if (decoded)
+            {
+                reduced_params->cropbox = cv::Rect(cv::Point2i(0, 0), decoded->get_image_size());
+            }
+        }
+        if (!decoded && reduction > 1)
+        {
+            decoded = m_extractor.extract(datum_in.data(), datum_in.size(), reduction);
+            if (decoded->get_image_size() != reduced_size)
+            {
+                decoded = nullptr;
+            }
+        }
+        if (decoded)
+        {
+            load(datum_out, reduced_params, decoded);
+            return;
+        }
+    }
+
     // Process image data
     auto decoded    = m_extractor.extract(datum_in.data(), datum_in.size());
     auto input_size = decoded->get_image_size();
-    if (aug.m_image_augmentations == nullptr)
+
+    // params made from the header do not fit if the decoder changed the geometry,
+    // e.g. by applying EXIF orientation
+    if (aug.m_image_augmentations == nullptr ||
+        (params_from_header && input_size != header_size))
     {
         aug.m_image_augmentations = m_augmentation_factory.make_params(
             input_size.width, input_size.height, m_config.width, m_config.height);
     }
-    m_loader.load({datum_out}, m_transformer.transform(aug.m_image_augmentations, decoded));
+    load(datum_out, aug.m_image_augmentations, decoded);
 }
 
 //=================================================================================================
@@ -198,10 +297,10 @@ provider::label::label(nlohmann::json js)
     m_output_shapes.emplace_back(make_pair(m_buffer_name, m_config.get_shape_type()));
 }
 
-void provider::label::provide(int                        idx,
-                              const vector<char>&        datum_in,
-                              nervana::fixed_buffer_map& out_buf,
-                              augmentation&              aug) const
+void provider::label::provide(int                          idx,
+                              const variable_record_field& datum_in,
+                              nervana::fixed_buffer_map&   out_buf,
+                              augmentation&                aug) const
 {
     char* target_out = out_buf[m_buffer_name]->get_item(idx);
 
@@ -238,10 +337,10 @@ provider::audio::audio(nlohmann::json js, nlohmann::json aug)
     }
 }
 
-void provider::audio::provide(int                        idx,
-                              const std::vector<char>&   datum_in,
-                              nervana::fixed_buffer_map& out_buf,
-                              augmentation&              aug) const
+void provider::audio::provide(int                          idx,
+                              const variable_record_field& datum_in,
+                              nervana::fixed_buffer_map&   out_buf,
+                              augmentation&                aug) const
 {
     char* datum_out = out_buf[m_buffer_name]->get_item(idx);
 
@@ -304,10 +403,10 @@ provider::localization::rcnn::rcnn(nlohmann::json js, nlohmann::json aug)
     m_output_shapes.emplace_back(make_pair(m_difficult_flag_buffer_name, os[9]));
 }
 
-void provider::localization::rcnn::provide(int                        idx,
-                                           const std::vector<char>&   datum_in,
-                                           nervana::fixed_buffer_map& out_buf,
-                                           augmentation&              aug) const
+void provider::localization::rcnn::provide(int                          idx,
+                                           const variable_record_field& datum_in,
+                                           nervana::fixed_buffer_map&   out_buf,
+                                           augmentation&                aug) const
 {
     vector<void*> output_list = {out_buf[m_bbtargets_buffer_name]->get_item(idx),
                                  out_buf[m_bbtargets_mask_buffer_name]->get_item(idx),
@@ -365,10 +464,10 @@ provider::localization::ssd::ssd(nlohmann::json js, nlohmann::json aug)
     m_output_shapes.emplace_back(make_pair(m_difficult_flag_buffer_name, os[4]));
 }
 
-void provider::localization::ssd::provide(int                        idx,
-                                          const std::vector<char>&   datum_in,
-                                          nervana::fixed_buffer_map& out_buf,
-                                          augmentation&              aug) const
+void provider::localization::ssd::provide(int                          idx,
+                                          const variable_record_field& datum_in,
+                                          nervana::fixed_buffer_map&   out_buf,
+                                          augmentation&                aug) const
 {
     vector<void*> output_list = {out_buf[m_image_shape_buffer_name]->get_item(idx),
                                  out_buf[m_gt_boxes_buffer_name]->get_item(idx),
@@ -416,10 +515,10 @@ provider::pixelmask::pixelmask(nlohmann::json js, nlohmann::json aug)
     m_output_shapes.emplace_back(make_pair(m_buffer_name, m_config.get_shape_type()));
 }
 
-void provider::pixelmask::provide(int                        idx,
-                                  const std::vector<char>&   datum_in,
-                                  nervana::fixed_buffer_map& out_buf,
-                                  augmentation&              aug) const
+void provider::pixelmask::provide(int                          idx,
+                                  const variable_record_field& datum_in,
+                                  nervana::fixed_buffer_map&   out_buf,
+                                  augmentation&                aug) const
 {
     char* datum_out = out_buf[m_buffer_name]->get_item(idx);
 
@@ -462,10 +561,10 @@ provider::boundingbox::boundingbox(nlohmann::json js, nlohmann::json aug)
     m_output_shapes.emplace_back(make_pair(m_buffer_name, m_config.get_shape_type()));
 }
 
-void provider::boundingbox::provide(int                        idx,
-                                    const std::vector<char>&   datum_in,
-                                    nervana::fixed_buffer_map& out_buf,
-                                    augmentation&              aug) const
+void provider::boundingbox::provide(int                          idx,
+                                    const variable_record_field& datum_in,
+                                    nervana::fixed_buffer_map&   out_buf,
+                                    augmentation&                aug) const
 {
     char* datum_out = out_buf[m_buffer_name]->get_item(idx);
 
@@ -506,9 +605,9 @@ provider::blob::blob(nlohmann::json js)
     m_output_shapes.emplace_back(make_pair(m_buffer_name, m_config.get_shape_type()));
 }
 
-void provider::blob::provide(int                        idx,
-                             const std::vector<char>&   datum_in,
-                             nervana::fixed_buffer_map& out_buf,
+void provider::blob::provide(int                          idx,
+                             const variable_record_field& datum_in,
+                             nervana::fixed_buffer_map&   out_buf,
                              augmentation&) const
 {
     char* datum_out = out_buf[m_buffer_name]->get_item(idx);
@@ -540,10 +639,10 @@ provider::video::video(nlohmann::json js, nlohmann::json aug)
     m_output_shapes.emplace_back(make_pair(m_buffer_name, m_config.get_shape_type()));
 }
 
-void provider::video::provide(int                        idx,
-                              const std::vector<char>&   datum_in,
-                              nervana::fixed_buffer_map& out_buf,
-                              augmentation&              aug) const
+void provider::video::provide(int                          idx,
+                              const variable_record_field& datum_in,
+                              nervana::fixed_buffer_map&   out_buf,
+                              augmentation&                aug) const
 {
     char* datum_out = out_buf[m_buffer_name]->get_item(idx);
 
@@ -590,9 +689,9 @@ provider::char_map::char_map(nlohmann::json js)
     }
 }
 
-void provider::char_map::provide(int                        idx,
-                                 const std::vector<char>&   datum_in,
-                                 nervana::fixed_buffer_map& out_buf,
+void provider::char_map::provide(int                          idx,
+                                 const variable_record_field& datum_in,
+                                 nervana::fixed_buffer_map&   out_buf,
                                  augmentation&) const
 {
     char* datum_out = out_buf[m_buffer_name]->get_item(idx);
@@ -631,9 +730,9 @@ provider::label_map::label_map(nlohmann::json js)
     m_output_shapes.emplace_back(make_pair(m_buffer_name, m_config.get_shape_type()));
 }
 
-void provider::label_map::provide(int                        idx,
-                                  const std::vector<char>&   datum_in,
-                                  nervana::fixed_buffer_map& out_buf,
+void provider::label_map::provide(int                          idx,
+                                  const variable_record_field& datum_in,
+                                  nervana::fixed_buffer_map&   out_buf,
                                   augmentation&) const
 {
     char* datum_out = out_buf[m_buffer_name]->get_item(idx);
@@ -652,3 +751,91 @@ void provider::label_map::provide(int                        idx,
 //=================================================================================================
 // multicrop
 //=================================================================================================
+
+namespace
+{
+    class parallel_views : public cv::ParallelLoopBody
+    {
+    public:
+        parallel_views(const function<void(int)>& load_view)
+            : m_load_view(load_view)
+        {
+        }
+
+        void operator()(const cv::Range& range) const override
+        {
+            for (int i = range.start; i < range.end; i++)
+            {
+                m_load_view(i);
+            }
+        }
+
+    private:
+        const function<void(int)>& m_load_view;
+    };
+}
+
+provider::multicrop::multicrop(nlohmann::json js, nlohmann::json aug)
+    : interface(js, 1)
+    , m_config{js}
+    , m_image{js["image"], aug}
+    , m_buffer_name{create_name(m_config.name, "multicrop")}
+{
+    m_output_shapes.emplace_back(make_pair(m_buffer_name, m_config.get_shape_type()));
+}
+
+void provider::multicrop::provide(int                          idx,
+                                  const variable_record_field& datum_in,
+                                  nervana::fixed_buffer_map&   out_buf,
+                                  augmentation&                aug) const
+{
+    char* datum_out = out_buf[m_buffer_name]->get_item(idx);
+
+    if (datum_in.size() == 0)
+    {
+        std::stringstream ss;
+        ss << "received encoded image with size 0, at idx " << idx;
+        throw std::runtime_error(ss.str());
+    }
+
+    // decode once and draw the params of every view here, in this thread, so that
+    // deterministic mode sees the same sequence of random numbers on every run
+    auto decoded    = m_image.m_extractor.extract(datum_in.data(), datum_in.size());
+    auto input_size = decoded->get_image_size();
+    auto width      = m_config.image.width;
+    auto height     = m_config.image.height;
+
+    vector<shared_ptr<augment::image::params>> views;
+    bool                                       shared_plugin = false;
+    for (uint32_t i = 0; i < m_config.crop_count; i++)
+    {
+        views.push_back(m_image.m_augmentation_factory.make_params(
+            input_size.width, input_size.height, width, height));
+#ifdef PYTHON_PLUGIN
+        shared_plugin |= views.back()->user_plugin != nullptr;
+#endif
+    }
+    if (aug.m_image_augmentations == nullptr)
+    {
+        aug.m_image_augmentations = views[0];
+    }
+
+    size_t                    view_size = m_config.image.get_shape_type().get_byte_size();
+    const function<void(int)> load_view = [&](int i) {
+        m_image.load(datum_out + i * view_size, views[i], decoded);
+    };
+
+    // the views of a record share the decoded image and each writes its own slice
+    // of the output; a user plugin is one instance per thread so those run serially
+    if (shared_plugin)
+    {
+        for (uint32_t i = 0; i < views.size(); i++)
+        {
+            load_view(i);
+        }
+    }
+    else
+    {
+        cv::parallel_for_(cv::Range(0, views.size()), parallel_views(load_view));
+    }
+}
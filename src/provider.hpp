@@ -29,11 +29,13 @@
 #include "etl_char_map.hpp"
 #include "etl_depthmap.hpp"
 #include "etl_label_map.hpp"
+#include "etl_multicrop.hpp"
 #include "etl_localization_rcnn.hpp"
 #include "etl_localization_ssd.hpp"
 #include "etl_pixel_mask.hpp"
 #include "etl_video.hpp"
 #include "augment_image.hpp"
+#include "fused_transform.hpp"
 
 namespace nervana
 {
@@ -72,6 +74,10 @@ public:
                   nlohmann::json                     augmentation);
 
     void provide(int idx, encoded_record_list& in_buf, fixed_buffer_map& out_buf) const override;
+    void provide(int                  idx,
+                 encoded_record_list& in_buf,
+                 fixed_buffer_map&    out_buf,
+                 size_t               out_idx) const override;
 
 private:
     std::vector<std::shared_ptr<provider::interface>> m_providers;
@@ -97,9 +103,9 @@ class nervana::provider::interface : public nervana::provider_interface
 public:
     interface(nlohmann::json, size_t);
     virtual ~interface() {}
-    virtual void provide(int                        idx,
-                         const std::vector<char>&   datum_in,
-                         nervana::fixed_buffer_map& out_buf,
+    virtual void provide(int                          idx,
+                         const variable_record_field& datum_in,
+                         nervana::fixed_buffer_map&   out_buf,
                          augmentation&) const = 0;
 
     static std::string create_name(const std::string& name, const std::string& base_name);
@@ -110,6 +116,12 @@ private:
                  nervana::fixed_buffer_map&    out_buf) const
     {
     }
+    void provide(int                           idx,
+                 nervana::encoded_record_list& in_buf,
+                 nervana::fixed_buffer_map&    out_buf,
+                 size_t                        out_idx) const
+    {
+    }
 };
 
 //=================================================================================================
@@ -121,17 +133,24 @@ class nervana::provider::image : public provider::interface
 public:
     image(nlohmann::json config, nlohmann::json aug);
     virtual ~image() {}
-    void provide(int                        idx,
-                 const std::vector<char>&   datum_in,
-                 nervana::fixed_buffer_map& out_buf,
+    void provide(int                          idx,
+                 const variable_record_field& datum_in,
+                 nervana::fixed_buffer_map&   out_buf,
                  augmentation&) const override;
 
 private:
+    friend class multicrop;
+
+    void load(char*                                           datum_out,
+              const std::shared_ptr<augment::image::params>&  params,
+              const std::shared_ptr<nervana::image::decoded>& decoded) const;
+
     const nervana::image::config           m_config;
     nervana::image::extractor              m_extractor;
     nervana::image::transformer            m_transformer;
     nervana::augment::image::param_factory m_augmentation_factory;
     nervana::image::loader                 m_loader;
+    nervana::image::fused_transform        m_fused;
     const std::string                      m_buffer_name;
 };
 
@@ -144,9 +163,9 @@ class nervana::provider::label : public provider::interface
 public:
     label(nlohmann::json config);
     virtual ~label() {}
-    void provide(int                        idx,
-                 const std::vector<char>&   datum_in,
-                 nervana::fixed_buffer_map& out_buf,
+    void provide(int                          idx,
+                 const variable_record_field& datum_in,
+                 nervana::fixed_buffer_map&   out_buf,
                  augmentation&) const override;
 
 private:
@@ -165,9 +184,9 @@ class nervana::provider::audio : public provider::interface
 public:
     audio(nlohmann::json js, nlohmann::json aug);
     virtual ~audio() {}
-    void provide(int                        idx,
-                 const std::vector<char>&   datum_in,
-                 nervana::fixed_buffer_map& out_buf,
+    void provide(int                          idx,
+                 const variable_record_field& datum_in,
+                 nervana::fixed_buffer_map&   out_buf,
                  augmentation&) const override;
 
 private:
@@ -189,9 +208,9 @@ class nervana::provider::localization::rcnn : public provider::interface
 public:
     rcnn(nlohmann::json js, nlohmann::json aug);
     virtual ~rcnn() {}
-    void provide(int                        idx,
-                 const std::vector<char>&   datum_in,
-                 nervana::fixed_buffer_map& out_buf,
+    void provide(int                          idx,
+                 const variable_record_field& datum_in,
+                 nervana::fixed_buffer_map&   out_buf,
                  augmentation&) const override;
 
 private:
@@ -221,9 +240,9 @@ class nervana::provider::localization::ssd : public provider::interface
 public:
     ssd(nlohmann::json js, nlohmann::json aug);
     virtual ~ssd() {}
-    void provide(int                        idx,
-                 const std::vector<char>&   datum_in,
-                 nervana::fixed_buffer_map& out_buf,
+    void provide(int                          idx,
+                 const variable_record_field& datum_in,
+                 nervana::fixed_buffer_map&   out_buf,
                  augmentation&) const override;
 
 private:
@@ -248,9 +267,9 @@ class nervana::provider::pixelmask : public provider::interface
 public:
     pixelmask(nlohmann::json js, nlohmann::json aug);
     virtual ~pixelmask() {}
-    void provide(int                        idx,
-                 const std::vector<char>&   datum_in,
-                 nervana::fixed_buffer_map& out_buf,
+    void provide(int                          idx,
+                 const variable_record_field& datum_in,
+                 nervana::fixed_buffer_map&   out_buf,
                  augmentation&) const override;
 
 private:
@@ -271,9 +290,9 @@ class nervana::provider::boundingbox : public provider::interface
 public:
     boundingbox(nlohmann::json js, nlohmann::json aug);
     virtual ~boundingbox() {}
-    void provide(int                        idx,
-                 const std::vector<char>&   datum_in,
-                 nervana::fixed_buffer_map& out_buf,
+    void provide(int                          idx,
+                 const variable_record_field& datum_in,
+                 nervana::fixed_buffer_map&   out_buf,
                  augmentation&) const override;
 
 private:
@@ -295,9 +314,9 @@ class nervana::provider::blob : public provider::interface
 public:
     blob(nlohmann::json js);
     virtual ~blob() {}
-    void provide(int                        idx,
-                 const std::vector<char>&   datum_in,
-                 nervana::fixed_buffer_map& out_buf,
+    void provide(int                          idx,
+                 const variable_record_field& datum_in,
+                 nervana::fixed_buffer_map&   out_buf,
                  augmentation&) const override;
 
 private:
@@ -316,9 +335,9 @@ class nervana::provider::video : public provider::interface
 {
 public:
     video(nlohmann::json js, nlohmann::json aug);
-    void provide(int                        idx,
-                 const std::vector<char>&   datum_in,
-                 nervana::fixed_buffer_map& out_buf,
+    void provide(int                          idx,
+                 const variable_record_field& datum_in,
+                 nervana::fixed_buffer_map&   out_buf,
                  augmentation&) const override;
 
 private:
@@ -339,9 +358,9 @@ class nervana::provider::char_map : public provider::interface
 public:
     char_map(nlohmann::json js);
     virtual ~char_map() {}
-    void provide(int                        idx,
-                 const std::vector<char>&   datum_in,
-                 nervana::fixed_buffer_map& out_buf,
+    void provide(int                          idx,
+                 const variable_record_field& datum_in,
+                 nervana::fixed_buffer_map&   out_buf,
                  augmentation&) const override;
 
 private:
@@ -362,9 +381,9 @@ class nervana::provider::label_map : public provider::interface
 public:
     label_map(nlohmann::json js);
     virtual ~label_map() {}
-    void provide(int                        idx,
-                 const std::vector<char>&   datum_in,
-                 nervana::fixed_buffer_map& out_buf,
+    void provide(int                          idx,
+                 const variable_record_field& datum_in,
+                 nervana::fixed_buffer_map&   out_buf,
                  augmentation&) const override;
 
 private:
@@ -378,3 +397,20 @@ private:
 //=================================================================================================
 // multicrop
 //=================================================================================================
+
+class nervana::provider::multicrop : public provider::interface
+{
+public:
+    multicrop(nlohmann::json config, nlohmann::json aug);
+    virtual ~multicrop() {}
+    void provide(int                          idx,
+                 const variable_record_field& datum_in,
+                 nervana::fixed_buffer_map&   out_buf,
+                 augmentation&) const override;
+
+private:
+    multicrop() = delete;
+    nervana::multicrop::config m_config;
+    provider::image            m_image;
+    const std::string          m_buffer_name;
+};
@@ -43,6 +43,11 @@ public:
     virtual void provide(int                           idx,
                          nervana::encoded_record_list& in_buf,
                          nervana::fixed_buffer_map&    out_buf) const = 0;
+    // Decodes record idx of in_buf into record out_idx of out_buf
+    virtual void provide(int                           idx,
+                         nervana::encoded_record_list& in_buf,
+                         nervana::fixed_buffer_map&    out_buf,
+                         size_t                        out_idx) const = 0;
 
     size_t       get_input_count() const { return m_input_count; }
     virtual void post_process(fixed_buffer_map& out_buf) {}
@@ -14,6 +14,8 @@
 * limitations under the License.
 *******************************************************************************/
 
+#include <algorithm>
+#include <cstring>
 #include <fstream>
 
 #include <opencv2/core/core.hpp>
@@ -125,6 +127,7 @@ raw_image raw_image::from_cvmat(cv::Mat& mat)
     rc.m_width    = mat.cols;
     rc.m_height   = mat.rows;
     rc.m_bitwidth = mat.elemSize1() * 8;
+    rc.m_is_float = mat.depth() == CV_32F || mat.depth() == CV_64F;
 
     size_t size = rc.m_width * rc.m_height * rc.m_channels * (rc.m_bitwidth / 8);
     rc.m_data   = shared_ptr<char>(new char[size], std::default_delete<char[]>());
@@ -135,31 +138,101 @@ raw_image raw_image::from_cvmat(cv::Mat& mat)
 
 cv::Mat raw_image::to_cvmat()
 {
-    int type = 0;
+    int type = to_cv_type(m_is_float, m_bitwidth, m_channels);
+    if (type < 0)
+    {
+        throw runtime_error("unsupported raw_image pixel format");
+    }
+
+    cv::Mat rc((int)m_height, (int)m_width, type);
+    memcpy(rc.data, &*m_data, size());
+
+    return rc;
+}
 
-    if (m_is_float)
+bool raw_image::wrap(const void* data, size_t size, cv::Mat& image)
+{
+    // write() always starts with the width, which makes a cheap magic number
+    static const string magic = "width:";
+    const char*         p     = static_cast<const char*>(data);
+    const char*         end   = p + size;
+    if (size < magic.size() || magic.compare(0, magic.size(), p, magic.size()) != 0)
     {
-        switch (m_bitwidth)
-        {
-        case 32: type = CV_MAKETYPE(CV_32F, m_channels); break;
-        case 64: type = CV_MAKETYPE(CV_64F, m_channels); break;
-        default: break;
-        }
+        return false;
     }
-    else
+
+    // parse the "tag: value" lines in place, up to the blank line ending the header
+    raw_image header;
+    for (;;)
     {
-        switch (m_bitwidth)
+        const char* eol = static_cast<const char*>(memchr(p, '\n', end - p));
+        if (eol == nullptr)
         {
-        case 8: type  = CV_MAKETYPE(CV_8U, m_channels); break;
-        case 16: type = CV_MAKETYPE(CV_16U, m_channels); break;
-        default: break;
+            return false;
+        }
+        if (eol == p)
+        {
+            p++;
+            break;
+        }
+        const char* colon = static_cast<const char*>(memchr(p, ':', eol - p));
+        if (colon != nullptr)
+        {
+            string tag(p, colon);
+            string value(colon + 1, eol);
+            if (tag == "width")
+            {
+                header.m_width = stoi(value);
+            }
+            else if (tag == "height")
+            {
+                header.m_height = stoi(value);
+            }
+            else if (tag == "channels")
+            {
+                header.m_channels = stoi(value);
+            }
+            else if (tag == "bitwidth")
+            {
+                header.m_bitwidth = stoi(value);
+            }
+            else if (tag == "is_float")
+            {
+                header.m_is_float = to_bool(value);
+            }
+            else if (tag == "is_big_endian")
+            {
+                header.m_is_big_endian = to_bool(value);
+            }
         }
+        p = eol + 1;
     }
 
-    cv::Mat rc((int)m_height, (int)m_width, type);
-    memcpy(rc.data, &*m_data, size());
+    int type = to_cv_type(header.m_is_float, header.m_bitwidth, header.m_channels);
+    if (type < 0 || header.size() == 0 || header.size() > size_t(end - p))
+    {
+        return false;
+    }
 
-    return rc;
+    // It is bad to cast away const, but opencv does not support a const Mat
+    // Callers only read the pixels of the image
+    image = cv::Mat((int)header.m_height, (int)header.m_width, type, const_cast<char*>(p));
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    bool host_big_endian = true;
+#else
+    bool host_big_endian = false;
+#endif
+    size_t element_size = header.m_bitwidth / 8;
+    if (element_size > 1 && header.m_is_big_endian != host_big_endian)
+    {
+        image = image.clone();
+        for (uint8_t* e = image.data; e < image.dataend; e += element_size)
+        {
+            reverse(e, e + element_size);
+        }
+    }
+    return true;
 }
 
 size_t raw_image::size() const
@@ -167,7 +240,31 @@ size_t raw_image::size() const
     return m_width * m_height * m_channels * (m_bitwidth / 8);
 }
 
-bool raw_image::to_bool(const std::string& s) const
+int raw_image::to_cv_type(bool is_float, size_t bitwidth, size_t channels)
+{
+    int depth = -1;
+    if (is_float)
+    {
+        switch (bitwidth)
+        {
+        case 32: depth = CV_32F; break;
+        case 64: depth = CV_64F; break;
+        default: break;
+        }
+    }
+    else
+    {
+        switch (bitwidth)
+        {
+        case 8: depth  = CV_8U; break;
+        case 16: depth = CV_16U; break;
+        default: break;
+        }
+    }
+    return depth < 0 || channels < 1 || channels > 4 ? -1 : CV_MAKETYPE(depth, channels);
+}
+
+bool raw_image::to_bool(const std::string& s)
 {
     bool   rc  = false;
     string str = to_lower(s);
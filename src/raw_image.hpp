@@ -39,13 +39,19 @@ public:
     static raw_image from_cvmat(cv::Mat&);
     cv::Mat          to_cvmat();
 
+    // Recognizes a buffer written by write() and sets image to a Mat of its pixels that
+    // points into the buffer rather than copying them.  Multi byte pixels stored in the
+    // other byte order are copied and swapped.  Returns false for any other data.
+    static bool wrap(const void* data, size_t size, cv::Mat& image);
+
     size_t size() const;
 
 private:
     raw_image();
     void read(std::istream& in);
 
-    bool to_bool(const std::string&) const;
+    static bool to_bool(const std::string&);
+    static int  to_cv_type(bool is_float, size_t bitwidth, size_t channels);
 
     std::shared_ptr<char> m_data;
     size_t                m_width;
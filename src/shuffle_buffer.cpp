@@ -0,0 +1,284 @@
+/*******************************************************************************
+* Copyright 2017-2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#include <algorithm>
+#include <sstream>
+#include <unordered_map>
+
+#include "shuffle_buffer.hpp"
+
+using namespace std;
+using namespace nervana;
+
+shuffle_buffer::shuffle_buffer(shared_ptr<async_manager_source<encoded_record_list>> source,
+                               size_t   buffer_size,
+                               size_t   output_size,
+                               size_t   epoch_record_count,
+                               uint32_t seed)
+    : async_manager<encoded_record_list, encoded_record_list>{source, "shuffle_buffer"}
+    , m_buffer_size{buffer_size}
+    , m_output_size{output_size}
+    , m_epoch_record_count{epoch_record_count}
+    , m_elements_per_record{source->elements_per_record()}
+    , m_seed{seed ? seed : random_device{}()}
+{
+    if (m_buffer_size == 0 || m_output_size == 0)
+    {
+        throw invalid_argument("shuffle_buffer size and output size must be greater than 0");
+    }
+    m_buffer.reserve(m_buffer_size);
+}
+
+void shuffle_buffer::initialize()
+{
+    // Reseed on every restart so the order does not depend on how far the
+    // previous pass was prefetched
+    m_random.seed(m_seed + m_reset_count++);
+    m_buffer.clear();
+    m_positions.clear();
+    m_pending.clear();
+    m_pending_next    = 0;
+    m_epoch_position  = 0;
+    m_end_of_data     = false;
+    m_epoch           = 0;
+    m_output_position = m_start_output_position;
+    {
+        lock_guard<mutex> lock(m_state_mutex);
+        m_saved_buffers.clear();
+    }
+    m_start_output_position = 0;
+    async_manager<encoded_record_list, encoded_record_list>::initialize();
+}
+
+nlohmann::json shuffle_buffer::get_state(size_t stream_offset) const
+{
+    if (m_epoch_record_count == 0)
+    {
+        throw runtime_error("shuffle_buffer state needs an epoch record count");
+    }
+
+    lock_guard<mutex> lock(m_state_mutex);
+    auto              it = m_saved_buffers.upper_bound(stream_offset);
+    if (it == m_saved_buffers.begin())
+    {
+        throw runtime_error("shuffle_buffer state for record " + std::to_string(stream_offset) +
+                            " is no longer available");
+    }
+    --it;
+    const saved_buffer& saved = it->second;
+
+    stringstream random;
+    random << saved.random;
+
+    // the source is restored at the earliest record still needed
+    size_t origin = saved.epoch_position - saved.pending;
+    for (size_t position : saved.positions)
+    {
+        origin = std::min(origin, position);
+    }
+
+    return {{"stream_offset", it->first},
+            {"epoch", saved.epoch},
+            {"epoch_position", saved.epoch_position},
+            {"end_of_data", saved.end_of_data},
+            {"random", random.str()},
+            {"positions", saved.positions},
+            {"pending", saved.pending},
+            {"origin", origin}};
+}
+
+void shuffle_buffer::set_state(const nlohmann::json& state, size_t stream_offset)
+{
+    if (m_epoch_record_count == 0)
+    {
+        throw runtime_error("shuffle_buffer state needs an epoch record count");
+    }
+
+    saved_buffer saved;
+    saved.epoch          = state.at("epoch");
+    saved.epoch_position = state.at("epoch_position");
+    saved.end_of_data    = state.at("end_of_data");
+    saved.positions      = state.at("positions").get<vector<size_t>>();
+    saved.pending        = state.at("pending");
+    stringstream random(state.at("random").get<string>());
+    random >> saved.random;
+
+    size_t start = state.at("stream_offset");
+    if (stream_offset < start || stream_offset - start >= m_output_size ||
+        saved.epoch_position > m_epoch_record_count || saved.pending > saved.epoch_position ||
+        any_of(saved.positions.begin(), saved.positions.end(), [&](size_t position) {
+            return position >= saved.epoch_position - saved.pending;
+        }))
+    {
+        throw invalid_argument("shuffle_buffer state is inconsistent");
+    }
+
+    m_start_buffer          = std::move(saved);
+    m_start_output_position = start;
+    m_skip_count            = stream_offset - start;
+    m_restore               = true;
+}
+
+void shuffle_buffer::release_states(size_t stream_offset)
+{
+    lock_guard<mutex> lock(m_state_mutex);
+    auto              it = m_saved_buffers.upper_bound(stream_offset);
+    if (it != m_saved_buffers.begin())
+    {
+        m_saved_buffers.erase(m_saved_buffers.begin(), --it);
+    }
+}
+
+void shuffle_buffer::restore_buffer()
+{
+    // pull the saved records again, from the earliest of them up to the saved epoch
+    // position, and put each back in its saved slot so the same draws pick the same records.
+    // The last ones read are the records that were still waiting to be added.
+    unordered_map<size_t, size_t> slots;
+    size_t pending_start = m_start_buffer.epoch_position - m_start_buffer.pending;
+    size_t position      = pending_start;
+    for (size_t i = 0; i < m_start_buffer.positions.size(); i++)
+    {
+        slots[m_start_buffer.positions[i]] = i;
+        position = std::min(position, m_start_buffer.positions[i]);
+    }
+
+    m_buffer.resize(m_start_buffer.positions.size());
+    m_pending.clear();
+    m_pending_next = 0;
+    while (position < m_start_buffer.epoch_position)
+    {
+        m_state                    = async_state::fetching_data;
+        encoded_record_list* input = m_source->next();
+        m_state                    = async_state::processing;
+        if (input == nullptr)
+        {
+            throw runtime_error("shuffle_buffer source ended before the saved buffer was read");
+        }
+
+        for (encoded_record& record : *input)
+        {
+            auto slot = slots.find(position);
+            if (position >= pending_start)
+            {
+                m_pending.push_back(std::move(record));
+            }
+            else if (slot != slots.end())
+            {
+                m_buffer[slot->second] = std::move(record);
+            }
+            position++;
+        }
+        input->clear();
+    }
+
+    m_positions      = std::move(m_start_buffer.positions);
+    m_epoch          = m_start_buffer.epoch;
+    m_epoch_position = m_start_buffer.epoch_position;
+    m_end_of_data    = m_start_buffer.end_of_data;
+    m_random         = m_start_buffer.random;
+    m_restore        = false;
+}
+
+encoded_record_list* shuffle_buffer::filler()
+{
+    m_state                 = async_state::wait_for_buffer;
+    encoded_record_list* rc = get_pending_buffer();
+    m_state                 = async_state::processing;
+
+    rc->clear();
+
+    if (m_restore)
+    {
+        restore_buffer();
+    }
+    if (m_epoch_record_count != 0)
+    {
+        lock_guard<mutex> lock(m_state_mutex);
+        m_saved_buffers[m_output_position] = {
+            m_epoch, m_epoch_position, m_end_of_data, m_random, m_positions, pending_count()};
+    }
+
+    // keep the buffer full, but do not mix the next epoch into the current one
+    while (m_buffer.size() < m_buffer_size)
+    {
+        if (pending_count() == 0)
+        {
+            m_pending.clear();
+            m_pending_next = 0;
+            if (m_end_of_data ||
+                (m_epoch_record_count != 0 && m_epoch_position >= m_epoch_record_count))
+            {
+                break;
+            }
+
+            m_state                    = async_state::fetching_data;
+            encoded_record_list* input = m_source->next();
+            m_state                    = async_state::processing;
+            if (input == nullptr)
+            {
+                m_end_of_data = true;
+                break;
+            }
+
+            for (encoded_record& record : *input)
+            {
+                m_pending.push_back(std::move(record));
+            }
+            m_epoch_position += m_pending.size();
+            input->clear();
+        }
+
+        m_positions.push_back(m_epoch_position - pending_count());
+        m_buffer.push_back(std::move(m_pending[m_pending_next++]));
+    }
+
+    // a restored stream may start part way into its first output list
+    size_t count = std::min(m_output_size, m_buffer.size());
+    for (size_t i = 0; i < count; i++)
+    {
+        std::uniform_int_distribution<size_t> distribution(0, m_buffer.size() - 1);
+        size_t                                index = distribution(m_random);
+        if (i >= m_skip_count)
+        {
+            rc->add_record(std::move(m_buffer[index]));
+        }
+        if (index != m_buffer.size() - 1)
+        {
+            m_buffer[index]    = std::move(m_buffer.back());
+            m_positions[index] = m_positions.back();
+        }
+        m_buffer.pop_back();
+        m_positions.pop_back();
+    }
+    m_output_position += count;
+    m_skip_count = 0;
+
+    if (m_epoch_record_count != 0 && m_epoch_position >= m_epoch_record_count &&
+        m_buffer.empty() && pending_count() == 0)
+    {
+        m_epoch_position -= m_epoch_record_count;
+        m_epoch++;
+    }
+
+    if (rc->size() == 0)
+    {
+        rc = nullptr;
+    }
+
+    m_state = async_state::idle;
+    return rc;
+}
@@ -0,0 +1,114 @@
+/*******************************************************************************
+* Copyright 2017-2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <random>
+#include <vector>
+
+#include "async_manager.hpp"
+#include "buffer_batch.hpp"
+#include "json.hpp"
+
+/* shuffle_buffer
+ *
+ * Shuffles records across blocks. Incoming blocks are added to a buffer of
+ * buffer_size records and each output list is filled with records drawn at
+ * random from the buffer. Larger buffers mix records from more blocks at the
+ * cost of holding more encoded records in memory. The records of a block that
+ * do not fit wait in source order until there is room, so at most
+ * block_size - 1 records are held beyond buffer_size.
+ *
+ * When epoch_record_count is set, records of the next epoch are not pulled in
+ * until the buffer has drained, so every epoch is a permutation of the dataset.
+ *
+ * With epoch_record_count set the buffer can also be saved and restored. A
+ * saved buffer holds the position in its epoch of every buffered record rather
+ * than the records, and the number of records waiting to be added. Restoring
+ * pulls the epoch again from the earliest of them, so the source must be
+ * positioned at the epoch and offset named in the state.
+ *
+ */
+
+namespace nervana
+{
+    class shuffle_buffer;
+}
+
+class nervana::shuffle_buffer : public async_manager<encoded_record_list, encoded_record_list>
+{
+public:
+    shuffle_buffer(std::shared_ptr<async_manager_source<encoded_record_list>> source,
+                   size_t   buffer_size,
+                   size_t   output_size,
+                   size_t   epoch_record_count = 0,
+                   uint32_t seed               = 0);
+
+    virtual ~shuffle_buffer() { finalize(); }
+    encoded_record_list* filler() override;
+
+    size_t record_count() const override { return m_output_size; }
+    size_t elements_per_record() const override { return m_elements_per_record; }
+    void   initialize() override;
+
+    // The buffer is saved before each output list is filled, numbered by the stream offset
+    // of the first record of the list, and kept until released. get_state() describes the
+    // list holding stream_offset and set_state() makes the stream continue from there.
+    nlohmann::json get_state(size_t stream_offset) const;
+    void           set_state(const nlohmann::json& state, size_t stream_offset);
+    void           release_states(size_t stream_offset);
+
+private:
+    struct saved_buffer
+    {
+        size_t              epoch;
+        size_t              epoch_position;
+        bool                end_of_data;
+        std::minstd_rand0   random;
+        std::vector<size_t> positions;
+        size_t              pending;
+    };
+
+    void   restore_buffer();
+    size_t pending_count() const { return m_pending.size() - m_pending_next; }
+
+    size_t                      m_buffer_size;
+    size_t                      m_output_size;
+    size_t                      m_epoch_record_count;
+    size_t                      m_elements_per_record;
+    size_t                      m_epoch_position{0};
+    bool                        m_end_of_data{false};
+    std::vector<encoded_record> m_buffer;
+    std::vector<size_t>         m_positions;
+    // records read from the source that did not fit in the buffer yet, the last ones
+    // read, so record m_pending_next is at epoch position m_epoch_position - pending_count()
+    std::vector<encoded_record> m_pending;
+    size_t                      m_pending_next{0};
+    uint32_t                    m_seed;
+    uint32_t                    m_reset_count{0};
+    std::minstd_rand0           m_random;
+
+    size_t                         m_epoch{0};
+    size_t                         m_output_position{0};
+    size_t                         m_skip_count{0};
+    bool                           m_restore{false};
+    saved_buffer                   m_start_buffer;
+    size_t                         m_start_output_position{0};
+    std::map<size_t, saved_buffer> m_saved_buffers;
+    mutable std::mutex             m_state_mutex;
+};
@@ -30,9 +30,20 @@ void specgram::wav_to_specgram(const Mat& wav_col_mat,
                                const Mat& window,
                                Mat&       specgram)
 {
-    // const Mat& wav_mat = wav.get_data();
+    real_fft fft(frame_length_tn);
+    wav_to_specgram(wav_col_mat, fft, frame_stride_tn, max_time_steps, window, specgram);
+}
+
+void specgram::wav_to_specgram(const Mat&      wav_col_mat,
+                               const real_fft& fft,
+                               const int       frame_stride_tn,
+                               const int       max_time_steps,
+                               const Mat&      window,
+                               Mat&            specgram)
+{
     // Read as a row vector
-    Mat wav_mat = wav_col_mat.reshape(1, 1);
+    Mat wav_mat = wav_col_mat.isContinuous() ? wav_col_mat.reshape(1, 1)
+                                             : wav_col_mat.clone().reshape(1, 1);
 
     // TODO: support more sample formats
     if (wav_mat.elemSize1() != 2)
@@ -41,48 +52,23 @@ void specgram::wav_to_specgram(const Mat& wav_col_mat,
                                  std::to_string(wav_mat.elemSize1()));
     }
 
-    // Go from time domain to strided signal
-    Mat wav_frames;
-    {
-        int num_frames = ((wav_mat.cols - frame_length_tn) / frame_stride_tn) + 1;
-        num_frames     = std::min(num_frames, max_time_steps);
-        // ensure that there is enough data for at least one frame
-        affirm(num_frames >= 0, "number of frames is negative");
-
-        wav_frames.create(num_frames, frame_length_tn, wav_mat.type());
-        for (int frame = 0; frame < num_frames; frame++)
-        {
-            int start = frame * frame_stride_tn;
-            int end   = start + frame_length_tn;
-            wav_mat.colRange(start, end).copyTo(wav_frames.row(frame));
-        }
-    }
-
-    // Prepare for DFT by converting to float
-    Mat input;
-    wav_frames.convertTo(input, CV_32FC1);
+    int frame_length_tn = fft.size();
+    int num_frames      = ((wav_mat.cols - frame_length_tn) / frame_stride_tn) + 1;
+    num_frames          = std::min(num_frames, max_time_steps);
+    // ensure that there is enough data for at least one frame
+    affirm(num_frames >= 0, "number of frames is negative");
 
     // Apply window if it has been created
-    if (window.cols == frame_length_tn)
+    const float* win = window.cols == frame_length_tn ? window.ptr<float>() : nullptr;
+
+    // Each frame is read where it is in the signal and windowed as it is converted to float
+    // NOTE: the specgram is in (time_steps, freq_steps) shape order.
+    specgram.create(num_frames, fft.bins(), CV_32FC1);
+    const int16_t* samples = wav_mat.ptr<int16_t>();
+    for (int frame = 0; frame < num_frames; frame++)
     {
-        input = input.mul(cv::repeat(window, input.rows, 1));
+        fft.magnitude(samples + frame * frame_stride_tn, win, specgram.ptr<float>(frame));
     }
-
-    Mat planes[] = {input, Mat::zeros(input.size(), CV_32FC1)};
-    Mat compx;
-    cv::merge(planes, 2, compx);
-    cv::dft(compx, compx, cv::DFT_ROWS);
-    compx = compx(Range::all(), Range(0, frame_length_tn / 2 + 1));
-
-    cv::split(compx, planes);
-    cv::magnitude(planes[0], planes[1], planes[0]);
-
-    // NOTE: at this point we are returning the specgram representation in
-    // (time_steps, freq_steps) shape order.
-
-    specgram = planes[0];
-
-    return;
 }
 
 /** \brief Create an array of frequency weights to convert from linear
@@ -187,3 +173,102 @@ void specgram::create_window(const std::string& window_type, const int n, Mat& w
         }
     }
 }
+
+mel_filterbank::mel_filterbank(const Mat& filter_bank, int num_cepstra)
+    : m_num_freqs{filter_bank.rows}
+    , m_num_filters{filter_bank.cols}
+    , m_num_cepstra{num_cepstra}
+{
+    affirm(filter_bank.type() == CV_32FC1, "filter bank must be float");
+    affirm(num_cepstra <= m_num_filters, "num_cepstra <= num_filters");
+
+    m_offset.push_back(0);
+    for (int j = 0; j < m_num_filters; j++)
+    {
+        int first = 0;
+        int last  = -1;
+        for (int i = 0; i < m_num_freqs; i++)
+        {
+            if (filter_bank.at<float>(i, j) != 0)
+            {
+                first = last < 0 ? i : first;
+                last  = i;
+            }
+        }
+        m_start.push_back(first);
+        for (int i = first; i <= last; i++)
+        {
+            m_weights.push_back(filter_bank.at<float>(i, j));
+        }
+        m_offset.push_back(m_weights.size());
+    }
+
+    // orthonormal DCT-II as done by cv::dct, which needs an even length so an odd number of
+    // filters is padded with a zero
+    int n = m_num_filters + m_num_filters % 2;
+    m_dct.resize(m_num_cepstra * m_num_filters);
+    for (int k = 0; k < m_num_cepstra; k++)
+    {
+        double scale = std::sqrt((k == 0 ? 1.0 : 2.0) / n);
+        for (int j = 0; j < m_num_filters; j++)
+        {
+            m_dct[k * m_num_filters + j] = scale * std::cos(CV_PI * (2 * j + 1) * k / (2.0 * n));
+        }
+    }
+}
+
+void mel_filterbank::frame(const float* magnitudes, float* out, bool cepstra) const
+{
+    thread_local vector<float> energies;
+    energies.resize(m_num_filters);
+    float* mel = cepstra ? energies.data() : out;
+
+    // power spectrum scaled by the fft length
+    const float scale = 1.0f / (2 * (m_num_freqs - 1));
+    for (int j = 0; j < m_num_filters; j++)
+    {
+        const float* m      = magnitudes + m_start[j];
+        const float* w      = &m_weights[m_offset[j]];
+        int          length = m_offset[j + 1] - m_offset[j];
+        float        sum    = 0;
+        for (int i = 0; i < length; i++)
+        {
+            sum += m[i] * m[i] * w[i];
+        }
+        mel[j] = std::log(sum * scale);
+    }
+
+    if (cepstra)
+    {
+        for (int k = 0; k < m_num_cepstra; k++)
+        {
+            const float* d   = &m_dct[k * m_num_filters];
+            float        sum = 0;
+            for (int j = 0; j < m_num_filters; j++)
+            {
+                sum += d[j] * mel[j];
+            }
+            out[k] = sum;
+        }
+    }
+}
+
+void mel_filterbank::mfsc(const Mat& specgram, Mat& mfsc) const
+{
+    affirm(specgram.cols == m_num_freqs, "specgram does not match the filterbank");
+    mfsc.create(specgram.rows, m_num_filters, CV_32FC1);
+    for (int row = 0; row < specgram.rows; row++)
+    {
+        frame(specgram.ptr<float>(row), mfsc.ptr<float>(row), false);
+    }
+}
+
+void mel_filterbank::mfcc(const Mat& specgram, Mat& mfcc) const
+{
+    affirm(specgram.cols == m_num_freqs, "specgram does not match the filterbank");
+    mfcc.create(specgram.rows, m_num_cepstra, CV_32FC1);
+    for (int row = 0; row < specgram.rows; row++)
+    {
+        frame(specgram.ptr<float>(row), mfcc.ptr<float>(row), true);
+    }
+}
@@ -19,16 +19,20 @@
 #include <sstream>
 #include <math.h>
 #include <memory>
+#include <vector>
 #include <opencv2/core/core.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 
 #include <cmath>
 
+#include "fft.hpp"
+
 static_assert(sizeof(short) == 2, "Unsupported platform");
 
 namespace nervana
 {
     class specgram;
+    class mel_filterbank;
 }
 
 class nervana::specgram
@@ -43,6 +47,15 @@ public:
                                 const cv::Mat& window,
                                 cv::Mat&       specgram);
 
+    // Frames the samples in place and writes the magnitudes of their fft straight into
+    // specgram, so keeping the plan avoids all per record setup
+    static void wav_to_specgram(const cv::Mat&  wav_mat,
+                                const real_fft& fft,
+                                const int       frame_stride_tn,
+                                const int       max_time_steps,
+                                const cv::Mat&  window,
+                                cv::Mat&        specgram);
+
     static void specgram_to_cepsgram(const cv::Mat& specgram,
                                      const cv::Mat& filter_bank,
                                      cv::Mat&       cepsgram);
@@ -66,3 +79,34 @@ private:
         return 700 * (std::pow(10, freq_mel / 2595.0) - 1);
     }
 };
+
+/**
+ * \brief Mel filterbank stored as the band of nonzero weights of each filter
+ *
+ * Goes from a magnitude spectrogram to log mel energies (mfsc) and their dct (mfcc) one
+ * frame at a time, without the dense matrix product, separate log and padded dct of
+ * specgram::specgram_to_cepsgram and specgram::cepsgram_to_mfcc.  Results match those
+ * within float rounding.
+ */
+class nervana::mel_filterbank
+{
+public:
+    // From a num_freqs x num_filters filterbank made by specgram::create_filterbanks
+    mel_filterbank(const cv::Mat& filter_bank, int num_cepstra);
+
+    void mfsc(const cv::Mat& specgram, cv::Mat& mfsc) const;
+    void mfcc(const cv::Mat& specgram, cv::Mat& mfcc) const;
+
+    // Writes the num_filters log mel energies of one frame of num_freqs magnitudes, or
+    // their first num_cepstra dct coefficients when cepstra is set
+    void frame(const float* magnitudes, float* out, bool cepstra) const;
+
+private:
+    int                m_num_freqs;
+    int                m_num_filters;
+    int                m_num_cepstra;
+    std::vector<int>   m_start;   // first nonzero frequency of each filter
+    std::vector<int>   m_offset;  // of each filter's weights, with one past the last at the end
+    std::vector<float> m_weights; // the nonzero band of each filter
+    std::vector<float> m_dct;     // num_cepstra x num_filters
+};
@@ -125,6 +125,8 @@ public:
             thread.join();
     }
 
+    int get_thread_count() const { return m_threads.size(); }
+
     void run(T* worker, int task_count)
     {
         m_worker          = worker;
@@ -141,7 +143,7 @@ private:
     const int                       m_max_count_of_free_threads = 2;
     const int                       m_free_threads_ratio        = 8;
     T*                              m_worker;
-    int                             m_task_count;
+    int                             m_task_count{0};
     std::unique_ptr<thread_barrier> m_br_wake;
     std::unique_ptr<thread_barrier> m_br_endtasks;
     std::atomic<bool>               m_thread_pool_stop{false};
@@ -215,6 +217,8 @@ public:
         m_thread.join();
     }
 
+    int get_thread_count() const { return m_thread_pool.get_thread_count(); }
+
     void run(T* worker, int task_count)
     {
         std::packaged_task<void()> task(
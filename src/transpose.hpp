@@ -14,12 +14,96 @@
 * limitations under the License.
 *******************************************************************************/
 
+#include <algorithm>
+#include <cstddef>
 #include <cstdint>
+#include <stdexcept>
 #include <immintrin.h>
 #include <xmmintrin.h>
 
+#include "cpu_features.hpp"
+
+/**
+ * Transposes a rows x cols matrix, e.g. a batch of records into feature major order.
+ *
+ * The matrix is walked in cache sized tiles of square blocks, each transposed in
+ * registers by a kernel for the element size.  The kernels for 4 and 8 byte elements
+ * come in SSE, AVX2 and AVX-512 versions picked at run time.  Rows and columns past
+ * the last whole block are copied one element at a time.
+ */
 namespace transpose
 {
+    enum class isa
+    {
+        regular,
+        sse,
+        avx2,
+        avx512
+    };
+
+    // Best instruction set this CPU supports
+    inline isa best_isa()
+    {
+        static const isa best = nervana::cpu::has_avx512f()
+                                    ? isa::avx512
+                                    : nervana::cpu::has_avx2() ? isa::avx2 : isa::sse;
+        return best;
+    }
+
+    // Transposes the elements in rows [r0, r1) and columns [c0, c1)
+    template <typename T>
+    inline void regular(T* dest, const T* src, size_t rows, size_t cols, size_t r0, size_t r1,
+                        size_t c0, size_t c1)
+    {
+        for (size_t c = c0; c < c1; c++)
+        {
+            T*       d = dest + c * rows;
+            const T* s = src + c;
+            for (size_t r = r0; r < r1; r++)
+            {
+                d[r] = s[r * cols];
+            }
+        }
+    }
+
+    // Kernel::strip transposes the block of Kernel::block rows starting at row r for
+    // the columns [c0, c1), which is a whole number of blocks.  Columns [c0, c1) of the
+    // matrix are transposed, so separate column ranges can be done in parallel.  The rows
+    // of dest are dest_rows elements apart.
+    template <typename T, typename Kernel>
+    inline void blocked(T*       dest,
+                        const T* src,
+                        size_t   rows,
+                        size_t   cols,
+                        size_t   c0,
+                        size_t   c1,
+                        size_t   dest_rows)
+    {
+        // 64 x 64 tiles keep the source and destination rows being worked on in cache
+        const size_t tile       = 64;
+        const size_t block      = Kernel::block;
+        const size_t block_rows = rows - rows % block;
+        const size_t block_cols = c1 - (c1 - c0) % block;
+
+        uint8_t*       d = reinterpret_cast<uint8_t*>(dest);
+        const uint8_t* s = reinterpret_cast<const uint8_t*>(src);
+        for (size_t rt = 0; rt < block_rows; rt += tile)
+        {
+            size_t r_end = std::min(rt + tile, block_rows);
+            for (size_t ct = c0; ct < block_cols; ct += tile)
+            {
+                size_t c_end = std::min(ct + tile, block_cols);
+                for (size_t r = rt; r < r_end; r += block)
+                {
+                    Kernel::strip(d, s, dest_rows, cols, r, ct, c_end);
+                }
+            }
+        }
+
+        regular(dest, src, dest_rows, cols, 0, block_rows, block_cols, c1);
+        regular(dest, src, dest_rows, cols, block_rows, rows, c0, c1);
+    }
+
     namespace sse
     {
 #define combine_4_2bits(n0, n1, n2, n3) (n0 + (n1 << 2) + (n2 << 4) + (n3 << 6))
@@ -27,14 +111,15 @@ namespace transpose
 #define _128i_shuffle(x, y, n0, n1, n2, n3)                                                        \
     _mm_castps_si128(_128_shuffle(_mm_castsi128_ps(x), _mm_castsi128_ps(y), n0, n1, n2, n3))
 
+        // buffers need not be aligned
         inline void _128i_store(unsigned char* p, __m128i x)
         {
-            _mm_store_si128(reinterpret_cast<__m128i*>(p), x);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(p), x);
         }
 
         inline __m128i _128i_load(const unsigned char* p)
         {
-            return _mm_load_si128(reinterpret_cast<const __m128i*>(p));
+            return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
         }
 
         template <int  K>
@@ -51,13 +136,6 @@ namespace transpose
             return _mm_shuffle_epi8(m, y);
         }
 
-        template <>
-        inline __m128i transpose_4x4<2>(__m128i m)
-        {
-            __m128i y = _mm_setr_epi8(0, 1, 8, 9, 2, 3, 10, 11, 4, 5, 12, 13, 6, 7, 14, 15);
-            return _mm_shuffle_epi8(m, y);
-        }
-
         template <int K>
         inline void transpose_4x4_dwords(__m128i  w0,
                                          __m128i  w1,
@@ -95,26 +173,6 @@ namespace transpose
             r3         = _128i_shuffle(x1, x3, 1, 3, 1, 3);
         }
 
-        template <>
-        inline void transpose_4x4_dwords<2>(__m128i  w0,
-                                            __m128i  w1,
-                                            __m128i  w2,
-                                            __m128i  w3,
-                                            __m128i& r0,
-                                            __m128i& r1,
-                                            __m128i& r2,
-                                            __m128i& r3)
-        {
-            // 0  1  2  3
-            // 4  5  6  7
-            // 8  9  10 11
-            // 12 13 14 15
-            r0 = _128i_shuffle(w0, w1, 0, 1, 0, 1); // 0 1 4 5
-            r1 = _128i_shuffle(w0, w1, 2, 3, 2, 3); // 2 3 6 7
-            r2 = _128i_shuffle(w2, w3, 0, 1, 0, 1); // 8 9 12 13
-            r3 = _128i_shuffle(w2, w3, 2, 3, 2, 3); // 10 11 14 15
-        }
-
         template <int K>
         inline void transpose_16x16(__m128i x[16])
         {
@@ -140,112 +198,412 @@ namespace transpose
             transpose_4x4_dwords<1>(w[0][3], w[1][3], w[2][3], w[3][3], x[12], x[13], x[14], x[15]);
         }
 
-        template <>
-        inline void transpose_16x16<2>(__m128i x[16])
+        struct kernel_1
         {
-            __m128i w[4][4];
-            transpose_4x4_dwords<2>(x[0], x[1], x[8], x[9], w[0][0], w[0][1], w[0][2], w[0][3]);
-            transpose_4x4_dwords<2>(x[2], x[3], x[10], x[11], w[1][0], w[1][1], w[1][2], w[1][3]);
-            transpose_4x4_dwords<2>(x[4], x[5], x[12], x[13], w[2][0], w[2][1], w[2][2], w[2][3]);
-            transpose_4x4_dwords<2>(x[6], x[7], x[14], x[15], w[3][0], w[3][1], w[3][2], w[3][3]);
-
-            for (int row = 0; row < 4; ++row)
-                for (int col    = 0; col < 4; ++col)
-                    w[row][col] = transpose_4x4<2>(w[row][col]);
-
-            transpose_4x4_dwords<1>(w[0][0], w[1][0], w[2][0], w[3][0], x[0], x[1], x[2], x[3]);
-            transpose_4x4_dwords<1>(w[0][1], w[1][1], w[2][1], w[3][1], x[4], x[5], x[6], x[7]);
-            transpose_4x4_dwords<1>(w[0][2], w[1][2], w[2][2], w[3][2], x[8], x[9], x[10], x[11]);
-            transpose_4x4_dwords<1>(w[0][3], w[1][3], w[2][3], w[3][3], x[12], x[13], x[14], x[15]);
-        }
+            static const size_t block = 16;
+            static void strip(uint8_t*       dest,
+                              const uint8_t* src,
+                              size_t         rows,
+                              size_t         cols,
+                              size_t         r,
+                              size_t         c0,
+                              size_t         c1)
+            {
+                __m128i x[16];
+                for (size_t c = c0; c < c1; c += block)
+                {
+                    const uint8_t* s = src + r * cols + c;
+                    uint8_t*       d = dest + c * rows + r;
+                    for (int i = 0; i < 16; i++)
+                    {
+                        x[i] = _128i_load(s + i * cols);
+                    }
+                    transpose_16x16<1>(x);
+                    for (int i = 0; i < 16; i++)
+                    {
+                        _128i_store(d + i * rows, x[i]);
+                    }
+                }
+            }
+        };
 
-        template <int K>
-        inline void transpose(uint8_t* dest, const uint8_t* src, int rows, int cols)
+        struct kernel_2
         {
-            throw "unsupported datatype for transpose";
-        }
+            static const size_t block = 8;
+            static void strip(uint8_t*       dest,
+                              const uint8_t* src,
+                              size_t         rows,
+                              size_t         cols,
+                              size_t         r,
+                              size_t         c0,
+                              size_t         c1)
+            {
+                for (size_t c = c0; c < c1; c += block)
+                {
+                    const uint8_t* s = src + (r * cols + c) * 2;
+                    uint8_t*       d = dest + (c * rows + r) * 2;
+                    __m128i        a[8], b[8], e[8];
+                    for (int i = 0; i < 8; i++)
+                    {
+                        a[i] = _128i_load(s + i * cols * 2);
+                    }
+                    for (int i = 0; i < 8; i += 2)
+                    {
+                        b[i]     = _mm_unpacklo_epi16(a[i], a[i + 1]);
+                        b[i + 1] = _mm_unpackhi_epi16(a[i], a[i + 1]);
+                    }
+                    for (int i = 0; i < 8; i += 4)
+                    {
+                        e[i]     = _mm_unpacklo_epi32(b[i], b[i + 2]);
+                        e[i + 1] = _mm_unpackhi_epi32(b[i], b[i + 2]);
+                        e[i + 2] = _mm_unpacklo_epi32(b[i + 1], b[i + 3]);
+                        e[i + 3] = _mm_unpackhi_epi32(b[i + 1], b[i + 3]);
+                    }
+                    for (int i = 0; i < 4; i++)
+                    {
+                        _128i_store(d + (2 * i) * rows * 2, _mm_unpacklo_epi64(e[i], e[i + 4]));
+                        _128i_store(d + (2 * i + 1) * rows * 2,
+                                    _mm_unpackhi_epi64(e[i], e[i + 4]));
+                    }
+                }
+            }
+        };
 
-        template <>
-        inline void transpose<1>(uint8_t* dest, const uint8_t* src, int rows, int cols)
+        struct kernel_4
         {
-            const int block_size = 16;
-            __m128i   row[block_size];
-            for (int cb = 0; cb < cols; cb += block_size)
+            static const size_t block = 4;
+            static void strip(uint8_t*       dest,
+                              const uint8_t* src,
+                              size_t         rows,
+                              size_t         cols,
+                              size_t         r,
+                              size_t         c0,
+                              size_t         c1)
             {
-                int cbrows = cb * rows;
-                for (int rb = 0; rb < rows; rb += block_size)
+                for (size_t c = c0; c < c1; c += block)
                 {
-                    const uint8_t* src_c = src + rb * cols + cb;
-                    uint8_t*       dst_c = dest + cbrows + rb;
-
-                    for (int i = 0; i < block_size; i++, src_c += cols)
-                        row[i] = _128i_load(src_c);
-
-                    transpose_16x16<1>(row);
-
-                    for (int i = 0; i < block_size; i++, dst_c += rows)
-                        _128i_store(dst_c, row[i]);
+                    const float* s = reinterpret_cast<const float*>(src) + r * cols + c;
+                    float*       d = reinterpret_cast<float*>(dest) + c * rows + r;
+                    __m128       row0 = _mm_loadu_ps(s);
+                    __m128       row1 = _mm_loadu_ps(s + cols);
+                    __m128       row2 = _mm_loadu_ps(s + cols * 2);
+                    __m128       row3 = _mm_loadu_ps(s + cols * 3);
+                    _MM_TRANSPOSE4_PS(row0, row1, row2, row3);
+                    _mm_storeu_ps(d, row0);
+                    _mm_storeu_ps(d + rows, row1);
+                    _mm_storeu_ps(d + rows * 2, row2);
+                    _mm_storeu_ps(d + rows * 3, row3);
                 }
             }
-        }
+        };
 
-        template <>
-        inline void transpose<2>(uint8_t* dest, const uint8_t* src, int rows, int cols)
+        struct kernel_8
         {
-            const int block_size = 16;
-            __m128i   row[2][block_size];
-            for (int cb = 0; cb < cols * 2; cb += block_size * 2)
+            static const size_t block = 2;
+            static void strip(uint8_t*       dest,
+                              const uint8_t* src,
+                              size_t         rows,
+                              size_t         cols,
+                              size_t         r,
+                              size_t         c0,
+                              size_t         c1)
             {
-                int cbrows = cb * rows;
-                for (int rb = 0; rb < rows; rb += block_size)
+                for (size_t c = c0; c < c1; c += block)
                 {
-                    int            rbcols = rb * cols;
-                    const uint8_t* src_c  = src + rbcols + cb;
-                    const uint8_t* src_c2 = src + rbcols + cb + block_size;
-                    uint8_t*       dst_c  = dest + cbrows + rb;
-
-                    for (int i = 0; i < block_size; i++, src_c += cols * 2, src_c2 += cols * 2)
-                    {
-                        row[0][i] = _128i_load(src_c);
-                        row[1][i] = _128i_load(src_c2);
-                    }
-
-                    transpose_16x16<2>(row[0]);
-                    transpose_16x16<2>(row[1]);
-                    for (int x = 0; x < 2; ++x)
-                        for (int i = 0; i < block_size / 2; i++, dst_c += rows)
-                        {
-                            _128i_store(dst_c, row[x][i]);
-                            dst_c += rows;
-                            _128i_store(dst_c, row[x][i + 8]);
-                        }
+                    const uint8_t* s    = src + (r * cols + c) * 8;
+                    uint8_t*       d    = dest + (c * rows + r) * 8;
+                    __m128i        row0 = _128i_load(s);
+                    __m128i        row1 = _128i_load(s + cols * 8);
+                    _128i_store(d, _mm_unpacklo_epi64(row0, row1));
+                    _128i_store(d + rows * 8, _mm_unpackhi_epi64(row0, row1));
                 }
             }
-        }
+        };
+    }
 
-        template <>
-        inline void transpose<4>(uint8_t* dest, const uint8_t* src, int rows, int cols)
+    namespace avx2
+    {
+        struct kernel_4
         {
-            cols *= 4;
-            const int block_size = 4;
-            __m128i   row[4];
-            for (int cb = 0; cb < cols; cb += block_size * 4)
+            static const size_t block = 8;
+            __attribute__((target("avx2"))) static void strip(uint8_t*       dest,
+                                                              const uint8_t* src,
+                                                              size_t         rows,
+                                                              size_t         cols,
+                                                              size_t         r,
+                                                              size_t         c0,
+                                                              size_t         c1)
             {
-                int cbrows = cb * rows;
-                for (int rb = 0; rb < rows; rb += block_size)
+                for (size_t c = c0; c < c1; c += block)
                 {
-                    const uint8_t* src_c = src + rb * cols + cb;
-                    uint8_t*       dst_c = dest + cbrows + rb * 4;
+                    const uint8_t* s = src + (r * cols + c) * 4;
+                    uint8_t*       d = dest + (c * rows + r) * 4;
+                    __m256i        a[8], b[8], e[8];
+                    for (int i = 0; i < 8; i++)
+                    {
+                        a[i] = _mm256_loadu_si256(
+                            reinterpret_cast<const __m256i*>(s + i * cols * 4));
+                    }
+                    for (int i = 0; i < 8; i += 2)
+                    {
+                        b[i]     = _mm256_unpacklo_epi32(a[i], a[i + 1]);
+                        b[i + 1] = _mm256_unpackhi_epi32(a[i], a[i + 1]);
+                    }
+                    // each 128 bit lane now holds one column of four rows
+                    for (int i = 0; i < 8; i += 4)
+                    {
+                        e[i]     = _mm256_unpacklo_epi64(b[i], b[i + 2]);
+                        e[i + 1] = _mm256_unpackhi_epi64(b[i], b[i + 2]);
+                        e[i + 2] = _mm256_unpacklo_epi64(b[i + 1], b[i + 3]);
+                        e[i + 3] = _mm256_unpackhi_epi64(b[i + 1], b[i + 3]);
+                    }
+                    for (int i = 0; i < 4; i++)
+                    {
+                        __m256i low  = _mm256_permute2x128_si256(e[i], e[i + 4], 0x20);
+                        __m256i high = _mm256_permute2x128_si256(e[i], e[i + 4], 0x31);
+                        _mm256_storeu_si256(reinterpret_cast<__m256i*>(d + i * rows * 4), low);
+                        _mm256_storeu_si256(reinterpret_cast<__m256i*>(d + (i + 4) * rows * 4),
+                                            high);
+                    }
+                }
+            }
+        };
 
-                    for (int i = 0; i < block_size; i++, src_c += cols)
-                        row[i] = _128i_load(src_c);
+        struct kernel_8
+        {
+            static const size_t block = 4;
+            __attribute__((target("avx2"))) static void strip(uint8_t*       dest,
+                                                              const uint8_t* src,
+                                                              size_t         rows,
+                                                              size_t         cols,
+                                                              size_t         r,
+                                                              size_t         c0,
+                                                              size_t         c1)
+            {
+                for (size_t c = c0; c < c1; c += block)
+                {
+                    const uint8_t* s = src + (r * cols + c) * 8;
+                    uint8_t*       d = dest + (c * rows + r) * 8;
+                    __m256i        a[4], b[4];
+                    for (int i = 0; i < 4; i++)
+                    {
+                        a[i] = _mm256_loadu_si256(
+                            reinterpret_cast<const __m256i*>(s + i * cols * 8));
+                    }
+                    b[0] = _mm256_unpacklo_epi64(a[0], a[1]);
+                    b[1] = _mm256_unpackhi_epi64(a[0], a[1]);
+                    b[2] = _mm256_unpacklo_epi64(a[2], a[3]);
+                    b[3] = _mm256_unpackhi_epi64(a[2], a[3]);
+                    for (int i = 0; i < 2; i++)
+                    {
+                        __m256i low  = _mm256_permute2x128_si256(b[i], b[i + 2], 0x20);
+                        __m256i high = _mm256_permute2x128_si256(b[i], b[i + 2], 0x31);
+                        _mm256_storeu_si256(reinterpret_cast<__m256i*>(d + i * rows * 8), low);
+                        _mm256_storeu_si256(reinterpret_cast<__m256i*>(d + (i + 2) * rows * 8),
+                                            high);
+                    }
+                }
+            }
+        };
+    }
 
-                    _MM_TRANSPOSE4_PS(row[0], row[1], row[2], row[3]);
+    namespace avx512
+    {
+        struct kernel_4
+        {
+            static const size_t block = 16;
+            __attribute__((target("avx512f"))) static void strip(uint8_t*       dest,
+                                                                 const uint8_t* src,
+                                                                 size_t         rows,
+                                                                 size_t         cols,
+                                                                 size_t         r,
+                                                                 size_t         c0,
+                                                                 size_t         c1)
+            {
+                for (size_t c = c0; c < c1; c += block)
+                {
+                    const uint8_t* s = src + (r * cols + c) * 4;
+                    uint8_t*       d = dest + (c * rows + r) * 4;
+                    __m512i        a[16], b[16];
+                    for (int i = 0; i < 16; i++)
+                    {
+                        a[i] = _mm512_loadu_si512(s + i * cols * 4);
+                    }
+                    for (int i = 0; i < 16; i += 2)
+                    {
+                        b[i]     = _mm512_unpacklo_epi32(a[i], a[i + 1]);
+                        b[i + 1] = _mm512_unpackhi_epi32(a[i], a[i + 1]);
+                    }
+                    // each 128 bit lane now holds one column of four rows
+                    for (int i = 0; i < 16; i += 4)
+                    {
+                        a[i]     = _mm512_unpacklo_epi64(b[i], b[i + 2]);
+                        a[i + 1] = _mm512_unpackhi_epi64(b[i], b[i + 2]);
+                        a[i + 2] = _mm512_unpacklo_epi64(b[i + 1], b[i + 3]);
+                        a[i + 3] = _mm512_unpackhi_epi64(b[i + 1], b[i + 3]);
+                    }
+                    // gather the lanes of a column, first in pairs then all four
+                    for (int j = 0; j < 4; j++)
+                    {
+                        b[j]      = _mm512_shuffle_i32x4(a[j], a[j + 4], 0x88);
+                        b[j + 4]  = _mm512_shuffle_i32x4(a[j], a[j + 4], 0xDD);
+                        b[j + 8]  = _mm512_shuffle_i32x4(a[j + 8], a[j + 12], 0x88);
+                        b[j + 12] = _mm512_shuffle_i32x4(a[j + 8], a[j + 12], 0xDD);
+                    }
+                    for (int j = 0; j < 4; j++)
+                    {
+                        _mm512_storeu_si512(d + j * rows * 4,
+                                            _mm512_shuffle_i32x4(b[j], b[j + 8], 0x88));
+                        _mm512_storeu_si512(d + (j + 8) * rows * 4,
+                                            _mm512_shuffle_i32x4(b[j], b[j + 8], 0xDD));
+                        _mm512_storeu_si512(d + (j + 4) * rows * 4,
+                                            _mm512_shuffle_i32x4(b[j + 4], b[j + 12], 0x88));
+                        _mm512_storeu_si512(d + (j + 12) * rows * 4,
+                                            _mm512_shuffle_i32x4(b[j + 4], b[j + 12], 0xDD));
+                    }
+                }
+            }
+        };
 
-                    for (int i = 0; i < block_size; i++, dst_c += (rows * 4))
-                        _128i_store(dst_c, row[i]);
+        struct kernel_8
+        {
+            static const size_t block = 8;
+            __attribute__((target("avx512f"))) static void strip(uint8_t*       dest,
+                                                                 const uint8_t* src,
+                                                                 size_t         rows,
+                                                                 size_t         cols,
+                                                                 size_t         r,
+                                                                 size_t         c0,
+                                                                 size_t         c1)
+            {
+                for (size_t c = c0; c < c1; c += block)
+                {
+                    const uint8_t* s = src + (r * cols + c) * 8;
+                    uint8_t*       d = dest + (c * rows + r) * 8;
+                    __m512i        a[8], b[8];
+                    for (int i = 0; i < 8; i++)
+                    {
+                        a[i] = _mm512_loadu_si512(s + i * cols * 8);
+                    }
+                    // each 128 bit lane now holds one column of two rows
+                    for (int i = 0; i < 8; i += 2)
+                    {
+                        b[i]     = _mm512_unpacklo_epi64(a[i], a[i + 1]);
+                        b[i + 1] = _mm512_unpackhi_epi64(a[i], a[i + 1]);
+                    }
+                    for (int j = 0; j < 2; j++)
+                    {
+                        a[j]     = _mm512_shuffle_i64x2(b[j], b[j + 2], 0x88);
+                        a[j + 2] = _mm512_shuffle_i64x2(b[j], b[j + 2], 0xDD);
+                        a[j + 4] = _mm512_shuffle_i64x2(b[j + 4], b[j + 6], 0x88);
+                        a[j + 6] = _mm512_shuffle_i64x2(b[j + 4], b[j + 6], 0xDD);
+                    }
+                    for (int j = 0; j < 2; j++)
+                    {
+                        _mm512_storeu_si512(d + j * rows * 8,
+                                            _mm512_shuffle_i64x2(a[j], a[j + 4], 0x88));
+                        _mm512_storeu_si512(d + (j + 4) * rows * 8,
+                                            _mm512_shuffle_i64x2(a[j], a[j + 4], 0xDD));
+                        _mm512_storeu_si512(d + (j + 2) * rows * 8,
+                                            _mm512_shuffle_i64x2(a[j + 2], a[j + 6], 0x88));
+                        _mm512_storeu_si512(d + (j + 6) * rows * 8,
+                                            _mm512_shuffle_i64x2(a[j + 2], a[j + 6], 0xDD));
+                    }
                 }
             }
+        };
+    }
+
+    // Transposes columns [c0, c1) of the rows x cols matrix of element_size byte elements
+    // at src into dest, whose rows are dest_rows elements apart, using at most the
+    // instruction set level
+    inline void transpose_columns(void*       dest,
+                                  size_t      dest_rows,
+                                  const void* src,
+                                  size_t      rows,
+                                  size_t      cols,
+                                  size_t      element_size,
+                                  size_t      c0,
+                                  size_t      c1,
+                                  isa         level)
+    {
+        switch (element_size)
+        {
+        case 1:
+        {
+            auto d = static_cast<uint8_t*>(dest);
+            auto s = static_cast<const uint8_t*>(src);
+            if (level >= isa::sse)
+                blocked<uint8_t, sse::kernel_1>(d, s, rows, cols, c0, c1, dest_rows);
+            else
+                regular(d, s, dest_rows, cols, 0, rows, c0, c1);
+            break;
+        }
+        case 2:
+        {
+            auto d = static_cast<uint16_t*>(dest);
+            auto s = static_cast<const uint16_t*>(src);
+            if (level >= isa::sse)
+                blocked<uint16_t, sse::kernel_2>(d, s, rows, cols, c0, c1, dest_rows);
+            else
+                regular(d, s, dest_rows, cols, 0, rows, c0, c1);
+            break;
+        }
+        case 4:
+        {
+            auto d = static_cast<uint32_t*>(dest);
+            auto s = static_cast<const uint32_t*>(src);
+            if (level >= isa::avx512)
+                blocked<uint32_t, avx512::kernel_4>(d, s, rows, cols, c0, c1, dest_rows);
+            else if (level >= isa::avx2)
+                blocked<uint32_t, avx2::kernel_4>(d, s, rows, cols, c0, c1, dest_rows);
+            else if (level >= isa::sse)
+                blocked<uint32_t, sse::kernel_4>(d, s, rows, cols, c0, c1, dest_rows);
+            else
+                regular(d, s, dest_rows, cols, 0, rows, c0, c1);
+            break;
         }
+        case 8:
+        {
+            auto d = static_cast<uint64_t*>(dest);
+            auto s = static_cast<const uint64_t*>(src);
+            if (level >= isa::avx512)
+                blocked<uint64_t, avx512::kernel_8>(d, s, rows, cols, c0, c1, dest_rows);
+            else if (level >= isa::avx2)
+                blocked<uint64_t, avx2::kernel_8>(d, s, rows, cols, c0, c1, dest_rows);
+            else if (level >= isa::sse)
+                blocked<uint64_t, sse::kernel_8>(d, s, rows, cols, c0, c1, dest_rows);
+            else
+                regular(d, s, dest_rows, cols, 0, rows, c0, c1);
+            break;
+        }
+        default: throw std::invalid_argument("unsupported datatype for transpose");
+        }
+    }
+
+    // Transposes columns [c0, c1) of the rows x cols matrix of element_size byte elements
+    // at src into dest, using at most the instruction set level
+    inline void transpose_columns(void*       dest,
+                                  const void* src,
+                                  size_t      rows,
+                                  size_t      cols,
+                                  size_t      element_size,
+                                  size_t      c0,
+                                  size_t      c1,
+                                  isa         level = best_isa())
+    {
+        transpose_columns(dest, rows, src, rows, cols, element_size, c0, c1, level);
+    }
+
+    // Transposes the rows x cols matrix of element_size byte elements at src into dest,
+    // using at most the instruction set level
+    inline void transpose(void*       dest,
+                          const void* src,
+                          size_t      rows,
+                          size_t      cols,
+                          size_t      element_size,
+                          isa         level = best_isa())
+    {
+        transpose_columns(dest, src, rows, cols, element_size, 0, cols, level);
     }
 }
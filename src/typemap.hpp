@@ -31,6 +31,7 @@
 #define NPY_UINT16 0
 #define NPY_INT32 0
 #define NPY_UINT32 0
+#define NPY_FLOAT16 0
 #define NPY_FLOAT32 0
 #define NPY_FLOAT64 0
 #endif
@@ -47,6 +48,8 @@ namespace nervana
         {"uint16_t", std::make_tuple<int, int, size_t>(NPY_UINT16, CV_16U, sizeof(uint16_t))},
         {"int32_t", std::make_tuple<int, int, size_t>(NPY_INT32, CV_32S, sizeof(int32_t))},
         {"uint32_t", std::make_tuple<int, int, size_t>(NPY_UINT32, CV_32S, sizeof(uint32_t))},
+        {"float16", std::make_tuple<int, int, size_t>(NPY_FLOAT16, CV_16U, sizeof(uint16_t))},
+        {"bfloat16", std::make_tuple<int, int, size_t>(NPY_UINT16, CV_16U, sizeof(uint16_t))},
         {"float", std::make_tuple<int, int, size_t>(NPY_FLOAT32, CV_32F, sizeof(float))},
         {"double", std::make_tuple<int, int, size_t>(NPY_FLOAT64, CV_64F, sizeof(double))},
         {"char", std::make_tuple<int, int, size_t>(NPY_INT8, CV_8S, sizeof(char))}};
@@ -73,6 +76,10 @@ public:
     int         get_cv_type() const { return m_cv_type; }
     int         get_np_type() const { return m_np_type; }
     size_t      get_size() const { return m_size; }
+
+    // float16 and bfloat16 are stored as CV_16U, loaders compute in float and convert
+    // with convert_to_half.  numpy has no bfloat16, so its buffers show the raw bits.
+    bool is_half() const { return m_tp_name == "float16" || m_tp_name == "bfloat16"; }
     static bool is_valid_type(const std::string& s)
     {
         return all_outputs.find(s) != all_outputs.end();
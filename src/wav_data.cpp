@@ -72,6 +72,56 @@ wav_data::wav_data(const char* buf, uint32_t bufsize)
     }
 }
 
+bool wav_data::wrap(const char* buf, size_t bufsize, cv::Mat& samples)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    bool host_big_endian = true;
+#else
+    bool host_big_endian = false;
+#endif
+    // the samples are little endian
+    if (host_big_endian || bufsize < sizeof(RiffMainHeader) ||
+        unpack<uint32_t>(buf) != nervana::FOURCC('R', 'I', 'F', 'F') ||
+        unpack<uint32_t>(buf, 8) != nervana::FOURCC('W', 'A', 'V', 'E'))
+    {
+        return false;
+    }
+
+    // walk the chunks, which may come in any order, for the format and the samples
+    bool   have_format = false;
+    size_t pos         = sizeof(RiffMainHeader);
+    while (pos + sizeof(DataHeader) <= bufsize)
+    {
+        uint32_t tag  = unpack<uint32_t>(buf, pos);
+        uint32_t size = unpack<uint32_t>(buf, pos + 4);
+        pos += sizeof(DataHeader);
+        if (tag == nervana::FOURCC('f', 'm', 't', ' '))
+        {
+            if (size < 16 || pos + 16 > bufsize ||
+                unpack<uint16_t>(buf, pos) != WAVE_FORMAT_PCM ||
+                unpack<uint16_t>(buf, pos + 2) != 1 || unpack<uint16_t>(buf, pos + 14) != 16)
+            {
+                return false;
+            }
+            have_format = true;
+        }
+        else if (tag == nervana::FOURCC('d', 'a', 't', 'a'))
+        {
+            if (!have_format || size > bufsize - pos)
+            {
+                return false;
+            }
+            // It is bad to cast away const, but opencv does not support a const Mat.
+            // Callers copy the samples before changing them.
+            samples = cv::Mat(size / sizeof(int16_t), 1, CV_16SC1, const_cast<char*>(buf + pos));
+            return true;
+        }
+        // chunks are padded to an even size
+        pos += size + size % 2;
+    }
+    return false;
+}
+
 void wav_data::dump(std::ostream& ostr)
 {
     ostr << "sample_rate " << _sample_rate << "\n";
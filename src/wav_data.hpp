@@ -109,6 +109,10 @@ namespace nervana
 
         wav_data(const char* buf, uint32_t bufsize);
 
+        // Wraps the samples of a 16 bit mono PCM wav file in place as a column of CV_16SC1,
+        // without copying.  Returns false for other formats or a malformed file.
+        static bool wrap(const char* buf, size_t bufsize, cv::Mat& samples);
+
         void dump(std::ostream& ostr = std::cout);
         void write_to_file(std::string filename);
         void write_to_buffer(char* buf, uint32_t bufsize);
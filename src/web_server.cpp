@@ -103,6 +103,7 @@ void web::server::stop()
     {
         m_thread.join();
     }
+    join_connections(false);
 }
 
 void web::server::wait_for_exit()
@@ -214,10 +215,26 @@ void web::server::page_request(web::page& current_page)
     }
 }
 
-void web::server::connection_handler_entry(std::shared_ptr<page> page)
+void web::server::connection_handler_entry(page* page)
 {
     page->m_server->page_request(*page);
-    //    page->m_thread.detach();
+    page->m_finished = true;
+}
+
+void web::server::join_connections(bool finished_only)
+{
+    for (auto it = m_connection_pages.begin(); it != m_connection_pages.end();)
+    {
+        if (finished_only && !(*it)->m_finished)
+        {
+            it++;
+        }
+        else
+        {
+            (*it)->m_thread.join();
+            it = m_connection_pages.erase(it);
+        }
+    }
 }
 
 void web::server::process_loop()
@@ -248,8 +265,12 @@ void web::server::process_loop()
             }
             else
             {
-                auto fn = std::bind(&web::server::connection_handler_entry, current_page);
-                current_page->m_thread = std::thread(fn);
+                // the server keeps the page and joins its thread, so no request is
+                // still running when the server is destroyed
+                join_connections(true);
+                current_page->m_thread =
+                    std::thread(&web::server::connection_handler_entry, current_page.get());
+                m_connection_pages.push_back(current_page);
             }
         }
         else
@@ -20,6 +20,8 @@
 #include <vector>
 #include <functional>
 #include <thread>
+#include <atomic>
+#include <list>
 #include <strings.h>
 #include <memory.h>
 #include <streambuf>
@@ -91,6 +93,9 @@ public:
     void start(uint16_t port);
     void stop();
 
+    // serve each connection on the listening thread, or on its own thread when disabled
+    void set_single_thread(bool enable) { m_single_thread = enable; }
+
     void register_page_handler(page_request_handler);
     void register_error_handler(error_message_handler);
 
@@ -101,10 +106,11 @@ public:
 private:
     server(server&);
 
-    static void connection_handler_entry(std::shared_ptr<page>);
+    static void connection_handler_entry(page*);
     void        connection_handler(void*);
 
     void process_loop();
+    void join_connections(bool finished_only);
 
     static std::vector<std::string> split(const std::string& src, char delimiter);
     static std::string to_lower(const std::string& s);
@@ -117,6 +123,8 @@ private:
     error_message_handler                 m_error_handler;
     bool                                  m_active;
     bool                                  m_single_thread = true;
+    // pages served on their own thread, joined once finished or when the server stops
+    std::list<std::shared_ptr<page>>      m_connection_pages;
 };
 
 class web::page
@@ -175,5 +183,6 @@ private:
     std::shared_ptr<web::tcp::connection> m_connection;
     std::thread                           m_thread;
     server*                               m_server;
+    std::atomic<bool>                     m_finished{false};
     bool                                  m_http_header_sent;
 };
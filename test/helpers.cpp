@@ -33,14 +33,18 @@ vector<string> buffer_to_vector_of_strings(encoded_record_list& b)
     {
         for (auto i = 0; i != b.size(); ++i)
         {
-            vector<char>& s = b.record(i).element(0);
-            words.push_back(string(s.data(), s.size()));
+            words.push_back(element2string(b.record(i).element(0)));
         }
     }
 
     return words;
 }
 
+string element2string(const variable_record_field& element)
+{
+    return string(element.data(), element.size());
+}
+
 bool sorted(vector<string> words)
 {
     return std::is_sorted(words.begin(), words.end());
@@ -28,6 +28,7 @@
 #endif
 
 std::vector<std::string> buffer_to_vector_of_strings(nervana::encoded_record_list& b);
+std::string element2string(const nervana::variable_record_field& element);
 bool sorted(std::vector<std::string> words);
 void dump_vector_of_strings(std::vector<std::string>& words);
 
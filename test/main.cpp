@@ -17,6 +17,8 @@
 #include <iostream>
 #include <chrono>
 #include <clocale>
+#include <thread>
+#include <atomic>
 
 #include "gtest/gtest.h"
 #include "gmock/gmock.h"
@@ -34,20 +36,27 @@ using namespace nervana;
 
 extern gen_image image_dataset;
 extern string    test_cache_directory;
+extern atomic<size_t> slow_macrobatch_peak;
 
-gen_image image_dataset;
-string    test_cache_directory;
+gen_image      image_dataset;
+string         test_cache_directory;
+atomic<size_t> slow_macrobatch_peak{0};
 
 // NDSMockServer starts a python process in the constructor and kills the
 // process in the destructor
 class mock_nds_server
 {
 public:
+    // macrobatch requests for this collection are answered after a delay
+    static const size_t slow_collection_id   = 2;
+    static const int    slow_macrobatch_msec = 50;
+
     mock_nds_server()
     {
         page_request_handler fn =
             bind(&mock_nds_server::page_handler, this, placeholders::_1, placeholders::_2);
         m_server.register_page_handler(fn);
+        m_server.set_single_thread(false);
         m_server.start(5000);
     }
 
@@ -69,8 +78,20 @@ public:
             size_t collection_id = stod(args["collection_id"]);
             string token         = args["token"];
             (void)block_index;
-            (void)collection_id;
             (void)token; // silence warning
+            if (collection_id == slow_collection_id)
+            {
+                // stand-in for a remote NDS server, the most requests seen in flight at
+                // once is kept in slow_macrobatch_peak
+                size_t in_flight = ++m_slow_in_flight;
+                size_t peak      = slow_macrobatch_peak;
+                while (in_flight > peak &&
+                       !slow_macrobatch_peak.compare_exchange_weak(peak, in_flight))
+                {
+                }
+                this_thread::sleep_for(chrono::milliseconds(slow_macrobatch_msec));
+                m_slow_in_flight--;
+            }
             stringstream ss;
             {
                 size_t              record_start = block_size * block_index;
@@ -110,8 +131,9 @@ public:
     }
 
 private:
-    web::server m_server;
-    vector<int> m_elements_size_list = {1024, 32};
+    web::server    m_server;
+    vector<int>    m_elements_size_list = {1024, 32};
+    atomic<size_t> m_slow_in_flight{0};
 };
 
 static void CreateImageDataset()
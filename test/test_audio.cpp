@@ -15,10 +15,13 @@
 *******************************************************************************/
 
 #include <fstream>
+#include <unistd.h>
 #include "gtest/gtest.h"
 #include <sox.h>
 
 #include "etl_audio.hpp"
+#include "file_util.hpp"
+#include "noise_clips.hpp"
 #include "wav_data.hpp"
 
 using namespace std;
@@ -99,6 +102,103 @@ TEST(audio, specgram)
     ASSERT_EQ(cv::countNonZero(diff), 0);
 }
 
+// The cv::dft spectrogram that wav_to_specgram computed before it used real_fft
+static void dft_specgram(const cv::Mat& wav_col_mat,
+                         int            frame_length_tn,
+                         int            frame_stride_tn,
+                         int            max_time_steps,
+                         const cv::Mat& window,
+                         cv::Mat&       specgram)
+{
+    cv::Mat wav_mat    = wav_col_mat.reshape(1, 1);
+    int     num_frames = ((wav_mat.cols - frame_length_tn) / frame_stride_tn) + 1;
+    num_frames         = std::min(num_frames, max_time_steps);
+
+    cv::Mat wav_frames(num_frames, frame_length_tn, wav_mat.type());
+    for (int frame = 0; frame < num_frames; frame++)
+    {
+        int start = frame * frame_stride_tn;
+        wav_mat.colRange(start, start + frame_length_tn).copyTo(wav_frames.row(frame));
+    }
+
+    cv::Mat input;
+    wav_frames.convertTo(input, CV_32FC1);
+    input = input.mul(cv::repeat(window, input.rows, 1));
+
+    cv::Mat planes[] = {input, cv::Mat::zeros(input.size(), CV_32FC1)};
+    cv::Mat compx;
+    cv::merge(planes, 2, compx);
+    cv::dft(compx, compx, cv::DFT_ROWS);
+    compx = compx(cv::Range::all(), cv::Range(0, frame_length_tn / 2 + 1));
+    cv::split(compx, planes);
+    cv::magnitude(planes[0], planes[1], specgram);
+}
+
+TEST(audio, specgram_fft)
+{
+    // A frame length that is not a power of two, against the cv::dft spectrogram
+    sinewave_generator sg{440, 3000};
+    wav_data           wav(sg, 1, 16000, false);
+
+    int     frame_length_tn = 400;
+    int     frame_stride_tn = 160;
+    int     time_steps      = 20;
+    cv::Mat spec, ref_spec, window;
+    specgram::create_window("hann", frame_length_tn, window);
+    specgram::wav_to_specgram(
+        wav.get_data(), frame_length_tn, frame_stride_tn, time_steps, window, spec);
+    dft_specgram(wav.get_data(), frame_length_tn, frame_stride_tn, time_steps, window, ref_spec);
+    ASSERT_EQ(time_steps, spec.rows);
+    ASSERT_EQ(frame_length_tn / 2 + 1, spec.cols);
+    ASSERT_EQ(ref_spec.size(), spec.size());
+
+    // both are float transforms, so they agree to float rounding of the peak magnitude
+    double peak;
+    cv::minMaxLoc(ref_spec, nullptr, &peak);
+    for (int frame = 0; frame < time_steps; frame++)
+    {
+        for (int k = 0; k < spec.cols; k++)
+        {
+            EXPECT_NEAR(ref_spec.at<float>(frame, k), spec.at<float>(frame, k), peak * 1e-5)
+                << "frame " << frame << " bin " << k;
+        }
+    }
+}
+
+TEST(benchmark, specgram_fft)
+{
+    sinewave_generator sg{440, 3000};
+    wav_data           wav(sg, 10, 16000, false);
+
+    int       frame_length_tn = 400;
+    int       frame_stride_tn = 160;
+    int       time_steps      = 1000;
+    int       iterations      = 20;
+    cv::Mat   spec, window;
+    stopwatch timer;
+    specgram::create_window("hann", frame_length_tn, window);
+
+    timer.start();
+    for (int i = 0; i < iterations; i++)
+    {
+        dft_specgram(wav.get_data(), frame_length_tn, frame_stride_tn, time_steps, window, spec);
+    }
+    timer.stop();
+    float dft_time = timer.get_microseconds() / 1000.;
+
+    timer.start();
+    for (int i = 0; i < iterations; i++)
+    {
+        specgram::wav_to_specgram(
+            wav.get_data(), frame_length_tn, frame_stride_tn, time_steps, window, spec);
+    }
+    timer.stop();
+    float fft_time = timer.get_microseconds() / 1000.;
+
+    cout << "cv::dft  " << dft_time / iterations << " ms/spectrogram" << endl;
+    cout << "real_fft " << fft_time / iterations << " ms/spectrogram" << endl;
+}
+
 TEST(audio, transform)
 {
     auto js     = R"(
@@ -168,6 +268,42 @@ TEST(wav, read)
     }
 }
 
+TEST(wav, wrap)
+{
+    sinewave_generator sg{400, 500};
+    wav_data           wav(sg, 1, 16000, false);
+    vector<char>       buf(wav_data::HEADER_SIZE + wav.nbytes());
+    wav.write_to_buffer(buf.data(), buf.size());
+
+    // the samples are used where they are in the buffer
+    cv::Mat samples;
+    ASSERT_TRUE(wav_data::wrap(buf.data(), buf.size(), samples));
+    EXPECT_EQ(buf.data() + wav_data::HEADER_SIZE, (char*)samples.data);
+    ASSERT_EQ(wav.nsamples(), samples.rows);
+    EXPECT_EQ(0, memcmp(wav.get_data().data, samples.data, wav.nbytes()));
+
+    audio::extractor extractor;
+    auto             decoded = extractor.extract(buf.data(), buf.size());
+    EXPECT_TRUE(decoded->wraps_record);
+    EXPECT_EQ(samples.data, decoded->get_time_data().data);
+
+    // a chunk between the format and the samples is skipped
+    vector<char> list(buf.begin(), buf.begin() + sizeof(RiffMainHeader) + sizeof(FmtHeader));
+    const char   info[] = {'L', 'I', 'S', 'T', 3, 0, 0, 0, 'a', 'b', 'c', 0};
+    list.insert(list.end(), info, info + sizeof(info));
+    list.insert(list.end(), buf.begin() + list.size() - sizeof(info), buf.end());
+    ASSERT_TRUE(wav_data::wrap(list.data(), list.size(), samples));
+    EXPECT_EQ(0, memcmp(wav.get_data().data, samples.data, wav.nbytes()));
+
+    // stereo, truncated and other files are left to sox
+    wav_data stereo(sg, 1, 16000, true);
+    buf.resize(wav_data::HEADER_SIZE + stereo.nbytes());
+    stereo.write_to_buffer(buf.data(), buf.size());
+    EXPECT_FALSE(wav_data::wrap(buf.data(), buf.size(), samples));
+    EXPECT_FALSE(wav_data::wrap(list.data(), list.size() - 2, samples));
+    EXPECT_FALSE(wav_data::wrap("not a wav file", 14, samples));
+}
+
 TEST(audio, transform2)
 {
     auto js     = R"(
@@ -373,6 +509,73 @@ TEST(etl, sox_use)
     }
 }
 
+TEST(audio, noise_bank)
+{
+    string tmp   = file_util::make_temp_directory();
+    string index = file_util::path_join(tmp, "noise_index.txt");
+    string bank  = file_util::path_join(tmp, "noise.bank");
+    {
+        ofstream ofs(index);
+        for (int i = 0; i < 2; i++)
+        {
+            sinewave_generator sg{300.0f + 500 * i, 20000};
+            wav_data           wav(sg, 1 + i, 16000, false);
+            string             name = "noise" + to_string(i) + ".wav";
+            wav.write_to_file(file_util::path_join(tmp, name));
+            ofs << name << "\n";
+        }
+    }
+
+    // one set of clips is shared while in use, and writes the bank
+    auto decoded = nervana::noise_clips::get(index, tmp, bank);
+    EXPECT_EQ(decoded, nervana::noise_clips::get(index, tmp, bank));
+    ASSERT_EQ(2, decoded->size());
+    ASSERT_TRUE(file_util::exists(bank));
+
+    // the bank is mapped instead of decoding the noise files
+    nervana::noise_clips mapped("", "", bank);
+    ASSERT_EQ(2, mapped.size());
+    for (size_t i = 0; i < mapped.size(); i++)
+    {
+        ASSERT_EQ(decoded->clip(i).rows, mapped.clip(i).rows);
+        EXPECT_EQ(0,
+                  memcmp(decoded->clip(i).data,
+                         mapped.clip(i).data,
+                         decoded->clip(i).rows * sizeof(int16_t)));
+    }
+
+    // mixing wraps around the clip and matches cv::addWeighted, including saturation
+    sinewave_generator sg{1000, 30000};
+    wav_data           wav(sg, 3, 16000, false);
+    cv::Mat            samples = wav.get_data().clone();
+    mapped.addNoise(samples, true, 1, 0.75f, 0.9f);
+
+    const cv::Mat& clip   = mapped.clip(1);
+    int            offset = clip.rows * 0.75f;
+    cv::Mat        noise(samples.size(), CV_16SC1);
+    for (int i = 0; i < noise.rows; i++)
+    {
+        noise.at<int16_t>(i, 0) = clip.at<int16_t>((offset + i) % clip.rows, 0);
+    }
+    cv::Mat expected;
+    cv::addWeighted(wav.get_data(), 1.0f, noise, 0.9f, 0.0f, expected);
+    EXPECT_EQ(0, cv::norm(expected, samples, cv::NORM_INF));
+
+    // a bank made from an older index is made again, without leaving its temporary file
+    {
+        ofstream ofs(index);
+        ofs << "noise1.wav\n";
+    }
+    nervana::noise_clips rebuilt(index, tmp, bank);
+    ASSERT_EQ(1, rebuilt.size());
+    EXPECT_EQ(decoded->clip(1).rows, rebuilt.clip(0).rows);
+    EXPECT_EQ(1, nervana::noise_clips("", "", bank).size());
+    EXPECT_EQ(1, nervana::noise_clips(index, tmp, bank).size());
+    EXPECT_FALSE(file_util::exists(bank + "." + to_string(getpid())));
+
+    file_util::remove_directory(tmp);
+}
+
 TEST(audio, filterbank)
 {
     int sample_rate = 2000;
@@ -393,6 +596,37 @@ TEST(audio, filterbank)
     }
 }
 
+TEST(audio, mel_filterbank)
+{
+    // The banded filterbank matches the dense matrix product, log and dct, also for an odd
+    // number of filters where cv::dct needs padding
+    sinewave_generator sg{440, 3000};
+    wav_data           wav(sg, 1, 16000, false);
+    cv::Mat            spec, window;
+    specgram::create_window("hann", 512, window);
+    specgram::wav_to_specgram(wav.get_data(), 512, 256, 40, window, spec);
+
+    for (int num_filters : {40, 41})
+    {
+        int     num_cepstra = 13;
+        cv::Mat fbank;
+        specgram::create_filterbanks(num_filters, 512, 16000, fbank);
+
+        cv::Mat expected_mfsc, expected_mfcc;
+        specgram::specgram_to_cepsgram(spec, fbank, expected_mfsc);
+        specgram::cepsgram_to_mfcc(expected_mfsc, num_cepstra, expected_mfcc);
+
+        mel_filterbank bank(fbank, num_cepstra);
+        cv::Mat        mfsc, mfcc;
+        bank.mfsc(spec, mfsc);
+        bank.mfcc(spec, mfcc);
+        ASSERT_EQ(expected_mfsc.size(), mfsc.size());
+        ASSERT_EQ(expected_mfcc.size(), mfcc.size());
+        EXPECT_LT(cv::norm(expected_mfsc, mfsc, cv::NORM_INF), 1e-3);
+        EXPECT_LT(cv::norm(expected_mfcc, mfcc, cv::NORM_INF), 1e-2);
+    }
+}
+
 #ifdef PYTHON_PLUGIN
 TEST(plugin, audio_example_scale)
 {
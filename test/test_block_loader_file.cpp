@@ -24,6 +24,7 @@
 #include "file_util.hpp"
 #include "log.hpp"
 #include "util.hpp"
+#include "helpers.hpp"
 
 using namespace std;
 using namespace nervana;
@@ -63,7 +64,7 @@ TEST(block_loader_file, file_block)
                 stringstream ss;
                 ss << record_number << ":" << element_number;
                 string expected = ss.str();
-                string element  = vector2string(record.element(element_number));
+                string element  = element2string(record.element(element_number));
                 EXPECT_STREQ(expected.c_str(), element.c_str());
             }
             record_number++;
@@ -145,7 +146,7 @@ TEST(block_loader_file, iterate_batch)
                 stringstream ss;
                 ss << record_number << ":" << element_number;
                 string expected = ss.str();
-                string element  = vector2string(record.element(element_number));
+                string element  = element2string(record.element(element_number));
                 ASSERT_STREQ(expected.c_str(), element.c_str());
             }
             record_number = (record_number + 1) % record_count;
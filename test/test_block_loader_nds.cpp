@@ -18,6 +18,8 @@
 #include <signal.h>
 #include <sys/param.h>
 #include <initializer_list>
+#include <numeric>
+#include <atomic>
 
 #include <curl/curl.h>
 #include <curl/easy.h>
@@ -36,6 +38,8 @@
 using namespace std;
 using namespace nervana;
 
+extern atomic<size_t> slow_macrobatch_peak;
+
 TEST(DISABLED_curl, test)
 {
     network_client client("http://127.0.0.1:5000", "token", 1, 500, 1, 0);
@@ -166,8 +170,8 @@ TEST(block_loader_nds, cpio)
 
         for (auto record : *block)
         {
-            element_info info0(vector2string(record.element(0)));
-            element_info info1(vector2string(record.element(1)));
+            element_info info0(element2string(record.element(0)));
+            element_info info1(element2string(record.element(1)));
 
             ASSERT_EQ(record_number, info0.record_number());
             ASSERT_EQ(record_number, info1.record_number());
@@ -211,8 +215,8 @@ TEST(block_loader_nds, cpio_filename)
 
         for (auto record : *block)
         {
-            element_info info0(vector2string(record.element(0)));
-            element_info info1(vector2string(record.element(1)));
+            element_info info0(element2string(record.element(0)));
+            element_info info1(element2string(record.element(1)));
 
             ASSERT_EQ(record_number, info0.record_number());
             ASSERT_EQ(record_number, info1.record_number());
@@ -224,6 +228,166 @@ TEST(block_loader_nds, cpio_filename)
     }
 }
 
+namespace
+{
+    vector<size_t> read_record_numbers(manifest_nds& client, size_t epochs)
+    {
+        vector<size_t> rc;
+        for (size_t epoch = 0; epoch < epochs; epoch++)
+        {
+            encoded_record_list* block;
+            while ((block = client.next()) != nullptr)
+            {
+                for (auto record : *block)
+                {
+                    element_info info(element2string(record.element(0)));
+                    rc.push_back(info.record_number());
+                }
+            }
+            client.reset();
+        }
+        return rc;
+    }
+}
+
+TEST(block_loader_nds, prefetch)
+{
+    size_t block_size          = 16;
+    size_t elements_per_record = 2;
+
+    auto make_client = [&](size_t prefetch_count) {
+        return manifest_nds_builder()
+            .base_url("http://127.0.0.1:5000")
+            .token("token")
+            .collection_id(1)
+            .block_size(block_size)
+            .elements_per_record(elements_per_record)
+            .shuffle(true)
+            .seed(7)
+            .prefetch_count(prefetch_count)
+            .make_shared();
+    };
+
+    // concurrent fetches must deliver blocks in the same order as serial ones
+    auto           serial   = make_client(1);
+    auto           parallel = make_client(3);
+    vector<size_t> expected = read_record_numbers(*serial, 2);
+    vector<size_t> actual   = read_record_numbers(*parallel, 2);
+    ASSERT_EQ(2 * 5 * block_size, expected.size());
+    EXPECT_EQ(expected, actual);
+
+    // reset in the middle of an epoch discards requests still in flight
+    parallel->reset();
+    ASSERT_NE(nullptr, parallel->next());
+    parallel->reset();
+    EXPECT_EQ(5 * block_size, read_record_numbers(*parallel, 1).size());
+
+    EXPECT_THROW(manifest_nds_builder()
+                     .base_url("http://127.0.0.1:5000")
+                     .token("token")
+                     .collection_id(1)
+                     .elements_per_record(elements_per_record)
+                     .prefetch_count(0)
+                     .make_shared(),
+                 invalid_argument);
+}
+
+TEST(block_loader_nds, prefetch_overlap)
+{
+    // the mock server delays every macrobatch of collection 2 to stand in for a
+    // remote NDS server and counts how many of them are in flight at once
+    size_t block_size          = 16;
+    size_t elements_per_record = 2;
+
+    auto read_epoch_peak = [&](size_t prefetch_count) {
+        auto client = manifest_nds_builder()
+                          .base_url("http://127.0.0.1:5000")
+                          .token("token")
+                          .collection_id(2)
+                          .block_size(block_size)
+                          .elements_per_record(elements_per_record)
+                          .prefetch_count(prefetch_count)
+                          .make_shared();
+
+        slow_macrobatch_peak = 0;
+        EXPECT_EQ(5 * block_size, read_record_numbers(*client, 1).size());
+        return slow_macrobatch_peak.load();
+    };
+
+    EXPECT_EQ(1, read_epoch_peak(1));
+    EXPECT_LT(1, read_epoch_peak(5));
+}
+
+TEST(block_loader_nds, spill)
+{
+    size_t block_size          = 16;
+    size_t elements_per_record = 2;
+    string spill_root          = file_util::make_temp_directory();
+
+    auto client = manifest_nds_builder()
+                      .base_url("http://127.0.0.1:5000")
+                      .token("token")
+                      .collection_id(1)
+                      .block_size(block_size)
+                      .elements_per_record(elements_per_record)
+                      .spill_directory(spill_root)
+                      .make_shared();
+
+    vector<size_t> expected(5 * block_size);
+    iota(expected.begin(), expected.end(), 0);
+    EXPECT_EQ(expected, read_record_numbers(*client, 1));
+
+    string spill_dir;
+    file_util::iterate_files(spill_root, [&](const string& file, bool is_dir) {
+        if (is_dir)
+        {
+            spill_dir = file;
+        }
+    });
+    ASSERT_FALSE(spill_dir.empty());
+    string block_path = file_util::path_join(spill_dir, "block_0.cpio");
+    ASSERT_TRUE(file_util::exists(block_path));
+
+    // replace a spilled block to show that later epochs are read from disk
+    {
+        encoded_record_list block;
+        for (size_t i = 0; i < block_size; i++)
+        {
+            encoded_record record;
+            record.add_element(string2vector(to_string(1000 + i) + ":0"));
+            record.add_element(string2vector(to_string(1000 + i) + ":1"));
+            block.add_record(record);
+        }
+        ofstream     f(block_path, ios::binary);
+        cpio::writer writer(f);
+        writer.write_all_records(block);
+    }
+    vector<size_t> actual = read_record_numbers(*client, 1);
+    ASSERT_EQ(expected.size(), actual.size());
+    EXPECT_EQ(1000, actual[0]);
+    EXPECT_EQ(block_size, actual[block_size]);
+
+    // torn metadata, as seen by a reader racing a writer, keeps the spill
+    {
+        ofstream f(file_util::path_join(spill_dir, "metadata.json"));
+        f << "{\"record_count\": 8";
+    }
+    client->reset();
+    EXPECT_TRUE(file_util::exists(block_path));
+    EXPECT_EQ(1000, read_record_numbers(*client, 1)[0]);
+
+    // a changed object count discards the spill at the next epoch
+    {
+        ofstream f(file_util::path_join(spill_dir, "metadata.json"));
+        f << "{\"record_count\": 100, \"macro_batch_per_shard\": 5}";
+    }
+    client->reset();
+    EXPECT_FALSE(file_util::exists(block_path));
+    EXPECT_EQ(expected, read_record_numbers(*client, 1));
+
+    file_util::remove_directory(spill_root);
+}
+
 // TEST(block_loader_nds, multiblock_sequential)
 // {
 
@@ -26,6 +26,7 @@
 #include "block_loader_file.hpp"
 #include "block_loader_nds.hpp"
 #include "block.hpp"
+#include "helpers.hpp"
 
 #define private public
 #include "block_manager.hpp"
@@ -33,6 +34,7 @@
 
 using namespace std;
 using namespace nervana;
+using nlohmann::json;
 
 TEST(block_manager, block_list)
 {
@@ -162,7 +164,7 @@ TEST(block_manager, build_cache)
                 stringstream ss;
                 ss << record_number << ":" << element_number;
                 string expected = ss.str();
-                string element  = vector2string(record.element(element_number));
+                string element  = element2string(record.element(element_number));
                 ASSERT_STREQ(expected.c_str(), element.c_str());
             }
             record_number = (record_number + 1) % record_count;
@@ -222,7 +224,7 @@ TEST(block_manager, reuse_cache)
                     stringstream ss;
                     ss << record_number << ":" << element_number;
                     string expected = ss.str();
-                    string element  = vector2string(record.element(element_number));
+                    string element  = element2string(record.element(element_number));
                     ASSERT_STREQ(expected.c_str(), element.c_str());
                 }
                 record_number = (record_number + 1) % record_count;
@@ -251,7 +253,7 @@ TEST(block_manager, reuse_cache)
                     stringstream ss;
                     ss << record_number << ":" << element_number;
                     string expected = ss.str();
-                    string element  = vector2string(record.element(element_number));
+                    string element  = element2string(record.element(element_number));
                     ASSERT_STREQ(expected.c_str(), element.c_str());
                 }
                 record_number = (record_number + 1) % record_count;
@@ -297,7 +299,7 @@ TEST(block_manager, file_no_shuffle_cache)
 
         for (size_t record = 0; record < block_size; record++)
         {
-            string data0 = vector2string(buffer->record(record).element(0));
+            string data0 = element2string(buffer->record(record).element(0));
             size_t value = stod(split(data0, ':')[0]);
             first_pass.push_back(value);
         }
@@ -314,7 +316,7 @@ TEST(block_manager, file_no_shuffle_cache)
 
         for (size_t record = 0; record < block_size; record++)
         {
-            string data0 = vector2string(buffer->record(record).element(0));
+            string data0 = element2string(buffer->record(record).element(0));
             size_t value = stod(split(data0, ':')[0]);
             second_pass.push_back(value);
         }
@@ -362,7 +364,7 @@ TEST(block_manager, file_no_shuffle_no_cache)
 
         for (size_t record = 0; record < block_size; record++)
         {
-            string data0 = vector2string(buffer->record(record).element(0));
+            string data0 = element2string(buffer->record(record).element(0));
             size_t value = stod(split(data0, ':')[0]);
             first_pass.push_back(value);
         }
@@ -379,7 +381,7 @@ TEST(block_manager, file_no_shuffle_no_cache)
 
         for (size_t record = 0; record < block_size; record++)
         {
-            string data0 = vector2string(buffer->record(record).element(0));
+            string data0 = element2string(buffer->record(record).element(0));
             size_t value = stod(split(data0, ':')[0]);
             second_pass.push_back(value);
         }
@@ -426,7 +428,7 @@ TEST(block_manager, file_shuffle_cache)
 
         for (size_t record = 0; record < block_size; record++)
         {
-            string data0 = vector2string(buffer->record(record).element(0));
+            string data0 = element2string(buffer->record(record).element(0));
             size_t value = stod(split(data0, ':')[0]);
             first_pass.push_back(value);
         }
@@ -443,7 +445,7 @@ TEST(block_manager, file_shuffle_cache)
 
         for (size_t record = 0; record < block_size; record++)
         {
-            string data0 = vector2string(buffer->record(record).element(0));
+            string data0 = element2string(buffer->record(record).element(0));
             size_t value = stod(split(data0, ':')[0]);
             second_pass.push_back(value);
         }
@@ -456,6 +458,58 @@ TEST(block_manager, file_shuffle_cache)
     file_util::remove_directory(cache_root);
 }
 
+TEST(block_manager, restore_state_cache)
+{
+    manifest_builder mb;
+
+    string         cache_root     = file_util::make_temp_directory();
+    size_t         record_count   = 14;
+    size_t         block_size     = 4;
+    bool           enable_shuffle = true;
+    const uint32_t seed           = 1234;
+
+    stringstream& manifest_stream = mb.sizes({16, 16}).record_count(record_count).create();
+    auto          manifest =
+        make_shared<manifest_file>(manifest_stream, enable_shuffle, "", 1.0, block_size, seed);
+    auto reader = make_shared<block_loader_file>(manifest, block_size);
+
+    auto read = [](block_manager& manager, size_t count) {
+        vector<size_t> records;
+        while (records.size() < count)
+        {
+            encoded_record_list* buffer = manager.next();
+            EXPECT_NE(nullptr, buffer);
+            if (buffer == nullptr)
+            {
+                break;
+            }
+            for (size_t record = 0; record < buffer->size(); record++)
+            {
+                string data0 = element2string(buffer->record(record).element(0));
+                records.push_back(stod(split(data0, ':')[0]));
+            }
+        }
+        return records;
+    };
+
+    // the first epoch writes the cache, the saved record is part way into the third epoch
+    block_manager  saved(reader, block_size, cache_root, enable_shuffle, seed);
+    vector<size_t> expected = read(saved, record_count * 4);
+    size_t         offset   = 5;
+    size_t         count    = record_count + 3;
+    json           state    = saved.get_state(2, offset);
+    EXPECT_EQ("cache", state["source"]);
+
+    block_manager restored(reader, block_size, cache_root, enable_shuffle, seed);
+    restored.set_state(json::parse(state.dump()), 0);
+    vector<size_t> actual = read(restored, count);
+    ASSERT_LE(count, actual.size());
+    auto saved_record = expected.begin() + record_count * 2 + offset;
+    EXPECT_TRUE(equal(actual.begin(), actual.begin() + count, saved_record));
+
+    file_util::remove_directory(cache_root);
+}
+
 TEST(block_manager, file_shuffle_no_cache)
 {
     manifest_builder mb;
@@ -492,7 +546,7 @@ TEST(block_manager, file_shuffle_no_cache)
 
         for (size_t record = 0; record < block_size; record++)
         {
-            string data0 = vector2string(buffer->record(record).element(0));
+            string data0 = element2string(buffer->record(record).element(0));
             size_t value = stod(split(data0, ':')[0]);
             first_pass.push_back(value);
         }
@@ -509,7 +563,7 @@ TEST(block_manager, file_shuffle_no_cache)
 
         for (size_t record = 0; record < block_size; record++)
         {
-            string data0 = vector2string(buffer->record(record).element(0));
+            string data0 = element2string(buffer->record(record).element(0));
             size_t value = stod(split(data0, ':')[0]);
             second_pass.push_back(value);
         }
@@ -554,7 +608,7 @@ TEST(block_manager, nds_no_shuffle_cache)
 
         for (size_t record = 0; record < block_size; record++)
         {
-            string data0 = vector2string(buffer->record(record).element(0));
+            string data0 = element2string(buffer->record(record).element(0));
             size_t value = stod(split(data0, ':')[0]);
             first_pass.push_back(value);
         }
@@ -571,7 +625,7 @@ TEST(block_manager, nds_no_shuffle_cache)
 
         for (size_t record = 0; record < block_size; record++)
         {
-            string data0 = vector2string(buffer->record(record).element(0));
+            string data0 = element2string(buffer->record(record).element(0));
             size_t value = stod(split(data0, ':')[0]);
             second_pass.push_back(value);
         }
@@ -618,7 +672,7 @@ TEST(block_manager, nds_no_shuffle_no_cache)
 
         for (size_t record = 0; record < block_size; record++)
         {
-            string data0 = vector2string(buffer->record(record).element(0));
+            string data0 = element2string(buffer->record(record).element(0));
             size_t value = stod(split(data0, ':')[0]);
             first_pass.push_back(value);
         }
@@ -635,7 +689,7 @@ TEST(block_manager, nds_no_shuffle_no_cache)
 
         for (size_t record = 0; record < block_size; record++)
         {
-            string data0 = vector2string(buffer->record(record).element(0));
+            string data0 = element2string(buffer->record(record).element(0));
             size_t value = stod(split(data0, ':')[0]);
             second_pass.push_back(value);
         }
@@ -682,7 +736,7 @@ TEST(block_manager, nds_shuffle_cache)
 
         for (size_t record = 0; record < block_size; record++)
         {
-            string data0 = vector2string(buffer->record(record).element(0));
+            string data0 = element2string(buffer->record(record).element(0));
             size_t value = stod(split(data0, ':')[0]);
             first_pass.push_back(value);
         }
@@ -699,7 +753,7 @@ TEST(block_manager, nds_shuffle_cache)
 
         for (size_t record = 0; record < block_size; record++)
         {
-            string data0 = vector2string(buffer->record(record).element(0));
+            string data0 = element2string(buffer->record(record).element(0));
             size_t value = stod(split(data0, ':')[0]);
             second_pass.push_back(value);
         }
@@ -748,7 +802,7 @@ TEST(block_manager, nds_shuffle_no_cache)
 
         for (size_t record = 0; record < block_size; record++)
         {
-            string data0 = vector2string(buffer->record(record).element(0));
+            string data0 = element2string(buffer->record(record).element(0));
             size_t value = stod(split(data0, ':')[0]);
             first_pass.push_back(value);
         }
@@ -765,7 +819,7 @@ TEST(block_manager, nds_shuffle_no_cache)
 
         for (size_t record = 0; record < block_size; record++)
         {
-            string data0 = vector2string(buffer->record(record).element(0));
+            string data0 = element2string(buffer->record(record).element(0));
             size_t value = stod(split(data0, ':')[0]);
             second_pass.push_back(value);
         }
@@ -14,6 +14,10 @@
 * limitations under the License.
 *******************************************************************************/
 
+#include <functional>
+#include <random>
+#include <thread>
+
 #include "gtest/gtest.h"
 
 #include "buffer_batch.hpp"
@@ -22,6 +26,7 @@
 #include "file_util.hpp"
 #include "provider_factory.hpp"
 #include "provider_interface.hpp"
+#include "transpose.hpp"
 
 using namespace std;
 using namespace nervana;
@@ -183,3 +188,293 @@ TEST(buffer, serialization)
         ASSERT_TRUE(found);
     }
 }
+
+TEST(buffer, transpose)
+{
+    // shapes with and without whole kernel blocks, against the scalar version
+    vector<pair<size_t, size_t>> shapes{{1, 5}, {5, 1}, {3, 3}, {16, 16}, {24, 37}, {130, 77}};
+    vector<transpose::isa>       levels{transpose::isa::sse, transpose::isa::avx2,
+                                  transpose::isa::avx512};
+    for (auto shape : shapes)
+    {
+        for (size_t element_size : {1, 2, 4, 8})
+        {
+            size_t rows = shape.first;
+            size_t cols = shape.second;
+            size_t size = rows * cols * element_size;
+            // offset by a byte so the buffers are unaligned
+            vector<char> src(size + 1);
+            vector<char> expected(size);
+            for (size_t i = 0; i < src.size(); i++)
+            {
+                src[i] = static_cast<char>(i * 7 + 3);
+            }
+            transpose::transpose(
+                expected.data(), &src[1], rows, cols, element_size, transpose::isa::regular);
+            for (size_t r = 0; r < rows; r++)
+            {
+                for (size_t c = 0; c < cols; c++)
+                {
+                    ASSERT_EQ(0,
+                              memcmp(&expected[(c * rows + r) * element_size],
+                                     &src[1 + (r * cols + c) * element_size],
+                                     element_size));
+                }
+            }
+
+            for (auto level : levels)
+            {
+                if (level > transpose::best_isa())
+                {
+                    continue;
+                }
+                vector<char> dest(size + 1);
+                transpose::transpose(&dest[1], &src[1], rows, cols, element_size, level);
+                EXPECT_EQ(0, memcmp(expected.data(), &dest[1], size))
+                    << rows << "x" << cols << " element size " << element_size;
+            }
+        }
+    }
+}
+
+TEST(buffer, copy_transpose_tiles)
+{
+    int        height     = 224;
+    int        width      = 224;
+    size_t     batch_size = 8;
+    const bool pinned     = false;
+
+    using nlohmann::json;
+    json image_config = {
+        {"type", "image"}, {"height", height}, {"width", width}, {"channel_major", false}};
+    json label_config = {{"type", "label"}, {"binary", false}};
+    json config       = {{"manifest_root", ""},
+                   {"manifest_filename", ""},
+                   {"batch_size", batch_size},
+                   {"iteration_mode", "INFINITE"},
+                   {"cache_directory", ""},
+                   {"decode_thread_count", 0},
+                   {"etl", {image_config, label_config}}};
+
+    shared_ptr<nervana::provider_interface> provider = provider_factory::create(config);
+
+    // the source holds two batches, copy the second one
+    nervana::fixed_buffer_map src(provider->get_output_shapes(), batch_size * 2, pinned);
+    nervana::fixed_buffer_map whole(provider->get_output_shapes(), batch_size, pinned);
+    nervana::fixed_buffer_map tiled(provider->get_output_shapes(), batch_size, pinned);
+
+    std::minstd_rand0 rand_items(0);
+    for (auto name : src.get_names())
+    {
+        for (int i = 0; i < src[name]->size(); i++)
+            src[name]->data()[i] = rand_items();
+    }
+
+    whole.copy(src, batch_size, 0, batch_size, batch_size, true);
+
+    vector<nervana::fixed_buffer_map::transpose_tile> tiles;
+    tiled.copy(src, batch_size, 0, batch_size, batch_size, true, &tiles);
+    EXPECT_GT(tiles.size(), 2);
+    for (auto& tile : tiles)
+    {
+        tile.run();
+    }
+
+    for (auto name : whole.get_names())
+    {
+        EXPECT_EQ(0, memcmp(whole[name]->data(), tiled[name]->data(), whole[name]->size()))
+            << name;
+    }
+}
+
+TEST(buffer, copy_feature_major)
+{
+    size_t     batch_size  = 4;
+    size_t     decode_size = batch_size * 3;
+    const bool pinned      = false;
+
+    using nlohmann::json;
+    json image_config = {{"type", "image"}, {"height", 8}, {"width", 6}, {"channel_major", true}};
+    json label_config = {{"type", "label"}, {"binary", false}};
+    json config       = {{"manifest_root", ""},
+                   {"manifest_filename", ""},
+                   {"batch_size", batch_size},
+                   {"iteration_mode", "INFINITE"},
+                   {"cache_directory", ""},
+                   {"decode_thread_count", 0},
+                   {"etl", {image_config, label_config}}};
+
+    shared_ptr<nervana::provider_interface> provider = provider_factory::create(config);
+    auto                                    shapes   = provider->get_output_shapes();
+
+    // the same records batch major and written feature major in groups of batch_size
+    nervana::fixed_buffer_map batch_major(shapes, decode_size, pinned);
+    nervana::fixed_buffer_map feature_major(shapes, decode_size, pinned);
+    feature_major.set_feature_major(batch_size);
+    EXPECT_TRUE(feature_major.is_feature_major());
+
+    std::minstd_rand0 rand_items(0);
+    for (auto name : batch_major.get_names())
+    {
+        for (int i = 0; i < batch_major[name]->size(); i++)
+            batch_major[name]->data()[i] = rand_items();
+        for (size_t i = 0; i < decode_size; i++)
+            feature_major[name]->write_item(i, batch_major[name]->get_item(i));
+    }
+
+    // copying a batch must match transposing it, also when it spans two groups
+    for (size_t src_index : {0, 4, 2, 7})
+    {
+        nervana::fixed_buffer_map transposed(shapes, batch_size, pinned);
+        nervana::fixed_buffer_map copied(shapes, batch_size, pinned);
+        transposed.copy(batch_major, src_index, 0, batch_size, batch_size, true);
+        copied.copy(feature_major, src_index, 0, batch_size, batch_size, true);
+        for (auto name : copied.get_names())
+        {
+            EXPECT_EQ(0,
+                      memcmp(transposed[name]->data(), copied[name]->data(), copied[name]->size()))
+                << name << " from " << src_index;
+        }
+    }
+}
+
+TEST(buffer, write_items_feature_major)
+{
+    size_t group_size  = 32;
+    size_t decode_size = group_size * 3;
+    vector<pair<string, shape_type>> shapes{
+        {"image", shape_type({3, 8, 9}, output_type("uint8_t"))},
+        {"half", shape_type({2, 5}, output_type("float16"))},
+        {"label", shape_type({1}, output_type("uint32_t"))},
+        {"value", shape_type({3}, output_type("double"))}};
+
+    nervana::fixed_buffer_map batch_major(shapes, decode_size);
+    nervana::fixed_buffer_map expected(shapes, decode_size);
+    expected.set_feature_major(group_size);
+    std::minstd_rand0 rand_items(0);
+    for (auto name : batch_major.get_names())
+    {
+        for (int i = 0; i < batch_major[name]->size(); i++)
+            batch_major[name]->data()[i] = rand_items();
+        for (size_t i = 0; i < decode_size; i++)
+            expected[name]->write_item(i, batch_major[name]->get_item(i));
+    }
+
+    // blocks within a group, across groups and spanning several of them
+    for (size_t block : {1, 3, 5, 20, 32, 48, 96})
+    {
+        nervana::fixed_buffer_map blocked(shapes, decode_size);
+        blocked.set_feature_major(group_size);
+        for (auto name : blocked.get_names())
+        {
+            for (size_t i = 0; i < decode_size; i += block)
+            {
+                size_t count = min(block, decode_size - i);
+                blocked[name]->write_items(i, batch_major[name]->get_item(i), count);
+            }
+            EXPECT_EQ(0,
+                      memcmp(expected[name]->data(), blocked[name]->data(), blocked[name]->size()))
+                << name << " in blocks of " << block;
+        }
+    }
+    EXPECT_THROW(expected["label"]->write_items(90, batch_major["label"]->get_item(0), 7),
+                 invalid_argument);
+}
+
+TEST(benchmark, feature_major_write)
+{
+    size_t    batch_size   = 512;
+    size_t    iterations   = 50;
+    size_t    thread_count = max(2u, thread::hardware_concurrency());
+    stopwatch timer;
+    vector<pair<string, shape_type>> shapes{
+        {"image", shape_type({3, 64, 64}, output_type("uint8_t"))},
+        {"label", shape_type({1}, output_type("uint32_t"))}};
+
+    nervana::fixed_buffer_map decoded(shapes, batch_size);
+    std::minstd_rand0         rand_items(0);
+    for (auto name : decoded.get_names())
+    {
+        for (int i = 0; i < decoded[name]->size(); i++)
+            decoded[name]->data()[i] = rand_items();
+    }
+
+    // each thread takes every thread_count'th task, as the decode threads take the next one
+    auto parallel = [&](size_t tasks, const function<void(size_t)>& task) {
+        vector<thread> threads;
+        for (size_t t = 0; t < thread_count; t++)
+        {
+            threads.emplace_back([&, t]() {
+                for (size_t i = t; i < tasks; i += thread_count)
+                    task(i);
+            });
+        }
+        for (thread& t : threads)
+            t.join();
+    };
+
+    // records decoded batch major and transposed into the output batch
+    nervana::fixed_buffer_map batch_major(shapes, batch_size);
+    nervana::fixed_buffer_map transposed(shapes, batch_size);
+    timer.start();
+    for (size_t n = 0; n < iterations; n++)
+    {
+        parallel(batch_size, [&](size_t i) {
+            for (auto name : decoded.get_names())
+                batch_major[name]->write_item(i, decoded[name]->get_item(i));
+        });
+        transposed.copy(batch_major, 0, 0, batch_size, batch_size, true);
+    }
+    timer.stop();
+    float transpose_time = timer.get_microseconds() / 1000.;
+
+    // records scattered feature major one at a time
+    nervana::fixed_buffer_map scattered(shapes, batch_size);
+    scattered.set_feature_major(batch_size);
+    timer.start();
+    for (size_t n = 0; n < iterations; n++)
+    {
+        parallel(batch_size, [&](size_t i) {
+            for (auto name : decoded.get_names())
+                scattered[name]->write_item(i, decoded[name]->get_item(i));
+        });
+    }
+    timer.stop();
+    float scatter_time = timer.get_microseconds() / 1000.;
+
+    cout << "batch major and transpose " << transpose_time / iterations << " ms/batch" << endl;
+    cout << "feature major per record  " << scatter_time / iterations << " ms/batch" << endl;
+
+    // blocks of records decoded batch major into a per thread buffer, as the decoder does:
+    // a cache line of records, and the 8 records per thread the loader's decode size gives
+    for (size_t block : {64, 8})
+    {
+        nervana::fixed_buffer_map blocked(shapes, batch_size);
+        blocked.set_feature_major(batch_size);
+        timer.start();
+        for (size_t n = 0; n < iterations; n++)
+        {
+            parallel(batch_size / block, [&](size_t i) {
+                thread_local nervana::fixed_buffer_map staged;
+                staged.reshape(shapes, block);
+                for (auto name : decoded.get_names())
+                {
+                    staged[name]->write_items(0, decoded[name]->get_item(i * block), block);
+                    blocked[name]->write_items(i * block, staged[name]->get_item(0), block);
+                }
+            });
+        }
+        timer.stop();
+        float block_time = timer.get_microseconds() / 1000.;
+
+        for (auto name : decoded.get_names())
+        {
+            EXPECT_EQ(0,
+                      memcmp(transposed[name]->data(), blocked[name]->data(), blocked[name]->size()));
+            EXPECT_EQ(0,
+                      memcmp(scattered[name]->data(), blocked[name]->data(), blocked[name]->size()));
+        }
+        cout << "feature major in blocks of " << block << " " << block_time / iterations
+             << " ms/batch" << endl;
+    }
+}
@@ -67,3 +67,22 @@ TEST(config, throws)
 
     EXPECT_THROW(loader_config cfg{js}, invalid_argument);
 }
+
+TEST(config, shard_reshuffle_cache)
+{
+    // a complete cache is read without resetting the manifest, so it would keep the first
+    // epoch's shard
+    nlohmann::json label = {{"type", "label"}, {"name", "label1"}, {"binary", false}};
+    nlohmann::json js    = {{"manifest_filename", "blah"},
+                         {"batch_size", 1},
+                         {"shard_count", 2},
+                         {"random_seed", 1},
+                         {"etl", {label}}};
+
+    js["shard_reshuffle"] = true;
+    EXPECT_NO_THROW(loader_config cfg{js});
+    js["cache_directory"] = "cache";
+    EXPECT_THROW(loader_config cfg{js}, invalid_argument);
+    js["shard_reshuffle"] = false;
+    EXPECT_NO_THROW(loader_config cfg{js});
+}
@@ -18,6 +18,7 @@
 #include <string>
 #include <sstream>
 #include <random>
+#include <future>
 
 #include <opencv2/core/core.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
@@ -35,6 +36,8 @@
 #define private public
 
 #include "etl_image.hpp"
+#include "float16.hpp"
+#include "fused_transform.hpp"
 
 using namespace std;
 using namespace nervana;
@@ -232,6 +235,42 @@ TEST(image, extract2)
     test_image(png, 1);
 }
 
+TEST(image, extract_releases_images)
+{
+    cv::Mat               first = generate_indexed_image(64, 48);
+    cv::Mat               second(64, 48, CV_8UC3, cv::Scalar(1, 2, 3));
+    vector<unsigned char> first_png;
+    vector<unsigned char> second_png;
+    cv::imencode(".png", first, first_png);
+    cv::imencode(".png", second, second_png);
+
+    nlohmann::json   js = {{"width", 48}, {"height", 64}};
+    image::config    cfg(js);
+    image::extractor extractor(cfg);
+
+    // on a new thread, which starts with an empty object pool
+    async(launch::async, [&]() {
+        auto            decoded = extractor.extract(first_png.data(), first_png.size());
+        image::decoded* object  = decoded.get();
+
+        // the pooled decoded is reused but lets go of its image, so only the caller
+        // still references it
+        cv::Mat held = decoded->get_image(0);
+        decoded      = nullptr;
+        decoded      = extractor.extract(second_png.data(), second_png.size());
+        EXPECT_EQ(object, decoded.get());
+        EXPECT_EQ(1, decoded->get_image_count());
+        EXPECT_NE(held.data, decoded->get_image(0).data);
+#if CV_VERSION_MAJOR >= 3
+        EXPECT_EQ(1, held.u->refcount);
+#else
+        EXPECT_EQ(1, *held.refcount);
+#endif
+        EXPECT_EQ(0, cv::norm(held, first, cv::NORM_INF));
+        EXPECT_EQ(0, cv::norm(decoded->get_image(0), second, cv::NORM_INF));
+    }).get();
+}
+
 TEST(image, extract3)
 {
     cv::Mat               img = cv::Mat(256, 256, CV_8UC1, 0.0);
@@ -626,6 +665,146 @@ TEST(image, convert_split)
     }
 }
 
+TEST(image, normalize)
+{
+    // odd width for the scalar tail of the conversion
+    cv::Mat       input_image = generate_indexed_image(13, 29);
+    vector<float> mean        = {100, 110, 120};
+    vector<float> stddev      = {50, 60, 70};
+
+    for (string output_type : {"float", "float16", "bfloat16"})
+    {
+        for (bool channel_major : {true, false})
+        {
+            nlohmann::json js = {{"width", 29},
+                                 {"height", 13},
+                                 {"channel_major", channel_major},
+                                 {"output_type", output_type},
+                                 {"mean", mean},
+                                 {"stddev", stddev}};
+            image::config cfg(js);
+            image::loader loader(cfg, false);
+
+            auto         decoded = make_shared<image::decoded>(input_image);
+            vector<char> output(cfg.get_shape_type().get_byte_size());
+            loader.load({output.data()}, decoded);
+
+            // float16 keeps 11 bits of precision and bfloat16 8 bits
+            float tolerance = 1e-5;
+            if (output_type != "float")
+            {
+                tolerance = output_type == "float16" ? 4e-3 : 3e-2;
+            }
+            for (int row = 0; row < input_image.rows; row++)
+            {
+                for (int col = 0; col < input_image.cols; col++)
+                {
+                    cv::Vec3b pixel = input_image.at<cv::Vec3b>(row, col);
+                    for (int ch = 0; ch < 3; ch++)
+                    {
+                        size_t index = channel_major
+                                           ? (ch * input_image.rows + row) * input_image.cols + col
+                                           : (row * input_image.cols + col) * 3 + ch;
+                        float value;
+                        if (output_type == "float")
+                        {
+                            value = reinterpret_cast<const float*>(output.data())[index];
+                        }
+                        else
+                        {
+                            uint16_t bits = reinterpret_cast<const uint16_t*>(output.data())[index];
+                            value         = output_type == "float16" ? half_to_float(bits)
+                                                                     : bfloat16_to_float(bits);
+                        }
+                        EXPECT_NEAR((pixel[ch] - mean[ch]) / stddev[ch], value, tolerance);
+                    }
+                }
+            }
+        }
+    }
+
+    {
+        // the image goes to the top left of the canvas, the rest is zero
+        nlohmann::json js = {{"width", 40}, {"height", 20}, {"output_type", "float"}};
+        image::config  cfg(js);
+        image::loader  loader(cfg, true);
+        vector<float>  output(3 * 20 * 40, -1.0f);
+        loader.load({output.data()}, make_shared<image::decoded>(input_image));
+        EXPECT_EQ(28, output[12 * 40 + 28]);
+        EXPECT_EQ(12, output[(20 + 12) * 40 + 28]);
+        EXPECT_EQ(0, output[12 * 40 + 29]);
+        EXPECT_EQ(0, output[13 * 40 + 28]);
+    }
+
+    nlohmann::json js = {{"width", 29}, {"height", 13}, {"mean", mean}};
+    EXPECT_THROW(image::config{js}, std::invalid_argument);
+    js["output_type"] = "float";
+    js["stddev"]      = {1, 0, 1};
+    EXPECT_THROW(image::config{js}, std::invalid_argument);
+    js["stddev"] = {1, 1};
+    EXPECT_THROW(image::config{js}, std::invalid_argument);
+}
+
+TEST(image, fixed_aspect_ratio_canvas)
+{
+    // two images of a record, smaller than the canvas and with an odd width
+    cv::Mat                    first  = generate_indexed_image(13, 29);
+    cv::Mat                    second = generate_indexed_image(20, 19) + cv::Scalar(0, 0, 7);
+    shared_ptr<image::decoded> decoded = make_shared<image::decoded>(first);
+    decoded->add(second);
+
+    int width  = 40;
+    int height = 20;
+    for (string output_type : {"uint8_t", "int16_t", "float", "double"})
+    {
+        for (bool channel_major : {true, false})
+        {
+            nlohmann::json js = {{"width", width},
+                                 {"height", height},
+                                 {"channel_major", channel_major},
+                                 {"output_type", output_type}};
+            image::config cfg(js);
+            image::loader loader(cfg, true);
+
+            // stale data from an earlier batch must not show around the image
+            size_t       canvas_bytes = cfg.get_shape_type().get_byte_size();
+            vector<char> output(canvas_bytes * 2, 0x55);
+            loader.load({output.data()}, decoded);
+
+            int     cv_type = cfg.get_shape_type().get_otype().get_cv_type();
+            cv::Mat mats[2] = {first, second};
+            for (int i = 0; i < 2; i++)
+            {
+                char*   canvas = output.data() + i * canvas_bytes;
+                cv::Mat expected(height, width, CV_8UC3, cv::Scalar::all(0));
+                mats[i].copyTo(expected(cv::Rect(0, 0, mats[i].cols, mats[i].rows)));
+
+                cv::Mat actual;
+                if (channel_major)
+                {
+                    vector<cv::Mat> planes;
+                    for (int ch = 0; ch < 3; ch++)
+                    {
+                        size_t plane_size = width * height * CV_ELEM_SIZE(cv_type);
+                        planes.emplace_back(height, width, cv_type, canvas + ch * plane_size);
+                    }
+                    cv::merge(planes, actual);
+                }
+                else
+                {
+                    actual = cv::Mat(height, width, CV_MAKETYPE(cv_type, 3), canvas);
+                }
+                actual.convertTo(actual, CV_8U);
+
+                cv::Mat diff;
+                cv::absdiff(expected, actual, diff);
+                EXPECT_EQ(0, cv::countNonZero(diff.reshape(1)))
+                    << output_type << " channel_major " << channel_major << " image " << i;
+            }
+        }
+    }
+}
+
 TEST(image, cropbox_max_proportional)
 {
     {
@@ -683,6 +862,213 @@ TEST(image, calculate_scale)
     EXPECT_EQ(600, size.height);
 }
 
+TEST(image, jpeg_size)
+{
+    cv::Mat               img = generate_indexed_image(200, 320);
+    vector<unsigned char> jpg;
+    vector<unsigned char> png;
+    cv::imencode(".jpg", img, jpg);
+    cv::imencode(".png", img, png);
+
+    cv::Size2i size;
+    ASSERT_TRUE(image::jpeg_size(jpg.data(), jpg.size(), size));
+    EXPECT_EQ(320, size.width);
+    EXPECT_EQ(200, size.height);
+
+    EXPECT_FALSE(image::jpeg_size(png.data(), png.size(), size));
+    EXPECT_FALSE(image::jpeg_size(jpg.data(), 20, size));
+}
+
+TEST(image, reduced_decode)
+{
+    // smooth content so the reduced and full decodes can be compared
+    cv::Mat img(384, 512, CV_8UC3);
+    for (int row = 0; row < img.rows; row++)
+    {
+        for (int col = 0; col < img.cols; col++)
+        {
+            img.at<cv::Vec3b>(row, col) = cv::Vec3b(col / 2, row / 2, 128);
+        }
+    }
+    vector<unsigned char> jpg;
+    cv::imencode(".jpg", img, jpg, {cv::IMWRITE_JPEG_QUALITY, 95});
+
+    nlohmann::json                js = {{"width", 50}, {"height", 40}};
+    image::config                 cfg(js);
+    image::extractor              ext{cfg};
+    image::transformer            trans{cfg};
+    augment::image::param_factory factory(nlohmann::json::object());
+
+    shared_ptr<image::decoded> reduced = ext.extract(jpg.data(), jpg.size(), 4);
+    EXPECT_EQ(cv::Size2i(128, 96), reduced->get_image_size());
+
+    image_params_builder builder(factory.make_params(512, 384, cfg.width, cfg.height));
+    shared_ptr<augment::image::params> params =
+        builder.cropbox(40, 80, 400, 300).output_size(50, 40);
+
+    // 300 / 8 does not cover 40 rows
+    ASSERT_EQ(4, image::transformer::decode_reduction(*params));
+    auto reduced_params = image::transformer::reduce_params(*params, 4, reduced->get_image_size());
+    EXPECT_EQ(cv::Rect(10, 20, 100, 75), reduced_params->cropbox);
+    EXPECT_EQ(cv::Rect(40, 80, 400, 300), params->cropbox);
+
+    shared_ptr<image::decoded> full = ext.extract(jpg.data(), jpg.size());
+    cv::Mat                    expected = trans.transform(params, full)->get_image(0);
+    cv::Mat                    actual   = trans.transform(reduced_params, reduced)->get_image(0);
+    ASSERT_EQ(expected.size(), actual.size());
+    cv::Mat diff;
+    cv::absdiff(expected, actual, diff);
+    EXPECT_LT(cv::mean(diff)[0], 3.0);
+    EXPECT_LT(cv::mean(diff)[1], 3.0);
+
+    builder.padding(4, 0, 0);
+    EXPECT_EQ(1, image::transformer::decode_reduction(*params));
+}
+
+TEST(image, jpeg_orientation)
+{
+    cv::Mat               img = generate_indexed_image(64, 64);
+    vector<unsigned char> jpg;
+    cv::imencode(".jpg", img, jpg);
+    EXPECT_EQ(1, image::jpeg_orientation(jpg.data(), jpg.size()));
+
+    // big endian EXIF block with orientation 6 inserted after SOI
+    vector<unsigned char> exif = {0xFF, 0xE1, 0x00, 0x22, 'E',  'x',  'i',  'f',  0x00,
+                                  0x00, 'M',  'M',  0x00, 0x2A, 0x00, 0x00, 0x00, 0x08,
+                                  0x00, 0x01, 0x01, 0x12, 0x00, 0x03, 0x00, 0x00, 0x00,
+                                  0x01, 0x00, 0x06, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+    jpg.insert(jpg.begin() + 2, exif.begin(), exif.end());
+    EXPECT_EQ(6, image::jpeg_orientation(jpg.data(), jpg.size()));
+
+    cv::Size2i size;
+    ASSERT_TRUE(image::jpeg_size(jpg.data(), jpg.size(), size));
+    EXPECT_EQ(cv::Size2i(64, 64), size);
+}
+
+TEST(image, roi_decode)
+{
+    cv::Mat               img = generate_indexed_image(300, 400);
+    vector<unsigned char> jpg;
+    cv::imencode(".jpg", img, jpg);
+
+    nlohmann::json   js = {{"width", 32}, {"height", 32}};
+    image::config    cfg(js);
+    image::extractor ext{cfg};
+
+    cv::Rect                   roi(101, 75, 90, 120);
+    shared_ptr<image::decoded> decoded = ext.extract_roi(jpg.data(), jpg.size(), 1, roi);
+#ifdef JPEG_TURBO_FOUND
+    ASSERT_NE(nullptr, decoded);
+    EXPECT_EQ(roi.size(), decoded->get_image_size());
+
+    // only the iMCUs covering the region are decoded, with the same pixels
+    cv::Mat full = ext.extract(jpg.data(), jpg.size())->get_image(0);
+    cv::Mat diff;
+    cv::absdiff(full(roi), decoded->get_image(0), diff);
+    EXPECT_EQ(0, cv::countNonZero(diff.reshape(1)));
+
+    // region outside the image
+    EXPECT_EQ(nullptr, ext.extract_roi(jpg.data(), jpg.size(), 2, roi + cv::Point(120, 0)));
+#else
+    EXPECT_EQ(nullptr, decoded);
+#endif
+
+    augment::image::param_factory factory(nlohmann::json::object());
+    image_params_builder          builder(factory.make_params(400, 300, cfg.width, cfg.height));
+    shared_ptr<augment::image::params> params = builder.cropbox(roi);
+    EXPECT_TRUE(image::transformer::roi_decode_supported(*params));
+    builder.angle(10);
+    EXPECT_FALSE(image::transformer::roi_decode_supported(*params));
+}
+
+TEST(image, fused_transform)
+{
+    vector<char> image_data = file_util::read_file_contents(CURDIR "/test_data/img_2112_70.jpg");
+    int          width      = 96;
+    int          height     = 64;
+
+    for (string output_type : {"uint8_t", "float"})
+    {
+        for (bool channel_major : {true, false})
+        {
+            nlohmann::json js = {{"width", width},
+                                 {"height", height},
+                                 {"output_type", output_type},
+                                 {"channel_major", channel_major}};
+            image::config                 cfg{js};
+            image::extractor              extractor{cfg};
+            image::transformer            transformer{cfg};
+            image::loader                 loader{cfg, false};
+            augment::image::param_factory factory(nlohmann::json::object());
+            int                           cv_type = cfg.get_shape_type().get_otype().get_cv_type();
+            image::fused_transform        fused{channel_major, cfg.get_shape_type().get_otype()};
+
+            auto       decoded = extractor.extract(image_data.data(), image_data.size());
+            auto       size    = decoded->get_image_size();
+            cv::Size2i expanded(size.width * 3 / 2, size.height * 3 / 2);
+            auto       make = [&]() {
+                auto params = factory.make_params(size.width, size.height, width, height);
+                image_params_builder(params).cropbox(20, 10, 192, 128).output_size(width, height);
+                return image_params_builder(params);
+            };
+
+            vector<shared_ptr<augment::image::params>> cases = {
+                make(),
+                make().cropbox(5, 7, width, height),
+                make().cropbox(30, 12, 60, 40).flip(true),
+                make().angle(15),
+                make().contrast(0.6).brightness(1.3).saturation(0.5),
+                make().cropbox(5, 7, width, height).saturation(1.4),
+                make().lighting(0.2, -0.4, 0.1).color_noise_std(0.1),
+                make().expand(1.5, cv::Size2i(20, 15), expanded),
+            };
+            auto& hue_case = *cases[4];
+            hue_case.hue   = 20;
+
+            size_t buffer_size = cfg.get_shape_type().get_byte_size();
+            for (auto params : cases)
+            {
+                ASSERT_TRUE(image::fused_transform::is_supported(*params, decoded->get_image(0)));
+
+                vector<char> expected(buffer_size);
+                vector<char> actual(buffer_size);
+                vector<char> scalar(buffer_size);
+                loader.load({expected.data()}, transformer.transform(params, decoded));
+                fused.run(decoded->get_image(0), *params, actual.data());
+                fused.set_simd(false);
+                fused.run(decoded->get_image(0), *params, scalar.data());
+                fused.set_simd(true);
+
+                cv::Mat e(1, width * height * 3, cv_type, expected.data());
+                cv::Mat a(1, width * height * 3, cv_type, actual.data());
+                cv::Mat s(1, width * height * 3, cv_type, scalar.data());
+                cv::Mat diff;
+
+                // the vector kernels round the same way as the scalar ones
+                cv::absdiff(s, a, diff);
+                EXPECT_LT(cv::mean(diff)[0], 0.01);
+
+                cv::absdiff(e, a, diff);
+                double mean_diff = cv::mean(diff)[0];
+                if (params->cropbox.size() == params->output_size && params->angle == 0 &&
+                    params->expand_ratio <= 1.0)
+                {
+                    // no resampling, so only rare rounding ties differ
+                    EXPECT_LT(mean_diff, 0.05) << *params;
+                }
+                else
+                {
+                    // bilinear sampling instead of area or cubic interpolation
+                    EXPECT_LT(mean_diff, 4.0) << *params;
+                }
+            }
+
+            shared_ptr<augment::image::params> padded = make().padding(4, 1, 2);
+            EXPECT_FALSE(image::fused_transform::is_supported(*padded, decoded->get_image(0)));
+        }
+    }
+}
+
 TEST(image, transform)
 {
     vector<char> image_data = file_util::read_file_contents(CURDIR "/test_data/img_2112_70.jpg");
@@ -1408,58 +1794,116 @@ TEST(DISABLED_photometric, saturation)
 
 cv::Mat refHueShift(const cv::Mat image, int hue)
 {
-    cv::Mat hsv;
-    cv::Mat ret;
-    cv::cvtColor(image, hsv, CV_BGR2HSV);
-    if (hue != 0)
+    // rotate the I and Q components of every pixel in double precision
+    const double yiq_data[3][3] = {
+        {0.299, 0.587, 0.114}, {0.596, -0.274, -0.322}, {0.211, -0.523, 0.312}};
+    cv::Mat yiq(3, 3, CV_64FC1, (void*)yiq_data);
+    cv::Mat rgb   = yiq.inv();
+    double  theta = hue * 2.0 * CV_PI / 180.0;
+    cv::Mat ret   = image.clone();
+    for (int row = 0; row < ret.rows; row++)
     {
-        uint8_t* p = hsv.data;
-        for (int i = 0; i < hsv.size().area(); i++)
+        for (int col = 0; col < ret.cols; col++)
         {
-            *p = (*p + hue) % 180;
-            p += 3;
+            cv::Vec3b& bgr = ret.at<cv::Vec3b>(row, col);
+            cv::Mat    in  = (cv::Mat_<double>(3, 1) << bgr[2], bgr[1], bgr[0]);
+            cv::Mat    c   = yiq * in;
+            double     i   = c.at<double>(1);
+            double     q   = c.at<double>(2);
+            c.at<double>(1) = i * cos(theta) + q * sin(theta);
+            c.at<double>(2) = -i * sin(theta) + q * cos(theta);
+            cv::Mat out     = rgb * c;
+
+            bgr = cv::Vec3b(cv::saturate_cast<uint8_t>(out.at<double>(2)),
+                            cv::saturate_cast<uint8_t>(out.at<double>(1)),
+                            cv::saturate_cast<uint8_t>(out.at<double>(0)));
         }
     }
-    cv::cvtColor(hsv, ret, CV_HSV2BGR);
     return ret;
 }
 
 TEST(photometric, hue)
 {
-    cv::Mat  source{1, 3, CV_8UC3, cv::Scalar::all(255)};
-    uint8_t* p = source.data;
-    for (int row = 0; row < 1; row++)
+    // wide enough for the vector kernel and its scalar tail
+    cv::Mat source(4, 37, CV_8UC3);
+    for (int row = 0; row < source.rows; row++)
     {
-        for (int col = 0; col < 1; col++)
+        for (int col = 0; col < source.cols; col++)
         {
-            *p++ = 128;
-            *p++ = 0;
-            *p++ = 0;
+            source.at<cv::Vec3b>(row, col) =
+                cv::Vec3b((col * 7 + row * 60) % 256, (col * 13) % 256, (255 - col * 5) % 256);
         }
     }
-    for (int row = 0; row < 1; row++)
+    source.at<cv::Vec3b>(0, 0) = cv::Vec3b(128, 0, 0);
+    source.at<cv::Vec3b>(0, 1) = cv::Vec3b(0, 128, 255);
+    source.at<cv::Vec3b>(0, 2) = cv::Vec3b(90, 90, 90);
+
+    for (int i = -90; i <= 180; i += 45 / 2)
+    {
+        cv::Mat mat = source.clone();
+        image::photometric::cbsjitter(mat, 1.0, 1.0, 1.0, i);
+        cv::Mat expected = refHueShift(source, i);
+        cv::Mat diff;
+        cv::absdiff(mat, expected, diff);
+        double max_diff;
+        cv::minMaxLoc(diff.reshape(1), nullptr, &max_diff);
+        EXPECT_LE(max_diff, 1) << "at hue shift: " << i;
+
+        // gray has no hue
+        EXPECT_EQ(cv::Vec3b(90, 90, 90), mat.at<cv::Vec3b>(0, 2)) << "at hue shift: " << i;
+    }
+
+    // a full turn
+    cv::Mat mat = source.clone();
+    image::photometric::cbsjitter(mat, 1.0, 1.0, 1.0, 180);
+    cv::Mat diff;
+    cv::absdiff(mat, source, diff);
+    EXPECT_EQ(0, cv::countNonZero(diff.reshape(1)));
+}
+
+TEST(photometric, color_matrix)
+{
+    cv::Mat source(3, 40, CV_8UC3);
+    for (int row = 0; row < source.rows; row++)
     {
-        for (int col = 1; col < 2; col++)
+        for (int col = 0; col < source.cols; col++)
         {
-            *p++ = 0;
-            *p++ = 128;
-            *p++ = 255;
+            source.at<cv::Vec3b>(row, col) =
+                cv::Vec3b((col * 31) % 256, (row * 90 + col) % 256, (col * 11 + 40) % 256);
         }
     }
 
-    for (int i = 0; i <= 180; i += 45 / 2)
+    // the folded matrix matches saturation and brightness followed by a hue shift
+    float   brightness = 1.2;
+    float   saturation = 0.7;
+    int     hue        = 25;
+    cv::Mat mat        = source.clone();
+    image::photometric::cbsjitter(mat, 1.0, brightness, saturation, hue);
+
+    cv::Mat expected = source.clone();
+    image::photometric::cbsjitter(expected, 1.0, brightness, saturation, 0);
+    expected = refHueShift(expected, hue);
+    cv::Mat full;
+    cv::transform(source, full, image::photometric::color_matrix(brightness, saturation, hue));
+
+    cv::Mat diff;
+    double  max_diff;
+    cv::absdiff(mat, full, diff);
+    cv::minMaxLoc(diff.reshape(1), nullptr, &max_diff);
+    EXPECT_LE(max_diff, 1);
+    cv::absdiff(mat, expected, diff);
+    cv::minMaxLoc(diff.reshape(1), nullptr, &max_diff);
+    EXPECT_LE(max_diff, 2);
+
+    // contrast uses the mean of the image after the color matrix
+    cv::Mat with_contrast = source.clone();
+    image::photometric::cbsjitter(with_contrast, 0.5, brightness, saturation, hue);
+    cv::Scalar mean = cv::mean(mat);
+    for (int c = 0; c < 3; c++)
     {
-        cv::Mat mat = source.clone();
-        image::photometric::cbsjitter(mat, 1.0, 1.0, 1.0, i);
-        cv::Mat expected = refHueShift(source, i);
-        auto lambda      = [](cv::Mat m) {
-            stringstream ss;
-            ss << m;
-            return ss.str();
-        };
-        EXPECT_EQ(lambda(mat), lambda(expected)) << "at hue shift: " << i;
-        //        string name = "hue_" + to_string(i) + ".png";
-        //        cv::imwrite(name, mat);
+        uint8_t v = mat.at<cv::Vec3b>(1, 7)[c];
+        EXPECT_EQ(cv::saturate_cast<uint8_t>(v * 0.5f + 0.5f * float(mean[c])),
+                  with_contrast.at<cv::Vec3b>(1, 7)[c]);
     }
 }
 
@@ -496,6 +496,115 @@ TEST(loader, deterministic)
     EXPECT_EQ(data[2], expected_result[2]);
 }
 
+static nlohmann::json restore_state_config()
+{
+    std::string test_data_directory = file_util::path_join(string(CURDIR), "test_data");
+    std::string manifest            = generate_manifest_file(20);
+
+    nlohmann::json image_config = {
+        {"type", "image"}, {"height", 1}, {"width", 1}, {"channel_major", false}};
+    nlohmann::json label_config = {{"type", "label"}, {"binary", false}};
+    auto           aug_config   = vector<nlohmann::json>{{{"type", "image"},
+                                              {"scale", {0.5, 1.0}},
+                                              {"brightness", {0.5, 1.0}},
+                                              {"flip_enable", true}}};
+    return {{"manifest_root", test_data_directory},
+            {"manifest_filename", manifest},
+            {"batch_size", 4},
+            {"block_size", 6},
+            {"iteration_mode", "INFINITE"},
+            {"decode_thread_count", 1},
+            {"shuffle_manifest", true},
+            {"etl", {image_config, label_config}},
+            {"augmentation", aug_config},
+            {"random_seed", 1234}};
+}
+
+// saves the state of a loader in the second epoch, part way into a block and a decoder
+// batch, and checks that a loader restored from it continues with the same batches
+static json check_restore_state(const nlohmann::json& config)
+{
+    auto read_batch = [](loader& ld) {
+        const fixed_buffer_map& buffer = *ld.get_current_iter();
+        vector<char>            data;
+        for (const string& name : {"image", "label"})
+        {
+            const char* p = buffer[name]->data();
+            data.insert(data.end(), p, p + buffer[name]->size());
+        }
+        return data;
+    };
+
+    loader_local saved{config};
+    saved.reset();
+    for (int i = 0; i < 7; i++)
+    {
+        saved.get_current_iter()++;
+    }
+    json                 state    = saved.save_state();
+    size_t               position = saved.position();
+    vector<vector<char>> expected;
+    for (int i = 0; i < 10; i++)
+    {
+        expected.push_back(read_batch(saved));
+        saved.get_current_iter()++;
+    }
+
+    loader_local restored{config};
+    restored.restore_state(json::parse(state.dump()));
+    EXPECT_EQ(position, restored.position());
+    for (int i = 0; i < 10; i++)
+    {
+        EXPECT_EQ(expected[i], read_batch(restored));
+        restored.get_current_iter()++;
+    }
+    return state;
+}
+
+TEST(loader, restore_state)
+{
+    nlohmann::json config = restore_state_config();
+    json           state  = check_restore_state(config);
+
+    config["batch_size"] = 2;
+    loader_local other{config};
+    EXPECT_THROW(other.restore_state(state), std::invalid_argument);
+}
+
+TEST(loader, restore_state_shuffle_buffer)
+{
+    nlohmann::json config         = restore_state_config();
+    config["shuffle_buffer_size"] = 12;
+
+    json state = check_restore_state(config);
+    EXPECT_EQ(1, state.count("shuffle_buffer"));
+
+    config.erase("shuffle_buffer_size");
+    loader_local other{config};
+    EXPECT_THROW(other.restore_state(state), std::invalid_argument);
+}
+
+TEST(loader, restore_state_cache)
+{
+    string         cache_root = file_util::make_temp_directory();
+    nlohmann::json config     = restore_state_config();
+    config["cache_directory"] = cache_root;
+
+    // the cache is written during the first epoch, so the saved epoch is read from it
+    {
+        loader_local writer{config};
+        writer.reset();
+        for (int i = 0; i < 2 * writer.batch_count(); i++)
+        {
+            writer.get_current_iter()++;
+        }
+    }
+    json state = check_restore_state(config);
+    EXPECT_EQ("cache", state["blocks"]["source"]);
+
+    file_util::remove_directory(cache_root);
+}
+
 #if defined(ENABLE_AEON_SERVICE)
 TEST(loader, loader_factory_no_remote)
 {
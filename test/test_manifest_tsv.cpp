@@ -26,6 +26,7 @@
 #include <memory>
 
 #include <chrono>
+#include <algorithm>
 
 #include "gtest/gtest.h"
 #include "manifest_file.hpp"
@@ -396,7 +397,7 @@ TEST(manifest, binary)
             encoded_record record   = buffer->record(j);
             auto           idata    = record.element(0);
             auto           tdata    = record.element(1);
-            string         str      = vector2string(tdata);
+            string         str{tdata.data(), tdata.size()};
             string         expected = make_target_data(index);
             index                   = (index + 1) % manifest->record_count();
             EXPECT_STREQ(expected.c_str(), str.c_str());
@@ -447,7 +448,7 @@ TEST(manifest, string)
             encoded_record record   = buffer->record(j);
             auto           idata    = record.element(0);
             auto           tdata    = record.element(1);
-            string         str      = vector2string(tdata);
+            string         str{tdata.data(), tdata.size()};
             string         expected = make_target_data(index);
             index                   = (index + 1) % manifest->record_count();
             EXPECT_STREQ(expected.c_str(), str.c_str());
@@ -542,6 +543,60 @@ TEST(manifest, ascii_float)
     }
 }
 
+TEST(manifest, ascii_invalid)
+{
+    stringstream ss;
+    ss << "@FILE"
+       << "\t"
+       << "ASCII_INT"
+       << "\n";
+    ss << "flowers.jpg"
+       << "\t"
+       << "1"
+       << "\n";
+    ss << "flowers.jpg"
+       << "\t"
+       << "not_a_number"
+       << "\n";
+
+    // numeric elements are converted when the manifest is loaded
+    EXPECT_THROW(manifest_file(ss, false), std::invalid_argument);
+
+    // the whole element must convert and fit the type, trailing white space is allowed
+    auto load = [](const string& type, const string& value) {
+        stringstream manifest;
+        manifest << "@FILE\t" << type << "\n";
+        manifest << "flowers.jpg\t" << value << "\n";
+        manifest_file m(manifest, false);
+    };
+    EXPECT_NO_THROW(load("ASCII_INT", "-2147483648"));
+    EXPECT_NO_THROW(load("ASCII_INT", "12\r"));
+    EXPECT_NO_THROW(load("ASCII_INT", "1.0"));
+    EXPECT_NO_THROW(load("ASCII_INT", "1e3"));
+    EXPECT_NO_THROW(load("ASCII_INT", "2147483647.9"));
+    EXPECT_NO_THROW(load("ASCII_FLOAT", "1.5e3"));
+    EXPECT_THROW(load("ASCII_INT", "2147483648"), std::invalid_argument);
+    EXPECT_THROW(load("ASCII_INT", "99999999999999999999"), std::invalid_argument);
+    EXPECT_THROW(load("ASCII_INT", "12abc"), std::invalid_argument);
+    EXPECT_THROW(load("ASCII_INT", "nan"), std::invalid_argument);
+    EXPECT_THROW(load("ASCII_INT", ""), std::invalid_argument);
+    EXPECT_THROW(load("ASCII_FLOAT", "1.5x"), std::invalid_argument);
+    EXPECT_THROW(load("ASCII_FLOAT", "1e99"), std::invalid_argument);
+
+    // decimal ASCII_INT values are truncated toward zero
+    auto value = [](const string& text) {
+        stringstream manifest;
+        manifest << "@FILE\tASCII_INT\n";
+        manifest << "flowers.jpg\t" << text << "\n";
+        auto              m = make_shared<manifest_file>(manifest, false, test_data_directory);
+        block_loader_file loader{m, 1};
+        return unpack<int32_t>(loader.filler()->record(0).element(1).data());
+    };
+    EXPECT_EQ(1, value("1.0"));
+    EXPECT_EQ(1000, value("1e3"));
+    EXPECT_EQ(-2, value("-2.7"));
+}
+
 extern string test_cache_directory;
 
 class manifest_manager
@@ -619,6 +674,126 @@ TEST(manifest, manifest_shuffle_repeatable)
     EXPECT_EQ(manifest1.get_crc(), manifest2.get_crc());
 }
 
+namespace
+{
+    vector<string> shard_records(manifest_file& manifest)
+    {
+        vector<string> names;
+        for (size_t i = 0; i < manifest.block_count(); i++)
+        {
+            for (const auto& record : *manifest.next())
+            {
+                names.push_back(record[0]);
+            }
+        }
+        manifest.reset();
+        return names;
+    }
+}
+
+TEST(manifest, shard)
+{
+    const size_t   record_count = 103;
+    const size_t   shard_count  = 4;
+    const uint32_t seed         = 1234;
+
+    for (bool shuffle : {false, true})
+    {
+        vector<string> all;
+        for (size_t index = 0; index < shard_count; index++)
+        {
+            manifest_builder mb;
+            auto&            ms = mb.sizes({4, 4}).record_count(record_count).create();
+            manifest_file    manifest(ms, shuffle, "", 1.0, 10, seed, shard_count, index);
+
+            // shard sizes are balanced within one record
+            EXPECT_GE(manifest.record_count(), record_count / shard_count);
+            EXPECT_LE(manifest.record_count(), record_count / shard_count + 1);
+            auto names = shard_records(manifest);
+            EXPECT_EQ(manifest.record_count(), names.size());
+            all.insert(all.end(), names.begin(), names.end());
+        }
+
+        // shards are disjoint and together cover the manifest
+        ASSERT_EQ(record_count, all.size());
+        sort(all.begin(), all.end());
+        EXPECT_EQ(all.end(), unique(all.begin(), all.end()));
+    }
+}
+
+TEST(manifest, shard_crc)
+{
+    manifest_builder mb1;
+    auto&            ms1 = mb1.sizes({4, 4}).record_count(20).create();
+    manifest_file    manifest1(ms1, false, "", 1.0, 5000, 0, 2, 0);
+
+    manifest_builder mb2;
+    auto&            ms2 = mb2.sizes({4, 4}).record_count(20).create();
+    manifest_file    manifest2(ms2, false, "", 1.0, 5000, 0, 2, 1);
+
+    // different shards must not share a cache
+    EXPECT_NE(manifest1.get_crc(), manifest2.get_crc());
+}
+
+TEST(manifest, shard_invalid)
+{
+    manifest_builder mb;
+    auto&            ms = mb.sizes({4, 4}).record_count(20).create();
+    EXPECT_THROW(manifest_file(ms, false, "", 1.0, 5000, 0, 2, 2), std::invalid_argument);
+    // shuffled shards need a shared seed
+    EXPECT_THROW(manifest_file(ms, true, "", 1.0, 5000, 0, 2, 0), std::invalid_argument);
+}
+
+TEST(manifest, shard_reshuffle)
+{
+    const size_t   record_count = 50;
+    const size_t   shard_count  = 3;
+    const uint32_t seed         = 1234;
+    const size_t   epochs       = 3;
+
+    vector<vector<string>> epoch_records(epochs);
+    for (size_t index = 0; index < shard_count; index++)
+    {
+        manifest_builder mb;
+        auto&            ms = mb.sizes({4, 4}).record_count(record_count).create();
+        manifest_file    manifest(ms, false, "", 1.0, 8, seed, shard_count, index, true);
+
+        size_t size   = manifest.record_count();
+        size_t blocks = manifest.block_count();
+        for (size_t epoch = 0; epoch < epochs; epoch++)
+        {
+            EXPECT_EQ(size, manifest.record_count());
+            EXPECT_EQ(blocks, manifest.block_count());
+            auto names = shard_records(manifest);
+            epoch_records[epoch].insert(epoch_records[epoch].end(), names.begin(), names.end());
+        }
+    }
+
+    // every epoch is a partition of the manifest, with different shard membership
+    for (auto& names : epoch_records)
+    {
+        ASSERT_EQ(record_count, names.size());
+    }
+    EXPECT_NE(epoch_records[0], epoch_records[1]);
+    for (auto& names : epoch_records)
+    {
+        sort(names.begin(), names.end());
+        EXPECT_EQ(names.end(), unique(names.begin(), names.end()));
+    }
+
+    // membership depends only on the seed and the epoch
+    manifest_builder mb;
+    auto&            ms = mb.sizes({4, 4}).record_count(record_count).create();
+    manifest_file    manifest(ms, false, "", 1.0, 8, seed, shard_count, 0, true);
+    manifest_builder mb_again;
+    auto&            ms_again = mb_again.sizes({4, 4}).record_count(record_count).create();
+    manifest_file    again(ms_again, false, "", 1.0, 8, seed, shard_count, 0, true);
+    for (size_t epoch = 0; epoch < epochs; epoch++)
+    {
+        EXPECT_EQ(shard_records(manifest), shard_records(again));
+    }
+}
+
 TEST(manifest, subset_fraction)
 {
     string           source_dir = file_util::make_temp_directory(test_cache_directory);
@@ -705,6 +880,167 @@ TEST(manifest, crc_root_dir)
     EXPECT_EQ(manifest1_crc, manifest2_crc);
 }
 
+TEST(manifest, mapped_matches_stream)
+{
+    // large enough to be split into several chunks on a multi-core machine
+    stringstream ss;
+    ss << "# header comment\n";
+    ss << manifest_file::get_metadata_char();
+    ss << manifest_file::get_file_type_id() << manifest_file::get_delimiter()
+       << manifest_file::get_ascii_int_type_id() << "\n";
+    for (size_t i = 0; i < 200000; i++)
+    {
+        ss << "relative/path/image" << i << ".jpg" << manifest_file::get_delimiter() << i << "\n";
+        if (i % 1000 == 0)
+        {
+            ss << "\n# comment\n";
+        }
+    }
+    string manifest_filename = file_util::tmp_filename(".tsv");
+    {
+        ofstream f(manifest_filename);
+        f << ss.str();
+    }
+
+    const uint32_t seed       = 1234;
+    const size_t   block_size = 5000;
+    for (float subset_fraction : {1.0f, 0.3f})
+    {
+        for (bool shuffle : {false, true})
+        {
+            stringstream  tmp{ss.str()};
+            manifest_file serial(tmp, shuffle, "/root1", subset_fraction, block_size, seed);
+            manifest_file mapped(
+                manifest_filename, shuffle, "/root1", subset_fraction, block_size, seed);
+
+            EXPECT_EQ(serial.get_crc(), mapped.get_crc());
+            ASSERT_EQ(serial.record_count(), mapped.record_count());
+            ASSERT_EQ(serial.block_count(), mapped.block_count());
+            for (size_t i = 0; i < serial.block_count(); i++)
+            {
+                ASSERT_EQ(*serial.next(), *mapped.next());
+            }
+        }
+    }
+
+    // errors must report the same line as the serial parser
+    {
+        ofstream f(manifest_filename, ios::app);
+        f << "a" << manifest_file::get_delimiter() << "b" << manifest_file::get_delimiter()
+          << "c\n";
+    }
+    string serial_error;
+    string mapped_error;
+    try
+    {
+        stringstream tmp{ss.str() + "a\tb\tc\n"};
+        manifest_file serial(tmp, false);
+    }
+    catch (std::runtime_error& e)
+    {
+        serial_error = e.what();
+    }
+    try
+    {
+        manifest_file mapped(manifest_filename, false);
+    }
+    catch (std::runtime_error& e)
+    {
+        mapped_error = e.what();
+    }
+    EXPECT_FALSE(serial_error.empty());
+    EXPECT_EQ(serial_error, mapped_error);
+
+    remove(manifest_filename.c_str());
+}
+
+TEST(manifest, index)
+{
+    string manifest_filename = file_util::tmp_filename(".tsv");
+    {
+        ofstream f(manifest_filename);
+        f << manifest_file::get_metadata_char();
+        f << manifest_file::get_file_type_id() << manifest_file::get_delimiter()
+          << manifest_file::get_string_type_id() << "\n";
+        for (size_t i = 0; i < 1000; i++)
+        {
+            f << "image" << i << ".jpg" << manifest_file::get_delimiter() << i << "\n";
+        }
+    }
+
+    const uint32_t seed            = 1234;
+    const size_t   block_size      = 64;
+    const float    subset_fraction = 0.5;
+    const bool     use_index       = true;
+    const string   root            = "/root1";
+
+    manifest_file parsed(manifest_filename, true, root, subset_fraction, block_size, seed);
+    string        index_filename = parsed.get_index_filename();
+    remove(index_filename.c_str());
+
+    {
+        // first pass writes the index, second pass reads it
+        manifest_file created(
+            manifest_filename, true, root, subset_fraction, block_size, seed, use_index);
+        ASSERT_TRUE(file_util::exists(index_filename));
+        manifest_file indexed(
+            manifest_filename, true, root, subset_fraction, block_size, seed, use_index);
+
+        EXPECT_EQ(parsed.get_crc(), indexed.get_crc());
+        EXPECT_EQ(parsed.get_element_types(), indexed.get_element_types());
+        ASSERT_EQ(parsed.record_count(), indexed.record_count());
+        for (size_t i = 0; i < parsed.record_count(); i++)
+        {
+            ASSERT_EQ(parsed[i], indexed[i]);
+        }
+    }
+
+    {
+        // a different manifest_root invalidates the index
+        manifest_file indexed(
+            manifest_filename, false, "/root2", subset_fraction, block_size, seed, use_index);
+        EXPECT_EQ(0, indexed[0][0].find("/root2/"));
+    }
+
+    {
+        // so does a change to the manifest itself
+        ofstream f(manifest_filename, ios::app);
+        f << "image" << 1000 << ".jpg" << manifest_file::get_delimiter() << 1000 << "\n";
+    }
+    {
+        manifest_file indexed(manifest_filename, false, root, 1.0, block_size, seed, use_index);
+        EXPECT_EQ(1001, indexed.record_count());
+    }
+
+    {
+        // a damaged index is ignored and rebuilt
+        fstream f(index_filename, ios::in | ios::out | ios::binary);
+        f << "garbage";
+    }
+    {
+        manifest_file indexed(manifest_filename, false, root, 1.0, block_size, seed, use_index);
+        manifest_file expected(manifest_filename, false, root, 1.0, block_size, seed);
+        EXPECT_EQ(expected.get_crc(), indexed.get_crc());
+        EXPECT_EQ(1001, indexed.record_count());
+    }
+
+    {
+        // record and element counts whose offset table size overflows are rejected
+        uint64_t counts[] = {uint64_t(1) << 61, 8};
+        fstream  f(index_filename, ios::in | ios::out | ios::binary);
+        f.seekp(32);
+        f.write(reinterpret_cast<const char*>(counts), sizeof(counts));
+    }
+    {
+        manifest_file indexed(manifest_filename, false, root, 1.0, block_size, seed, use_index);
+        EXPECT_EQ(1001, indexed.record_count());
+        EXPECT_EQ(0, indexed[1000][0].find(root + "/image1000.jpg"));
+    }
+
+    remove(index_filename.c_str());
+    remove(manifest_filename.c_str());
+}
+
 TEST(manifest, comma)
 {
     string manifest_file = "tmp_manifest.tsv";
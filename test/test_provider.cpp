@@ -219,6 +219,52 @@ TEST(provider, blob)
     }
 }
 
+TEST(provider, multicrop)
+{
+    const int      width      = 64;
+    const int      height     = 48;
+    const int      crop_count = 6;
+    nlohmann::json view       = {{"channel_major", false}, {"height", height}, {"width", width}};
+    nlohmann::json multicrop  = {{"type", "multicrop"}, {"crop_count", crop_count}, {"image", view}};
+    nlohmann::json image      = view;
+    image["type"]             = "image";
+    nlohmann::json aug = {{"type", "image"}, {"flip_enable", true}, {"scale", {0.5, 1.0}}};
+    nlohmann::json js  = {{"etl", {multicrop, image}}, {"augmentation", {aug}}};
+
+    vector<char> input = file_util::read_file_contents(CURDIR "/test_data/img_2112_70.jpg");
+
+    auto media = nervana::provider_factory::create(js);
+    ASSERT_NE(nullptr, media);
+    auto oshapes = media->get_output_shapes();
+
+    vector<size_t> expected_shape = {crop_count, height, width, 3};
+    EXPECT_EQ(expected_shape, media->get_output_shape("multicrop").get_shape());
+    size_t view_size = media->get_output_shape("image").get_byte_size();
+    ASSERT_EQ(crop_count * view_size, media->get_output_shape("multicrop").get_byte_size());
+
+    fixed_buffer_map    out_buf(oshapes, 1);
+    encoded_record_list in_buf;
+    encoded_record      record;
+    record.add_element(input);
+    record.add_element(input);
+    in_buf.add_record(record);
+
+    media->provide(0, in_buf, out_buf);
+
+    // the first view's params are shared with the other providers of the record
+    char* views = out_buf["multicrop"]->data();
+    char* first = out_buf["image"]->data();
+    EXPECT_EQ(0, memcmp(views, first, view_size));
+
+    // every view is its own crop of the one decoded image
+    int distinct = 0;
+    for (int i = 1; i < crop_count; i++)
+    {
+        distinct += memcmp(views + i * view_size, first, view_size) != 0;
+    }
+    EXPECT_GT(distinct, 0);
+}
+
 TEST(provider, char_map)
 {
     string alphabet      = "ABCDEFGHIJKLMNOPQRSTUVWXYZ .,()敏捷的棕色狐狸跳過了懶狗";
@@ -19,6 +19,7 @@
 
 #include "gtest/gtest.h"
 
+#include "etl_image.hpp"
 #include "raw_image.hpp"
 
 using namespace std;
@@ -57,3 +58,80 @@ TEST(raw_image, write_read)
         cv::imwrite("raw.png", mat);
     }
 }
+
+TEST(raw_image, wrap)
+{
+    auto         mat = generate_indexed_image();
+    stringstream ss;
+    raw_image::from_cvmat(mat).write(ss);
+    string data = ss.str();
+
+    cv::Mat image;
+    ASSERT_TRUE(raw_image::wrap(data.data(), data.size(), image));
+    EXPECT_EQ(CV_8UC3, image.type());
+    EXPECT_EQ(mat.size(), image.size());
+    EXPECT_EQ(0, cv::norm(mat, image, cv::NORM_INF));
+
+    // the pixels are not copied
+    EXPECT_EQ(data.data() + data.size() - mat.total() * mat.elemSize(), (char*)image.data);
+
+    // anything else is left to the image decoders
+    vector<unsigned char> png;
+    cv::imencode(".png", mat, png);
+    EXPECT_FALSE(raw_image::wrap(png.data(), png.size(), image));
+    EXPECT_FALSE(raw_image::wrap(data.data(), data.size() - 1, image));
+}
+
+TEST(raw_image, wrap_big_endian)
+{
+    cv::Mat mat(3, 5, CV_16UC1);
+    for (int i = 0; i < mat.total(); i++)
+    {
+        mat.at<uint16_t>(i) = 0x0102 * i;
+    }
+
+    stringstream ss;
+    ss << "width: 5\nheight: 3\nchannels: 1\nbitwidth: 16\nis_float: 0\nis_big_endian: 1\n\n";
+    for (int i = 0; i < mat.total(); i++)
+    {
+        uint16_t v = mat.at<uint16_t>(i);
+        ss.put(v >> 8);
+        ss.put(v & 0xFF);
+    }
+    string data = ss.str();
+
+    cv::Mat image;
+    ASSERT_TRUE(raw_image::wrap(data.data(), data.size(), image));
+    EXPECT_EQ(CV_16UC1, image.type());
+    EXPECT_EQ(0, cv::norm(mat, image, cv::NORM_INF));
+}
+
+TEST(raw_image, extract)
+{
+    auto         mat = generate_indexed_image();
+    stringstream ss;
+    raw_image::from_cvmat(mat).write(ss);
+    string data = ss.str();
+    string copy = data;
+
+    nlohmann::json   js = {{"width", 128}, {"height", 128}};
+    image::config    cfg(js);
+    image::extractor extractor(cfg);
+    auto             decoded = extractor.extract(data.data(), data.size());
+    ASSERT_NE(nullptr, decoded);
+    EXPECT_EQ(0, cv::norm(mat, decoded->get_image(0), cv::NORM_INF));
+    EXPECT_GE((char*)decoded->get_image(0).data, data.data());
+    EXPECT_LT((char*)decoded->get_image(0).data, data.data() + data.size());
+
+    // augmenting an image that needs no resize leaves the record alone
+    nlohmann::json aug = {{"type", "image"},
+                          {"crop_enable", false},
+                          {"flip_enable", true},
+                          {"brightness", {0.5, 0.5}}};
+    augment::image::param_factory factory(aug);
+    image::transformer            transformer(cfg);
+    auto params = factory.make_params(mat.cols, mat.rows, mat.cols, mat.rows);
+    transformer.transform(params, decoded);
+    EXPECT_EQ(copy, data);
+}
+
@@ -0,0 +1,179 @@
+/*******************************************************************************
+* Copyright 2017-2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#include <numeric>
+#include <set>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "manifest_builder.hpp"
+#include "manifest_file.hpp"
+#include "block_loader_file.hpp"
+#include "block_manager.hpp"
+#include "shuffle_buffer.hpp"
+#include "helpers.hpp"
+
+using namespace std;
+using namespace nervana;
+using nlohmann::json;
+
+// read one epoch worth of record numbers from a shuffle_buffer over a sequential manifest
+static vector<size_t> read_epoch(size_t   record_count,
+                                 size_t   block_size,
+                                 size_t   buffer_size,
+                                 size_t   output_size,
+                                 uint32_t seed)
+{
+    manifest_builder mb;
+    stringstream&    manifest_stream = mb.sizes({4, 4}).record_count(record_count).create();
+
+    auto manifest     = make_shared<manifest_file>(manifest_stream, false, "", 1.0, block_size);
+    auto block_loader = make_shared<block_loader_file>(manifest, block_size);
+    auto block_mgr    = make_shared<block_manager>(block_loader, block_size, "", false);
+    shuffle_buffer buffer(block_mgr, buffer_size, output_size, record_count, seed);
+
+    vector<size_t> rc;
+    while (rc.size() < record_count)
+    {
+        encoded_record_list* list = buffer.next();
+        EXPECT_NE(nullptr, list);
+        if (list == nullptr)
+        {
+            break;
+        }
+        EXPECT_GE(output_size, list->size());
+        for (const encoded_record& record : *list)
+        {
+            string element = element2string(record.element(0));
+            rc.push_back(stoul(element.substr(0, element.find(':'))));
+        }
+    }
+    return rc;
+}
+
+TEST(shuffle_buffer, epoch_is_permutation)
+{
+    size_t         record_count = 100;
+    vector<size_t> order        = read_epoch(record_count, 10, 30, 8, 1234);
+
+    ASSERT_EQ(record_count, order.size());
+    set<size_t> unique(order.begin(), order.end());
+    EXPECT_EQ(record_count, unique.size());
+    EXPECT_EQ(0, *unique.begin());
+    EXPECT_EQ(record_count - 1, *unique.rbegin());
+}
+
+TEST(shuffle_buffer, mixes_blocks)
+{
+    size_t         block_size = 10;
+    vector<size_t> order      = read_epoch(100, block_size, 30, 10, 1234);
+
+    // records of the first output list must not all come from the same block
+    set<size_t> blocks;
+    for (size_t i = 0; i < block_size; i++)
+    {
+        blocks.insert(order[i] / block_size);
+    }
+    EXPECT_LT(1, blocks.size());
+}
+
+TEST(shuffle_buffer, deterministic)
+{
+    vector<size_t> order1 = read_epoch(100, 10, 30, 8, 1234);
+    vector<size_t> order2 = read_epoch(100, 10, 30, 8, 1234);
+    vector<size_t> order3 = read_epoch(100, 10, 30, 8, 4321);
+
+    EXPECT_EQ(order1, order2);
+    EXPECT_NE(order1, order3);
+}
+
+TEST(shuffle_buffer, buffer_size_is_bound)
+{
+    // a buffer of one record has nothing to draw from, blocks pass through in order
+    vector<size_t> order = read_epoch(100, 10, 1, 8, 1234);
+    vector<size_t> expected(100);
+    iota(expected.begin(), expected.end(), 0);
+    EXPECT_EQ(expected, order);
+}
+
+// a shuffle_buffer over a shuffled manifest, reading record numbers
+struct shuffle_pipeline
+{
+    shuffle_pipeline(size_t record_count, size_t block_size, size_t output_size)
+    {
+        manifest_builder mb;
+        stringstream&    stream = mb.sizes({4, 4}).record_count(record_count).create();
+
+        manifest    = make_shared<manifest_file>(stream, true, "", 1.0, block_size, 1234);
+        auto loader = make_shared<block_loader_file>(manifest, block_size);
+        block_mgr   = make_shared<block_manager>(loader, block_size, "", false);
+        buffer      = make_shared<shuffle_buffer>(block_mgr, 30, output_size, record_count, 1234);
+    }
+
+    vector<size_t> read(size_t count)
+    {
+        vector<size_t> rc;
+        while (rc.size() < count)
+        {
+            encoded_record_list* list = buffer->next();
+            EXPECT_NE(nullptr, list);
+            if (list == nullptr)
+            {
+                break;
+            }
+            for (const encoded_record& record : *list)
+            {
+                string element = element2string(record.element(0));
+                rc.push_back(stoul(element.substr(0, element.find(':'))));
+            }
+        }
+        return rc;
+    }
+
+    shared_ptr<manifest_file>  manifest;
+    shared_ptr<block_manager>  block_mgr;
+    shared_ptr<shuffle_buffer> buffer;
+};
+
+TEST(shuffle_buffer, restore_state)
+{
+    // the saved record is in the second epoch, part way into an output list
+    size_t           stream_offset = 130;
+    size_t           count         = 120;
+    shuffle_pipeline saved(100, 10, 8);
+    vector<size_t>   expected = saved.read(stream_offset + count);
+
+    json   shuffle_state = saved.buffer->get_state(stream_offset);
+    size_t epoch         = shuffle_state["epoch"];
+    size_t origin        = shuffle_state["origin"];
+    EXPECT_EQ(1, epoch);
+    EXPECT_EQ(124, shuffle_state["stream_offset"]);
+    // some records of the last block read are waiting for room in the buffer
+    EXPECT_LT(0, shuffle_state["pending"].get<size_t>());
+
+    json   blocks         = saved.block_mgr->get_state(epoch, origin);
+    size_t manifest_epoch = blocks["manifest_epoch"];
+    json   manifest_state = saved.manifest->get_state(manifest_epoch, origin);
+
+    shuffle_pipeline restored(100, 10, 8);
+    restored.manifest->set_state(manifest_state, manifest_epoch);
+    restored.block_mgr->set_state(blocks, manifest_state["block_index"]);
+    restored.buffer->set_state(json::parse(shuffle_state.dump()), stream_offset);
+
+    vector<size_t> actual = restored.read(count);
+    ASSERT_LE(count, actual.size());
+    EXPECT_TRUE(equal(actual.begin(), actual.begin() + count, expected.begin() + stream_offset));
+}
@@ -18,9 +18,11 @@
 #include <string>
 #include <sstream>
 #include <random>
+#include <cmath>
 
 #include "gtest/gtest.h"
 #include "typemap.hpp"
+#include "float16.hpp"
 #include "json.hpp"
 #include <typeinfo>
 #include <typeindex>
@@ -36,6 +38,63 @@ TEST(typemap, numpy)
     }
 }
 
+TEST(typemap, half)
+{
+    output_type half{"float16"};
+    output_type bf16{"bfloat16"};
+    EXPECT_EQ(2, half.get_size());
+    EXPECT_EQ(2, bf16.get_size());
+    EXPECT_TRUE(half.is_half());
+    EXPECT_TRUE(bf16.is_half());
+    EXPECT_FALSE(output_type{"uint16_t"}.is_half());
+
+    // long enough for the vector loops and their scalar tails
+    vector<float> values = {0.0f, -0.0f, 1.0f, -2.5f, 65504.0f, 65520.0f, 1e-7f, 3.14159f,
+                            0.1f, 1000.5f, -1e30f, 5.96e-8f, 1.0009765625f, 1.00048828125f,
+                            NAN, INFINITY, -INFINITY, 255.0f, 1.5f};
+    vector<uint16_t> expected_half = {0x0000, 0x8000, 0x3C00, 0xC100, 0x7BFF, 0x7C00, 0x0002,
+                                      0x4248, 0x2E66, 0x63D1, 0xFC00, 0x0001, 0x3C01, 0x3C00,
+                                      0x7E00, 0x7C00, 0xFC00, 0x5BF8, 0x3E00};
+    vector<uint16_t> out(values.size());
+
+    float_to_half(values.data(), out.data(), values.size());
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        if (std::isnan(values[i]))
+        {
+            EXPECT_TRUE(std::isnan(half_to_float(out[i])));
+        }
+        else
+        {
+            EXPECT_EQ(expected_half[i], out[i]) << "at " << values[i];
+        }
+    }
+
+    convert_to_half(values.data(), out.data(), values.size(), bf16);
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        float f = bfloat16_to_float(out[i]);
+        if (std::isnan(values[i]))
+        {
+            EXPECT_TRUE(std::isnan(f));
+        }
+        else if (std::isinf(values[i]))
+        {
+            EXPECT_EQ(values[i], f);
+        }
+        else
+        {
+            // 8 bits of precision
+            EXPECT_NEAR(values[i], f, std::abs(values[i]) / 256) << "at " << values[i];
+        }
+    }
+    EXPECT_EQ(0x3F80, out[2]);
+    EXPECT_EQ(0x4049, out[7]);
+
+    EXPECT_THROW(convert_to_half(values.data(), out.data(), 1, output_type{"float"}),
+                 std::invalid_argument);
+}
+
 TEST(typemap, otype_serialize)
 {
     {
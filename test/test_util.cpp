@@ -43,6 +43,7 @@
 #include "etl_pixel_mask.hpp"
 #include "etl_video.hpp"
 #include "loader.hpp"
+#include "object_pool.hpp"
 
 using namespace std;
 using namespace nervana;
@@ -566,3 +567,39 @@ TEST(util, almost_equal_or_less)
                                         << get<1>(test) << ") = " << get<2>(test);
     }
 }
+
+TEST(util, object_pool)
+{
+    struct item
+    {
+        void reset()
+        {
+            value = 0;
+            reset_count++;
+        }
+        int value       = 0;
+        int reset_count = 0;
+    };
+
+    shared_ptr<item> first = object_pool<item>::acquire();
+    first->value           = 1;
+    shared_ptr<item> held  = object_pool<item>::acquire();
+    held->value            = 2;
+    EXPECT_NE(first, held);
+
+    // a released object is reset once and comes back empty
+    item* released = first.get();
+    first          = nullptr;
+    first          = object_pool<item>::acquire();
+    EXPECT_EQ(released, first.get());
+    EXPECT_EQ(0, first->value);
+    EXPECT_EQ(1, first->reset_count);
+    EXPECT_EQ(2, held->value);
+    EXPECT_EQ(0, held->reset_count);
+
+    // each thread has a pool of its own
+    item* other = async(launch::async, [] { return object_pool<item>::acquire().get(); }).get();
+    EXPECT_NE(first.get(), other);
+    EXPECT_NE(held.get(), other);
+}
+